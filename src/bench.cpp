@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "interpreter/Scanner.hpp"
+#include "interpreter/error.hpp"
+#include "interpreter/IncrementalParser.hpp"
+#include "interpreter/Parser.hpp"
+#include "interpreter/Interpreter.hpp"
+#include "interpreter/Resolver.hpp"
+#include "interpreter/TypeInference.hpp"
+
+// Times the scanner, parser, static analysis and interpreter phases of each workload
+// separately, and an incremental reparse after a one-byte edit. Results go to stdout as a table and optionally to a CSV file
+// that a later run can be compared against with --compare. A workload that does not parse or
+// run fails the run, so the suite doubles as a test that every workload still works.
+
+struct Workload {
+  std::string name;
+  std::string source;
+};
+
+struct Stats {
+  int reps;
+  double min;
+  double median;
+  double mean;
+  double stddev;
+  double max;
+};
+
+struct Options {
+  int reps { 10 };
+  int warmup { 1 };
+  int generatedFunctions { 2000 };
+  std::string label { "current" };
+  std::string csvPath;
+  std::string comparePath;
+  std::string emitGeneratedPath;
+  std::vector<std::string> paths;
+};
+
+class NullBuffer : public std::streambuf {
+protected:
+  int overflow(int c) override { return c; }
+  std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+};
+
+Stats summarize(std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+  Stats stats { static_cast<int>(samples.size()), 0, 0, 0, 0, 0 };
+  if (samples.empty())
+    return stats;
+  stats.min = samples.front();
+  stats.max = samples.back();
+  size_t mid = samples.size() / 2;
+  stats.median = samples.size() % 2 ? samples[mid] : (samples[mid - 1] + samples[mid]) / 2;
+  for (double sample : samples)
+    stats.mean += sample;
+  stats.mean /= samples.size();
+  for (double sample : samples)
+    stats.stddev += (sample - stats.mean) * (sample - stats.mean);
+  stats.stddev = std::sqrt(stats.stddev / samples.size());
+  return stats;
+}
+
+template<typename Fn>
+double timeNs(Fn &&fn) {
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+// Synthesizes a large program exercising every token kind the scanner
+// knows and most of the grammar, for lexer and parser throughput.
+std::string generateLargeSource(int functions) {
+  std::ostringstream oss;
+  oss << "// generated by lox_bench\n";
+  for (int i = 0; i < functions; ++i) {
+    oss << "fun generated" << i << "(a, b, c) {\n"
+        << "  var local" << i << " = (a + b) * c - " << i << ".5 / 2;\n"
+        << "  /* block comment " << i << " */\n"
+        << "  if (local" << i << " >= " << i << " or a != b) {\n"
+        << "    local" << i << " = \"prefix " << i << " \" + local" << i << ";\n"
+        << "  } else {\n"
+        << "    while (a <= c) { a = a + 1; }\n"
+        << "  }\n"
+        << "  for (var j = 0; j < 3; j = j + 1) { b = -b; }\n"
+        << "  var flag = !(a == b) or local" << i << ";\n"
+        << "  return a + b;\n"
+        << "}\n";
+  }
+  oss << "var total = 0;\n";
+  for (int i = 0; i < functions; i += 100)
+    oss << "total = total + generated" << i << "(1, 2, 3);\n";
+  return oss.str();
+}
+
+bool readFile(const std::filesystem::path &path, std::string &out) {
+  std::ifstream f(path);
+  if (!f)
+    return false;
+  std::stringstream buff;
+  buff << f.rdbuf();
+  out = buff.str();
+  return true;
+}
+
+std::vector<Workload> loadWorkloads(const Options &options) {
+  std::vector<Workload> workloads;
+  std::vector<std::string> paths = options.paths;
+  if (paths.empty())
+    paths.push_back("benchmarks");
+
+  for (const std::string &path : paths) {
+    std::vector<std::filesystem::path> files;
+    if (std::filesystem::is_directory(path)) {
+      for (auto &entry : std::filesystem::directory_iterator(path))
+        if (entry.path().extension() == ".lox")
+          files.push_back(entry.path());
+      std::sort(files.begin(), files.end());
+    } else {
+      files.push_back(path);
+    }
+    for (auto &file : files) {
+      Workload workload { file.stem().string(), "" };
+      if (!readFile(file, workload.source))
+        std::cerr << "lox_bench: cannot read " << file << std::endl;
+      else
+        workloads.push_back(std::move(workload));
+    }
+  }
+  workloads.push_back({ "generated", generateLargeSource(options.generatedFunctions) });
+  return workloads;
+}
+
+std::map<std::string, Stats> runWorkload(const Workload &workload, const Options &options) {
+  std::vector<double> scan, parse, analyze, interpret, reparse;
+  NullBuffer null;
+  // a space at the end of the middle line: no line moves, so everything
+  // but the declaration holding it can be reused
+  std::string edited = workload.source;
+  size_t middle = edited.find('\n', edited.size() / 2);
+  edited.insert(middle == std::string::npos ? edited.size() : middle, " ");
+
+  for (int rep = 0; rep < options.warmup + options.reps; ++rep) {
+    hadRuntimeError = false;
+
+    Diagnostics diagnostics;
+    std::vector<Token> tokens;
+    double scanNs = timeNs([&] {
+      Scanner scanner(workload.source, diagnostics);
+      tokens = scanner.scanTokens();
+    });
+
+    std::vector<std::shared_ptr<Stmt>> statements;
+    double parseNs = timeNs([&] {
+      Parser parser { tokens, diagnostics };
+      statements = parser.parse();
+    });
+    if (diagnostics.hasErrors()) {
+      std::cerr << "lox_bench: " << workload.name << " has syntax errors" << std::endl;
+      return {};
+    }
+
+    double analyzeNs = timeNs([&] {
+      Resolver resolver { diagnostics };
+      resolver.resolve(statements);
+      TypeInference { resolver }.analyze(statements);
+    });
+
+    IncrementalParser incremental;
+    Diagnostics ignored;
+    incremental.update(workload.source, ignored);
+    double reparseNs = timeNs([&] { incremental.update(edited, ignored); });
+
+    Interpreter interpreter { };
+    std::streambuf *out = std::cout.rdbuf(&null);
+    double interpretNs = timeNs([&] { interpreter.interpret(statements); });
+    std::cout.rdbuf(out);
+    if (hadRuntimeError) {
+      std::cerr << "lox_bench: " << workload.name << " raised a runtime error" << std::endl;
+      return {};
+    }
+
+    if (rep < options.warmup)
+      continue;
+    scan.push_back(scanNs);
+    parse.push_back(parseNs);
+    analyze.push_back(analyzeNs);
+    interpret.push_back(interpretNs);
+    reparse.push_back(reparseNs);
+  }
+
+  return {
+    { "scan", summarize(scan) },
+    { "parse", summarize(parse) },
+    { "analyze", summarize(analyze) },
+    { "interpret", summarize(interpret) },
+    { "reparse", summarize(reparse) },
+  };
+}
+
+// key is "workload/phase", value is the median in nanoseconds
+std::map<std::string, double> readBaseline(const std::string &path) {
+  std::map<std::string, double> baseline;
+  std::ifstream f(path);
+  std::string line;
+  std::getline(f, line); // header
+  while (std::getline(f, line)) {
+    std::vector<std::string> fields;
+    std::stringstream row(line);
+    std::string field;
+    while (std::getline(row, field, ','))
+      fields.push_back(field);
+    if (fields.size() >= 6)
+      baseline[fields[1] + "/" + fields[2]] = std::stod(fields[5]);
+  }
+  return baseline;
+}
+
+void usage() {
+  std::cout << "Usage: lox_bench [--reps N] [--warmup N] [--generated N] [--label NAME]\n"
+            << "                 [--csv out.csv] [--compare baseline.csv]\n"
+            << "                 [--emit-generated out.lox] [files or directories...]" << std::endl;
+}
+
+bool parseOptions(int argc, char *argv[], Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--reps" && hasValue)
+      options.reps = std::stoi(argv[++i]);
+    else if (arg == "--warmup" && hasValue)
+      options.warmup = std::stoi(argv[++i]);
+    else if (arg == "--generated" && hasValue)
+      options.generatedFunctions = std::stoi(argv[++i]);
+    else if (arg == "--label" && hasValue)
+      options.label = argv[++i];
+    else if (arg == "--csv" && hasValue)
+      options.csvPath = argv[++i];
+    else if (arg == "--compare" && hasValue)
+      options.comparePath = argv[++i];
+    else if (arg == "--emit-generated" && hasValue)
+      options.emitGeneratedPath = argv[++i];
+    else if (arg.starts_with("--"))
+      return false;
+    else
+      options.paths.push_back(arg);
+  }
+  return options.reps > 0 && options.warmup >= 0;
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    usage();
+    return -1;
+  }
+
+  if (!options.emitGeneratedPath.empty()) {
+    std::ofstream(options.emitGeneratedPath) << generateLargeSource(options.generatedFunctions);
+    return 0;
+  }
+
+  std::map<std::string, double> baseline;
+  if (!options.comparePath.empty())
+    baseline = readBaseline(options.comparePath);
+
+  std::ofstream csv;
+  if (!options.csvPath.empty()) {
+    csv.open(options.csvPath);
+    csv << "label,workload,phase,reps,min_ns,median_ns,mean_ns,stddev_ns,max_ns" << std::endl;
+  }
+
+  std::cout << std::left;
+  std::cout.width(14);
+  std::cout << "workload";
+  std::cout.width(11);
+  std::cout << "phase" << "median(ms)  mean(ms)  stddev(ms)  min(ms)  max(ms)" << std::endl;
+
+  // a workload that fails to run has no timings and fails the whole run
+  int status = 0;
+  for (const Workload &workload : loadWorkloads(options)) {
+    std::map<std::string, Stats> results = runWorkload(workload, options);
+    if (results.empty())
+      status = 1;
+    for (auto &[phase, stats] : results) {
+      std::ostringstream line;
+      line.setf(std::ios::fixed);
+      line.precision(3);
+      line << std::left;
+      line.width(14);
+      line << workload.name;
+      line.width(11);
+      line << phase;
+      for (double value : { stats.median, stats.mean, stats.stddev, stats.min, stats.max }) {
+        line.width(11);
+        line << value / 1e6 << " ";
+      }
+      auto previous = baseline.find(workload.name + "/" + phase);
+      if (previous != baseline.end() && previous->second > 0)
+        line << std::showpos << (stats.median / previous->second - 1) * 100 << "%" << std::noshowpos;
+      std::cout << line.str() << std::endl;
+
+      if (csv.is_open())
+        csv << options.label << "," << workload.name << "," << phase << "," << stats.reps << ","
+            << stats.min << "," << stats.median << "," << stats.mean << ","
+            << stats.stddev << "," << stats.max << std::endl;
+    }
+  }
+  return status;
+}
@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "Checker.hpp"
+#include "Diagnostics.hpp"
+#include "Parser.hpp"
+#include "Resolver.hpp"
+#include "Scanner.hpp"
+
+namespace {
+  struct FileResult {
+    bool readable { false };
+    Diagnostics diagnostics;
+  };
+
+  // `threads` is this file's share of the threads, for lexing it
+  void check(const std::string &path, FileResult &result, unsigned threads) {
+    std::ifstream file(path);
+    if (!file)
+      return;
+    result.readable = true;
+    std::stringstream source;
+    source << file.rdbuf();
+
+    Scanner scanner(source.str(), result.diagnostics);
+    std::vector<Token> tokens = scanner.scanTokensWithThreads(threads);
+    Parser parser { tokens, result.diagnostics };
+    std::vector<std::shared_ptr<Stmt>> statements = parser.parse();
+    if (!result.diagnostics.hasErrors())
+      Resolver { result.diagnostics }.resolve(statements);
+  }
+}
+
+int checkFiles(const std::vector<std::string> &paths, std::ostream &out, unsigned threads) {
+  std::vector<FileResult> results(paths.size());
+  // files are handed out one at a time, so a few large ones do not leave
+  // the other workers idle
+  std::atomic<size_t> next { 0 };
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  unsigned workers = std::min<size_t>(threads, paths.size());
+  // the workers split the threads between them, so one large file can
+  // lex in parallel but many files do not each start threads of their own
+  unsigned share = std::max(1u, threads / std::max(1u, workers));
+  auto worker = [&] {
+    for (size_t i = next++; i < paths.size(); i = next++)
+      check(paths[i], results[i], share);
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < workers; ++i)
+    pool.emplace_back(worker);
+  worker();
+  for (std::thread &thread : pool)
+    thread.join();
+
+  int status = 0;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (!results[i].readable) {
+      out << paths[i] << ": Could not read file." << std::endl;
+      status = 66;
+    } else if (results[i].diagnostics.hasErrors()) {
+      results[i].diagnostics.print(out, paths[i]);
+      status = std::max(status, 65);
+    }
+  }
+  return status;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Scans, parses and resolves scripts without running them, spreading the
+// files over a pool of threads. Every file gets its own Diagnostics; they
+// are printed afterwards in the order the files were given, each line
+// prefixed with the file's path. Returns 0 if every file is clean, 65 if
+// any has errors and 66 if any could not be read.
+//
+// `threads` of 0 means one per hardware thread. They are all the checker
+// uses: with fewer files than threads, a large file lexes in chunks on
+// the threads left over.
+int checkFiles(const std::vector<std::string> &paths, std::ostream &out, unsigned threads = 0);
@@ -0,0 +1,731 @@
+#include <any>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <utility>
+#include "ClosureEngine.hpp"
+#include "Environment.hpp"
+#include "Interpreter.hpp"
+#include "LoxArray.hpp"
+#include "LoxClass.hpp"
+#include "LoxFunction.hpp"
+#include "LoxInstance.hpp"
+#include "LoxMap.hpp"
+#include "LoxNative.hpp"
+#include "LoxString.hpp"
+#include "MemoryStats.hpp"
+#include "Number.hpp"
+#include "RuntimeError.hpp"
+#include "StringTable.hpp"
+#include "error.hpp"
+
+namespace {
+  // The state compiled code runs against: the innermost environment, and
+  // the environment captures and globals are found from, which is the
+  // closure for a function body and the globals for top-level code.
+  struct Frame {
+    std::shared_ptr<Environment> environment;
+    Environment *outer;
+    std::any result;
+  };
+
+  using Value = std::function<std::any(Frame&)>;
+  using Number = std::function<double(Frame&)>;
+  using Test = std::function<bool(Frame&)>;
+  // true once a return statement has stored the result in the frame
+  using Action = std::function<bool(Frame&)>;
+
+  bool runAll(const std::vector<Action> &actions, Frame &frame) {
+    for (const Action &action : actions) {
+      if (action(frame))
+        return true;
+    }
+    return false;
+  }
+
+  // Translates one function body or one run of top-level statements.
+  // Visits return the closure for the node, a Value or an Action, in a
+  // std::any.
+  class Compiler : public ExprVisitor, public StmtVisitor {
+    Interpreter &interpreter;
+    // the names each environment the compiled code creates will hold,
+    // innermost last; empty at the top level, where declarations go into
+    // the globals
+    std::vector<std::vector<const LoxString*>> scopes;
+
+  public:
+    Compiler(Interpreter &interpreter, std::vector<const LoxString*> parameters = {}, bool function = false)
+        : interpreter { interpreter } {
+      if (function)
+        scopes.push_back(std::move(parameters));
+    }
+
+    Value value(std::shared_ptr<Expr> &expr) {
+      return std::any_cast<Value>(expr->accept(*this));
+    }
+    Action action(std::shared_ptr<Stmt> &stmt) {
+      // the parser leaves null statements behind after a syntax error
+      if (stmt == nullptr)
+        return [](Frame &) { return false; };
+      return std::any_cast<Action>(stmt->accept(*this));
+    }
+    std::vector<Action> actions(std::vector<std::shared_ptr<Stmt>> &statements) {
+      std::vector<Action> compiled;
+      for (std::shared_ptr<Stmt> &stmt : statements)
+        compiled.push_back(action(stmt));
+      return compiled;
+    }
+
+    // an expression TypeInference proved numeric, unboxed; NaN where the
+    // tree walker's Interpreter::number gives NaN
+    Number number(std::shared_ptr<Expr> &expr) {
+      switch (expr->numeric) {
+        case NumericForm::Literal: {
+          double value = unboxNumber(static_cast<Literal&>(*expr).value);
+          return [value](Frame &) { return value; };
+        }
+        case NumericForm::Variable: {
+          Value read = variable(static_cast<Variable&>(*expr).name, static_cast<Variable&>(*expr).local);
+          return [read](Frame &frame) { return unboxNumber(read(frame)); };
+        }
+        case NumericForm::Grouping:
+          return number(static_cast<Grouping&>(*expr).expr);
+        case NumericForm::Negate: {
+          Number right = number(static_cast<Unary&>(*expr).right);
+          return [right](Frame &frame) { return -right(frame); };
+        }
+        case NumericForm::Arithmetic:
+          return arithmetic(static_cast<Binary&>(*expr));
+        default: {
+          Value boxed = value(expr);
+          return [boxed](Frame &frame) { return unboxNumber(boxed(frame)); };
+        }
+      }
+    }
+
+    // the truthiness of an expression, unboxed where the operands allow
+    Test test(std::shared_ptr<Expr> &expr) {
+      if (Binary *binary = dynamic_cast<Binary*>(expr.get()); binary != nullptr && isComparison(*binary))
+        return comparison(*binary);
+      if (Grouping *grouping = dynamic_cast<Grouping*>(expr.get()))
+        return test(grouping->expr);
+      if (Unary *unary = dynamic_cast<Unary*>(expr.get()); unary != nullptr && unary->op.type == TokenType::BANG) {
+        Test right = test(unary->right);
+        return [right](Frame &frame) { return !right(frame); };
+      }
+      Value boxed = value(expr);
+      return [boxed](Frame &frame) { return Interpreter::isTruthy(boxed(frame)); };
+    }
+
+  private:
+    int distanceOf(const LoxString *name) const {
+      for (size_t i = scopes.size(); i-- > 0;) {
+        for (const LoxString *declared : scopes[i]) {
+          if (declared == name)
+            return scopes.size() - 1 - i;
+        }
+      }
+      return -1;
+    }
+    void declare(const StringRef &name) {
+      if (!scopes.empty())
+        scopes.back().push_back(name.get());
+    }
+
+    Value variable(const Token &name, int local) {
+      int distance = local >= 0 ? distanceOf(name.lexeme.get()) : -1;
+      if (distance >= 0) {
+        StringRef lexeme = name.lexeme;
+        return [distance, lexeme](Frame &frame) { return frame.environment->getAt(distance, lexeme); };
+      }
+      if (local >= 0)
+        return [name](Frame &frame) { return frame.environment->get(name); };
+      return [name](Frame &frame) { return frame.outer->get(name); };
+    }
+
+    Number arithmetic(Binary &expr) {
+      Number left = number(expr.left);
+      Number right = number(expr.right);
+      switch (expr.op.type) {
+        case TokenType::PLUS:
+          return [left, right](Frame &frame) { return checked(left(frame) + right(frame)); };
+        case TokenType::MINUS:
+          return [left, right](Frame &frame) { return checked(left(frame) - right(frame)); };
+        case TokenType::STAR:
+          return [left, right](Frame &frame) { return checked(left(frame) * right(frame)); };
+        default: {
+          Token op = expr.op;
+          return [left, right, op](Frame &frame) {
+            double dividend = left(frame);
+            double divisor = right(frame);
+            if (divisor == 0)
+              throw RuntimeError(op, "Division by 0 not supported.");
+            return checked(dividend / divisor);
+          };
+        }
+      }
+    }
+
+    // both operands numeric and the node itself not arithmetic: the tree
+    // walker compares unboxed, with == for any operator it does not list
+    static bool isComparison(Binary &expr) {
+      return expr.numeric == NumericForm::None && expr.left->numeric != NumericForm::None
+        && expr.right->numeric != NumericForm::None;
+    }
+    Test comparison(Binary &expr) {
+      Number left = number(expr.left);
+      Number right = number(expr.right);
+      Value boxed = boxedBinary(expr);
+      auto unboxed = [left, right, boxed](auto compare) -> Test {
+        return [left, right, boxed, compare](Frame &frame) {
+          double a = left(frame);
+          double b = right(frame);
+          if (std::isnan(a) || std::isnan(b))
+            return std::any_cast<bool>(boxed(frame));
+          return compare(a, b);
+        };
+      };
+      switch (expr.op.type) {
+        case TokenType::GREATER:
+          return unboxed(std::greater<double> {});
+        case TokenType::GREATER_EQUAL:
+          return unboxed(std::greater_equal<double> {});
+        case TokenType::LESS:
+          return unboxed(std::less<double> {});
+        case TokenType::LESS_EQUAL:
+          return unboxed(std::less_equal<double> {});
+        case TokenType::BANG_EQUAL:
+          return unboxed(std::not_equal_to<double> {});
+        default:
+          return unboxed(std::equal_to<double> {});
+      }
+    }
+
+    // the operator applied to boxed operands, which is all the tree walker
+    // does for a node TypeInference could not prove numeric
+    Value boxedBinary(Binary &expr) {
+      Value left = value(expr.left);
+      Value right = value(expr.right);
+      Token op = expr.op;
+      Interpreter *interpreter = &this->interpreter;
+      // the arithmetic gives an empty result when an operand is not a
+      // number, so the operands are only checked then
+      switch (op.type) {
+        case TokenType::MINUS:
+          return Value { [left, right, interpreter, op](Frame &frame) -> std::any {
+            std::any a = left(frame), b = right(frame);
+            std::any difference = subtractNumbers(a, b);
+            if (!difference.has_value())
+              interpreter->checkNumberOperand(op, a, b);
+            return difference;
+          } };
+        case TokenType::SLASH:
+          return Value { [left, right, interpreter, op](Frame &frame) -> std::any {
+            std::any a = left(frame), b = right(frame);
+            interpreter->checkNumberOperand(op, a, b);
+            if (toDouble(b) == 0)
+              throw RuntimeError(op, "Division by 0 not supported.");
+            return divideNumbers(a, b);
+          } };
+        case TokenType::STAR:
+          return Value { [left, right, interpreter, op](Frame &frame) -> std::any {
+            std::any a = left(frame), b = right(frame);
+            std::any product = multiplyNumbers(a, b);
+            if (!product.has_value())
+              interpreter->checkNumberOperand(op, a, b);
+            return product;
+          } };
+        case TokenType::PLUS:
+          return Value { [left, right, op](Frame &frame) -> std::any {
+            std::any a = left(frame), b = right(frame);
+            std::any sum = addNumbers(a, b);
+            if (sum.has_value())
+              return sum;
+            if (a.type() == typeid(StringRef) && b.type() == typeid(StringRef))
+              return LoxString::concat(std::any_cast<StringRef&>(a), std::any_cast<StringRef&>(b));
+            if (a.type() == typeid(StringRef) && isNumber(b))
+              return LoxString::concat(std::any_cast<StringRef&>(a), LoxString::create(formatNumber(b)));
+            throw RuntimeError(op, "Operands must be two numbers or two strings.");
+          } };
+        case TokenType::GREATER:
+          return Value { [left, right, interpreter, op](Frame &frame) -> std::any {
+            std::any a = left(frame), b = right(frame);
+            return interpreter->compareNumberOperands(op, a, b) > 0;
+          } };
+        case TokenType::GREATER_EQUAL:
+          return Value { [left, right, interpreter, op](Frame &frame) -> std::any {
+            std::any a = left(frame), b = right(frame);
+            return interpreter->compareNumberOperands(op, a, b) >= 0;
+          } };
+        case TokenType::LESS:
+          return Value { [left, right, interpreter, op](Frame &frame) -> std::any {
+            std::any a = left(frame), b = right(frame);
+            return interpreter->compareNumberOperands(op, a, b) < 0;
+          } };
+        case TokenType::LESS_EQUAL:
+          return Value { [left, right, interpreter, op](Frame &frame) -> std::any {
+            std::any a = left(frame), b = right(frame);
+            return interpreter->compareNumberOperands(op, a, b) <= 0;
+          } };
+        case TokenType::BANG_EQUAL:
+          return Value { [left, right, interpreter](Frame &frame) -> std::any {
+            std::any a = left(frame);
+            return !interpreter->isEqual(a, right(frame));
+          } };
+        case TokenType::EQUAL_EQUAL:
+          return Value { [left, right, interpreter](Frame &frame) -> std::any {
+            std::any a = left(frame);
+            return interpreter->isEqual(a, right(frame));
+          } };
+        default:
+          return Value { [left, right](Frame &frame) -> std::any {
+            left(frame);
+            right(frame);
+            return (void*) nullptr;
+          } };
+      }
+    }
+
+  public:
+    std::any visitLiteralExpr(Literal &expr) override {
+      std::any value = expr.value;
+      return Value { [value](Frame &) { return value; } };
+    }
+    std::any visitGroupingExpr(Grouping &expr) override {
+      return value(expr.expr);
+    }
+    std::any visitUnaryExpr(Unary &expr) override {
+      Value right = value(expr.right);
+      Token op = expr.op;
+      Interpreter *interpreter = &this->interpreter;
+      if (op.type == TokenType::BANG)
+        return Value { [right](Frame &frame) -> std::any { return !Interpreter::isTruthy(right(frame)); } };
+      if (op.type != TokenType::MINUS) {
+        return Value { [right](Frame &frame) -> std::any {
+          right(frame);
+          return (void*) nullptr;
+        } };
+      }
+      Value boxed { [right, op, interpreter](Frame &frame) -> std::any {
+        std::any operand = right(frame);
+        std::any negated = negateNumber(operand);
+        if (!negated.has_value())
+          interpreter->checkNumberOperand(op, operand);
+        return negated;
+      } };
+      if (expr.numeric == NumericForm::None)
+        return boxed;
+      Number unboxed = number(expr.right);
+      return Value { [unboxed, boxed](Frame &frame) -> std::any {
+        double operand = unboxed(frame);
+        return std::isnan(operand) ? boxed(frame) : boxNumber(-operand);
+      } };
+    }
+    std::any visitBinaryExpr(Binary &expr) override {
+      if (expr.numeric != NumericForm::None) {
+        Number arithmetic = this->arithmetic(expr);
+        Value boxed = boxedBinary(expr);
+        return Value { [arithmetic, boxed](Frame &frame) -> std::any {
+          double result = arithmetic(frame);
+          return std::isnan(result) ? boxed(frame) : boxNumber(result);
+        } };
+      }
+      if (isComparison(expr)) {
+        Test compare = comparison(expr);
+        return Value { [compare](Frame &frame) -> std::any { return compare(frame); } };
+      }
+      return boxedBinary(expr);
+    }
+    std::any visitLogicalExpr(Logical &expr) override {
+      Value left = value(expr.left);
+      Value right = value(expr.right);
+      if (expr.op.type == TokenType::OR) {
+        return Value { [left, right](Frame &frame) {
+          std::any value = left(frame);
+          return Interpreter::isTruthy(value) ? value : right(frame);
+        } };
+      }
+      return Value { [left, right](Frame &frame) {
+        std::any value = left(frame);
+        return !Interpreter::isTruthy(value) ? value : right(frame);
+      } };
+    }
+    std::any visitVariableExpr(Variable &expr) override {
+      return variable(expr.name, expr.local);
+    }
+    std::any visitAssignExpr(Assign &expr) override {
+      Value value = this->value(expr.value);
+      int distance = expr.local >= 0 ? distanceOf(expr.name.lexeme.get()) : -1;
+      Token name = expr.name;
+      if (distance >= 0) {
+        return Value { [value, distance, name](Frame &frame) {
+          std::any result = value(frame);
+          Environment *environment = frame.environment.get();
+          for (int i = 0; i < distance; ++i)
+            environment = environment->enclosing.get();
+          environment->assign(name, result);
+          return result;
+        } };
+      }
+      bool local = expr.local >= 0;
+      return Value { [value, local, name](Frame &frame) {
+        std::any result = value(frame);
+        (local ? frame.environment.get() : frame.outer)->assign(name, result);
+        return result;
+      } };
+    }
+    std::any visitCallExpr(Call &expr) override {
+      Value callee = value(expr.callee);
+      std::vector<Value> arguments;
+      for (std::shared_ptr<Expr> &argument : expr.arguments)
+        arguments.push_back(value(argument));
+      Token paren = expr.paren;
+      Interpreter *interpreter = &this->interpreter;
+      return Value { [callee, arguments, paren, interpreter](Frame &frame) {
+        std::any target = callee(frame);
+        std::vector<std::any> args;
+        args.reserve(arguments.size());
+        for (const Value &argument : arguments)
+          args.push_back(argument(frame));
+
+        if (target.type() != typeid(std::shared_ptr<LoxCallable>))
+          throw RuntimeError(paren, "Can only call functions and classes.");
+        LoxCallable &function = *std::any_cast<std::shared_ptr<LoxCallable>&>(target);
+        if (args.size() != static_cast<size_t>(function.arity())) {
+          std::ostringstream oss;
+          oss << "Expected " << function.arity() << " arguments but got " << args.size() << ".";
+          throw RuntimeError(paren, oss.str());
+        }
+        try {
+          return function.call(*interpreter, std::move(args));
+        } catch (NativeError &error) {
+          throw RuntimeError(paren, error.what());
+        }
+      } };
+    }
+    std::any visitGetExpr(Get &expr) override {
+      Value object = value(expr.object);
+      Get *node = &expr;
+      return Value { [object, node](Frame &frame) {
+        std::any instance = object(frame);
+        if (instance.type() != typeid(std::shared_ptr<LoxInstance>))
+          throw RuntimeError(node->name, "Only instances have properties.");
+        return std::any_cast<std::shared_ptr<LoxInstance>&>(instance)->get(node->name, node->cache);
+      } };
+    }
+    std::any visitSetExpr(Set &expr) override {
+      Value object = value(expr.object);
+      Value value = this->value(expr.value);
+      Set *node = &expr;
+      return Value { [object, value, node](Frame &frame) {
+        std::any instance = object(frame);
+        if (instance.type() != typeid(std::shared_ptr<LoxInstance>))
+          throw RuntimeError(node->name, "Only instances have fields.");
+        std::any result = value(frame);
+        std::any_cast<std::shared_ptr<LoxInstance>&>(instance)->set(node->name, result, node->cache);
+        return result;
+      } };
+    }
+    std::any visitThisExpr(This &expr) override {
+      // `this` is bound in the closure of a method, or captured from one
+      Token keyword = expr.keyword;
+      return Value { [keyword](Frame &frame) { return frame.outer->get(keyword); } };
+    }
+    std::any visitSuperExpr(Super &expr) override {
+      Token keyword = expr.keyword;
+      Token method = expr.method;
+      return Value { [keyword, method](Frame &frame) -> std::any {
+        std::shared_ptr<LoxClass> superclass = std::static_pointer_cast<LoxClass>(
+          std::any_cast<std::shared_ptr<LoxCallable>>(frame.outer->get(keyword)));
+        Token self { TokenType::THIS, StringTable::thisName(), nullptr, keyword.line };
+        std::shared_ptr<LoxInstance> object = std::any_cast<std::shared_ptr<LoxInstance>>(frame.outer->get(self));
+        LoxFunction *found = superclass->findMethod(method.lexeme.get());
+        if (found == nullptr)
+          throw RuntimeError(method, "Undefined property '" + method.lexeme->str() + "'.");
+        std::shared_ptr<LoxCallable> bound = found->bind(object);
+        return bound;
+      } };
+    }
+    std::any visitArrayLiteralExpr(ArrayLiteral &expr) override {
+      std::vector<Value> elements;
+      for (std::shared_ptr<Expr> &element : expr.elements)
+        elements.push_back(value(element));
+      return Value { [elements](Frame &frame) -> std::any {
+        ArrayRef array = LoxArray::create();
+        for (const Value &element : elements)
+          array->push(element(frame));
+        return array;
+      } };
+    }
+    std::any visitMapLiteralExpr(MapLiteral &expr) override {
+      std::vector<std::pair<Value, Value>> entries;
+      for (size_t i = 0; i < expr.keys.size(); ++i)
+        entries.push_back({ value(expr.keys[i]), value(expr.values[i]) });
+      return Value { [entries](Frame &frame) -> std::any {
+        MapRef map = LoxMap::create();
+        for (const auto &[key, value] : entries) {
+          std::any k = key(frame);
+          map->set(k, value(frame));
+        }
+        return map;
+      } };
+    }
+    std::any visitIndexExpr(Index &expr) override {
+      Value object = value(expr.object);
+      Value index = value(expr.index);
+      Token bracket = expr.bracket;
+      Interpreter *interpreter = &this->interpreter;
+      return Value { [object, index, bracket, interpreter](Frame &frame) {
+        std::any target = object(frame);
+        if (target.type() == typeid(MapRef))
+          return std::any_cast<MapRef&>(target)->get(index(frame));
+        if (target.type() != typeid(ArrayRef))
+          throw RuntimeError(bracket, "Only arrays and maps can be indexed.");
+        LoxArray &array = *std::any_cast<ArrayRef&>(target);
+        return array.get(interpreter->arrayIndex(bracket, array, index(frame)));
+      } };
+    }
+    std::any visitIndexSetExpr(IndexSet &expr) override {
+      Value object = value(expr.object);
+      Value index = value(expr.index);
+      Value value = this->value(expr.value);
+      Token bracket = expr.bracket;
+      Interpreter *interpreter = &this->interpreter;
+      return Value { [object, index, value, bracket, interpreter](Frame &frame) {
+        std::any target = object(frame);
+        bool isMap = target.type() == typeid(MapRef);
+        if (!isMap && target.type() != typeid(ArrayRef))
+          throw RuntimeError(bracket, "Only arrays and maps can be indexed.");
+        std::any position = index(frame);
+        std::any result = value(frame);
+        if (isMap) {
+          std::any_cast<MapRef&>(target)->set(position, result);
+          return result;
+        }
+        LoxArray &array = *std::any_cast<ArrayRef&>(target);
+        array.set(interpreter->arrayIndex(bracket, array, position), result);
+        return result;
+      } };
+    }
+
+    std::any visitExpressionStmt(Expression &stmt) override {
+      Value value = this->value(stmt.expr);
+      return Action { [value](Frame &frame) {
+        value(frame);
+        return false;
+      } };
+    }
+    std::any visitPrintStmt(Print &stmt) override {
+      Value value = this->value(stmt.expr);
+      Interpreter *interpreter = &this->interpreter;
+      return Action { [value, interpreter](Frame &frame) {
+        std::any result = value(frame);
+        if (result.type() == typeid(StringRef))
+          std::cout << std::any_cast<StringRef&>(result)->str() << std::endl;
+        else
+          std::cout << interpreter->stringify(result) << std::endl;
+        return false;
+      } };
+    }
+    std::any visitVarStmt(Var &stmt) override {
+      Value initializer;
+      if (stmt.initializer != nullptr)
+        initializer = value(stmt.initializer);
+      declare(stmt.name.lexeme);
+      StringRef name = stmt.name.lexeme;
+      bool cell = stmt.cell;
+      return Action { [initializer, name, cell](Frame &frame) {
+        std::any value = (void*) nullptr;
+        if (initializer)
+          value = initializer(frame);
+        if (cell)
+          value = Environment::cell(value);
+        frame.environment->define(name, value);
+        return false;
+      } };
+    }
+    std::any visitBlockStmt(Block &stmt) override {
+      scopes.emplace_back();
+      std::vector<Action> body = actions(stmt.statements);
+      scopes.pop_back();
+      return Action { [body](Frame &frame) {
+        std::shared_ptr<Environment> previous = frame.environment;
+        frame.environment = Environment::create(previous);
+        bool returned = runAll(body, frame);
+        frame.environment = std::move(previous);
+        return returned;
+      } };
+    }
+    std::any visitIfStmt(If &stmt) override {
+      Test condition = test(stmt.condition);
+      Action thenBranch = action(stmt.thenBranch);
+      if (stmt.elseBranch == nullptr)
+        return Action { [condition, thenBranch](Frame &frame) { return condition(frame) && thenBranch(frame); } };
+      Action elseBranch = action(stmt.elseBranch);
+      return Action { [condition, thenBranch, elseBranch](Frame &frame) {
+        return condition(frame) ? thenBranch(frame) : elseBranch(frame);
+      } };
+    }
+    std::any visitWhileStmt(While &stmt) override {
+      Test condition = test(stmt.condition);
+      Action body = action(stmt.body);
+      return Action { [condition, body](Frame &frame) {
+        while (condition(frame)) {
+          if (body(frame))
+            return true;
+        }
+        return false;
+      } };
+    }
+    std::any visitForStmt(For &stmt) override {
+      bool scoped = stmt.initializer != nullptr;
+      if (scoped)
+        scopes.emplace_back();
+      Action initializer = scoped ? action(stmt.initializer) : Action {};
+      Test condition = test(stmt.condition);
+      Action body = action(stmt.body);
+      Value increment = stmt.increment != nullptr ? value(stmt.increment) : Value {};
+      if (scoped)
+        scopes.pop_back();
+
+      auto loop = [condition, body, increment](Frame &frame) {
+        while (condition(frame)) {
+          if (body(frame))
+            return true;
+          if (increment)
+            increment(frame);
+        }
+        return false;
+      };
+      if (!scoped)
+        return Action { loop };
+      return Action { [initializer, loop](Frame &frame) {
+        std::shared_ptr<Environment> previous = frame.environment;
+        frame.environment = Environment::create(previous);
+        initializer(frame);
+        bool returned = loop(frame);
+        frame.environment = std::move(previous);
+        return returned;
+      } };
+    }
+    std::any visitReturnStmt(Return &stmt) override {
+      if (stmt.value == nullptr) {
+        return Action { [](Frame &frame) {
+          frame.result = (void*) nullptr;
+          return true;
+        } };
+      }
+      Value value = this->value(stmt.value);
+      return Action { [value](Frame &frame) {
+        frame.result = value(frame);
+        return true;
+      } };
+    }
+    std::any visitFunctionStmt(Function &stmt) override {
+      declare(stmt.name.lexeme);
+      std::shared_ptr<Function> declaration = std::static_pointer_cast<Function>(stmt.shared_from_this());
+      Interpreter *interpreter = &this->interpreter;
+      return Action { [declaration, interpreter](Frame &frame) {
+        // a recursive function captures its own name, so the cell must exist first
+        if (declaration->cell)
+          frame.environment->define(declaration->name.lexeme, Environment::cell((void*) nullptr));
+        std::shared_ptr<LoxCallable> function = std::allocate_shared<LoxFunction>(
+          CountingAllocator<LoxFunction, MemoryCategory::Closure> {}, declaration,
+          Interpreter::closureFor(*declaration, interpreter->globals, *frame.environment));
+        if (declaration->cell)
+          frame.environment->assign(declaration->name, function);
+        else
+          frame.environment->define(declaration->name.lexeme, function);
+        return false;
+      } };
+    }
+    std::any visitClassStmt(Class &stmt) override {
+      Value superclassValue;
+      if (stmt.superclass != nullptr)
+        superclassValue = value(stmt.superclass);
+      declare(stmt.name.lexeme);
+      Class *node = &stmt;
+      std::shared_ptr<Stmt> keepAlive = stmt.shared_from_this();
+      Interpreter *interpreter = &this->interpreter;
+      return Action { [superclassValue, node, keepAlive, interpreter](Frame &frame) {
+        std::shared_ptr<LoxClass> superclass;
+        if (superclassValue) {
+          std::any value = superclassValue(frame);
+          if (value.type() == typeid(std::shared_ptr<LoxCallable>))
+            superclass = std::dynamic_pointer_cast<LoxClass>(std::any_cast<std::shared_ptr<LoxCallable>&>(value));
+          if (superclass == nullptr)
+            throw RuntimeError(static_cast<Variable&>(*node->superclass).name, "Superclass must be a class.");
+        }
+        std::any placeholder = (void*) nullptr;
+        if (node->cell)
+          placeholder = Environment::cell(placeholder);
+        frame.environment->define(node->name.lexeme, placeholder);
+
+        std::shared_ptr<Environment> enclosing = interpreter->globals;
+        if (superclass != nullptr) {
+          enclosing = Environment::create(interpreter->globals);
+          enclosing->define(StringTable::superName(), std::shared_ptr<LoxCallable>(superclass));
+        }
+        LoxClass::Methods methods;
+        for (std::shared_ptr<Function> &method : node->methods) {
+          methods[method->name.lexeme.get()] = std::allocate_shared<LoxFunction>(
+            CountingAllocator<LoxFunction, MemoryCategory::Closure> {}, method,
+            Interpreter::closureFor(*method, enclosing, *frame.environment), method->name.lexeme == StringTable::initName());
+        }
+        std::shared_ptr<LoxCallable> klass = std::make_shared<LoxClass>(node->name.lexeme, superclass, std::move(methods));
+        frame.environment->assign(node->name, klass);
+        return false;
+      } };
+    }
+  };
+}
+
+struct CompiledBody {
+  // keeps the node alive, so its address is not reused by another
+  std::shared_ptr<Function> declaration;
+  std::vector<Action> statements;
+};
+
+ClosureEngine::ClosureEngine(Interpreter &interpreter) : interpreter { interpreter } {}
+
+ClosureEngine::~ClosureEngine() = default;
+
+void ClosureEngine::interpret(std::vector<std::shared_ptr<Stmt>> &statements) {
+  Frame frame { interpreter.globals, interpreter.globals.get(), {} };
+  try {
+    Compiler compiler { interpreter };
+    for (std::shared_ptr<Stmt> &stmt : statements)
+      compiler.action(stmt)(frame);
+  } catch (const RuntimeError &error) {
+    runtimeError(error);
+  }
+}
+
+std::any ClosureEngine::call(LoxFunction &function, std::vector<std::any> &arguments) {
+  const std::shared_ptr<Function> &declaration = function.getDeclaration();
+  std::unique_ptr<CompiledBody> &body = bodies[declaration.get()];
+  if (body == nullptr) {
+    std::vector<const LoxString*> parameters;
+    for (const Token &param : declaration->params)
+      parameters.push_back(param.lexeme.get());
+    Compiler compiler { interpreter, std::move(parameters), true };
+    body = std::make_unique<CompiledBody>(declaration, compiler.actions(declaration->body));
+  }
+
+  std::shared_ptr<Environment> closure = function.getClosure();
+  Frame frame { Environment::create(closure), closure.get(), {} };
+  for (size_t i = 0; i < declaration->params.size(); ++i) {
+    if (declaration->cellParams[i])
+      frame.environment->define(declaration->params[i].lexeme, Environment::cell(arguments[i]));
+    else
+      frame.environment->define(declaration->params[i].lexeme, arguments[i]);
+  }
+
+  bool returned = runAll(body->statements, frame);
+  if (function.initializer())
+    return closure->getAt(0, StringTable::thisName());
+  if (!returned)
+    return nullptr;
+  return std::move(frame.result);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <any>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "Stmt.hpp"
+
+class Interpreter;
+class LoxFunction;
+struct CompiledBody;
+
+// An execution engine that translates the tree once into C++ closures
+// instead of walking it. Every closure holds its compiled children
+// directly, so running a node is one indirect call rather than an
+// accept/visit double dispatch, and expressions TypeInference proved
+// numeric compile to closures returning a plain double or bool instead of
+// a std::any. Top-level statements are translated when they run, function
+// bodies on their first call.
+//
+// The translation mirrors the environments the interpreter creates, so a
+// variable declared in the running function is read at the distance of
+// the environment holding it rather than by searching the chain; captures
+// and globals are looked up from the function's closure. A return ends a
+// body through a flag instead of an exception.
+//
+// Installed as Interpreter::engine, it takes over Interpreter::interpret
+// and every call to a Lox function, and it uses the interpreter's globals
+// and natives. Output and errors match the tree walker; the profiler,
+// execution statistics and the JIT only hook into the latter.
+class ClosureEngine {
+public:
+  explicit ClosureEngine(Interpreter &interpreter);
+  ~ClosureEngine();
+
+  // runs top-level statements, reporting a runtime error the way
+  // Interpreter::interpret does
+  void interpret(std::vector<std::shared_ptr<Stmt>> &statements);
+  std::any call(LoxFunction &function, std::vector<std::any> &arguments);
+
+private:
+  Interpreter &interpreter;
+  std::unordered_map<const Function*, std::unique_ptr<CompiledBody>> bodies;
+};
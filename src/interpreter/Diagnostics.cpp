@@ -0,0 +1,21 @@
+#include "Diagnostics.hpp"
+#include "TokenType.hpp"
+
+void Diagnostics::error(int line, std::string message) {
+  entries.push_back({ line, "", std::move(message) });
+}
+
+void Diagnostics::error(const Token &token, std::string message) {
+  if (token.type == TokenType::END_OF_LINE)
+    entries.push_back({ token.line, " at end", std::move(message) });
+  else
+    entries.push_back({ token.line, " at '" + token.lexeme->str() + "'", std::move(message) });
+}
+
+void Diagnostics::print(std::ostream &out, const std::string &file) const {
+  for (const Diagnostic &diagnostic : entries) {
+    if (!file.empty())
+      out << file << ":";
+    out << "[line " << diagnostic.line << "] Error" << diagnostic.where << ": " << diagnostic.message << std::endl;
+  }
+}
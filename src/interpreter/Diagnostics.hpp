@@ -0,0 +1,29 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Token.hpp"
+
+struct Diagnostic {
+  int line;
+  // " at 'x'", " at end", or empty
+  std::string where;
+  std::string message;
+};
+
+// The errors found while scanning and parsing one source, collected
+// rather than printed so several sources can be checked side by side.
+class Diagnostics {
+public:
+  void error(int line, std::string message);
+  void error(const Token &token, std::string message);
+
+  bool hasErrors() const { return !entries.empty(); }
+  const std::vector<Diagnostic> &all() const { return entries; }
+  // one "[line N] Error...: message" line per error, each prefixed with
+  // "file:" if one is given
+  void print(std::ostream &out, const std::string &file = "") const;
+
+private:
+  std::vector<Diagnostic> entries;
+};
@@ -6,27 +6,94 @@
 #include "RuntimeError.hpp"
 #include "Environment.hpp"
 
-void Environment::define(std::string name, std::any value) {
-  values[name] = value;
+namespace {
+  using EnvironmentAllocator = CountingAllocator<Environment, MemoryCategory::Environment>;
+
+  // the value a variable holds, looking through its cell if it has one
+  std::any &contents(std::any &entry) {
+    if (entry.type() == typeid(UpvalueRef))
+      return std::any_cast<UpvalueRef&>(entry)->value;
+    return entry;
+  }
+}
+
+Environment::~Environment() {
+  for (auto &[name, value] : values)
+    MemoryStats::untrackValue(value);
+}
+
+std::shared_ptr<Environment> Environment::create() {
+  return std::allocate_shared<Environment>(EnvironmentAllocator {});
 }
 
-std::any Environment::get(Token name) {
-  if (values.find(name.lexeme) != values.end())
-    return values.at(name.lexeme);
+std::shared_ptr<Environment> Environment::create(std::shared_ptr<Environment> &enclosing) {
+  return std::allocate_shared<Environment>(EnvironmentAllocator {}, enclosing);
+}
+
+UpvalueRef Environment::cell(std::any value) {
+  return std::allocate_shared<Upvalue>(CountingAllocator<Upvalue, MemoryCategory::Closure> {}, std::move(value));
+}
+
+void Environment::define(const StringRef &name, std::any value) {
+  MemoryStats::trackValue(value);
+  auto [entry, inserted] = values.try_emplace(name.get());
+  if (!inserted)
+    MemoryStats::untrackValue(entry->second);
+  entry->second = value;
+}
+
+void Environment::capture(const StringRef &name, Environment &from) {
+  for (Environment *env = &from; env != nullptr; env = env->enclosing.get()) {
+    auto found = env->values.find(name.get());
+    if (found != env->values.end()) {
+      define(name, found->second);
+      return;
+    }
+  }
+}
+
+std::any Environment::get(const Token &name) {
+  auto found = values.find(name.lexeme.get());
+  if (found != values.end())
+    return contents(found->second);
   if (enclosing != nullptr)
     return enclosing->get(name);
 
-  throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
+  throw RuntimeError(name, "Undefined variable '" + name.lexeme->str() + "'.");
+}
+
+std::any Environment::getAt(int distance, const StringRef &name) {
+  Environment *env = this;
+  for (int i = 0; i < distance; ++i)
+    env = env->enclosing.get();
+  return contents(env->values.at(name.get()));
+}
+
+std::any *Environment::slot(const StringRef &name) {
+  auto found = values.find(name.get());
+  return found != values.end() ? &found->second : nullptr;
 }
 
-void Environment::assign(Token name, std::any value) {
-  if (values.find(name.lexeme) != values.end()) {
-    values[name.lexeme] = value;
+void Environment::assign(const Token &name, std::any value) {
+  auto found = values.find(name.lexeme.get());
+  if (found != values.end()) {
+    std::any &variable = contents(found->second);
+    MemoryStats::trackValue(value);
+    MemoryStats::untrackValue(variable);
+    variable = value;
     return;
   }
   if (enclosing != nullptr) {
     enclosing->assign(name, value);
     return;
   }
-  throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
+  throw RuntimeError(name, "Undefined variable '" + name.lexeme->str() + "'.");
+}
+
+int Environment::depthOf(const StringRef &name) {
+  int depth = 0;
+  for (Environment *env = this; env != nullptr; env = env->enclosing.get(), ++depth)
+    if (env->values.find(name.get()) != env->values.end())
+      return depth;
+  return -1;
 }
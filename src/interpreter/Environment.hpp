@@ -4,16 +4,54 @@
 #include <any>
 #include <memory>
 #include "Token.hpp"
+#include "MemoryStats.hpp"
+#include "StringTable.hpp"
+
+// A variable that a closure captures and that can still change afterwards
+// lives in a cell shared by its own environment and every closure that
+// captured it, so the closures see later assignments and the frame can go
+// away without them.
+struct Upvalue {
+  std::any value;
+
+  Upvalue(std::any value) : value { std::move(value) } { MemoryStats::trackValue(this->value); }
+  ~Upvalue() { MemoryStats::untrackValue(value); }
+};
+using UpvalueRef = std::shared_ptr<Upvalue>;
 
 class Environment {
-  std::unordered_map<std::string, std::any> values;
+public:
+  // keyed by interned name; the table keeps the names alive
+  using Values = std::unordered_map<const LoxString*, std::any, SymbolHash, std::equal_to<const LoxString*>,
+    CountingAllocator<std::pair<const LoxString* const, std::any>, MemoryCategory::Environment>>;
+private:
+  Values values;
 public:
   std::shared_ptr<Environment> enclosing;
 
   Environment(std::shared_ptr<Environment> &enclosing) : enclosing { enclosing } {}
   Environment() {}
+  ~Environment();
+
+  // environments are allocated through here so they show up in MemoryStats
+  static std::shared_ptr<Environment> create();
+  static std::shared_ptr<Environment> create(std::shared_ptr<Environment> &enclosing);
+
+  // a cell holding value, to define in place of the value itself
+  static UpvalueRef cell(std::any value);
 
-  void define(std::string name, std::any value);
-  std::any get(Token name);
-  void assign(Token name, std::any value);
+  void define(const StringRef &name, std::any value);
+  // copies the entry for name visible from `from` into this environment,
+  // sharing it if it is a cell; a name not found is left out
+  void capture(const StringRef &name, Environment &from);
+  std::any get(const Token &name);
+  // a name known to be defined `distance` environments up the chain
+  std::any getAt(int distance, const StringRef &name);
+  void assign(const Token &name, std::any value);
+  int depthOf(const StringRef &name);
+  // the entry for name defined in this environment itself, or null; it
+  // stays put for as long as the environment does
+  std::any *slot(const StringRef &name);
+  // the entries defined here, cells and all
+  const Values &entries() const { return values; }
 };
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ExecutionStats.hpp"
+#include "LoxClass.hpp"
+#include "LoxFunction.hpp"
+#include "LoxNative.hpp"
+
+namespace {
+  struct NodeInfo {
+    const char *kind;
+    int line;
+  };
+
+  // Names a node and finds the source line it starts on.
+  struct NodeDescriber : public ExprVisitor, public StmtVisitor {
+    NodeInfo describe(Expr &expr) { return std::any_cast<NodeInfo>(expr.accept(*this)); }
+    NodeInfo describe(Stmt &stmt) { return std::any_cast<NodeInfo>(stmt.accept(*this)); }
+    int line(std::shared_ptr<Expr> &expr) { return expr == nullptr ? 0 : describe(*expr).line; }
+
+    std::any visitAssignExpr(Assign &expr) override { return NodeInfo { "Assign", expr.name.line }; }
+    std::any visitGroupingExpr(Grouping &expr) override { return NodeInfo { "Grouping", line(expr.expr) }; }
+    std::any visitBinaryExpr(Binary &expr) override { return NodeInfo { "Binary", expr.op.line }; }
+    std::any visitCallExpr(Call &expr) override { return NodeInfo { "Call", line(expr.callee) }; }
+    std::any visitGetExpr(Get &expr) override { return NodeInfo { "Get", expr.name.line }; }
+    std::any visitSetExpr(Set &expr) override { return NodeInfo { "Set", expr.name.line }; }
+    std::any visitThisExpr(This &expr) override { return NodeInfo { "This", expr.keyword.line }; }
+    std::any visitSuperExpr(Super &expr) override { return NodeInfo { "Super", expr.keyword.line }; }
+    std::any visitArrayLiteralExpr(ArrayLiteral &expr) override { return NodeInfo { "ArrayLiteral", expr.bracket.line }; }
+    std::any visitMapLiteralExpr(MapLiteral &expr) override { return NodeInfo { "MapLiteral", expr.brace.line }; }
+    std::any visitIndexExpr(Index &expr) override { return NodeInfo { "Index", expr.bracket.line }; }
+    std::any visitIndexSetExpr(IndexSet &expr) override { return NodeInfo { "IndexSet", expr.bracket.line }; }
+    std::any visitLiteralExpr(Literal &expr) override { return NodeInfo { "Literal", expr.line }; }
+    std::any visitLogicalExpr(Logical &expr) override { return NodeInfo { "Logical", expr.op.line }; }
+    std::any visitUnaryExpr(Unary &expr) override { return NodeInfo { "Unary", expr.op.line }; }
+    std::any visitVariableExpr(Variable &expr) override { return NodeInfo { "Variable", expr.name.line }; }
+
+    std::any visitBlockStmt(Block &stmt) override {
+      int first = 0;
+      for (auto &inner : stmt.statements)
+        if (inner != nullptr && (first = describe(*inner).line) != 0)
+          break;
+      return NodeInfo { "Block", first };
+    }
+    std::any visitVarStmt(Var &stmt) override { return NodeInfo { "Var", stmt.name.line }; }
+    std::any visitWhileStmt(While &stmt) override { return NodeInfo { "While", line(stmt.condition) }; }
+    std::any visitForStmt(For &stmt) override { return NodeInfo { "For", line(stmt.condition) }; }
+    std::any visitExpressionStmt(Expression &stmt) override { return NodeInfo { "Expression", line(stmt.expr) }; }
+    std::any visitFunctionStmt(Function &stmt) override { return NodeInfo { "Function", stmt.name.line }; }
+    std::any visitClassStmt(Class &stmt) override { return NodeInfo { "Class", stmt.name.line }; }
+    std::any visitIfStmt(If &stmt) override { return NodeInfo { "If", line(stmt.condition) }; }
+    std::any visitPrintStmt(Print &stmt) override { return NodeInfo { "Print", line(stmt.expr) }; }
+    std::any visitReturnStmt(Return &stmt) override { return NodeInfo { "Return", stmt.keyword.line }; }
+  };
+
+  struct Row {
+    std::string label;
+    uint64_t count;
+  };
+
+  void printRows(std::ostream &out, std::vector<Row> rows, size_t limit) {
+    std::stable_sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) { return a.count > b.count; });
+    for (size_t i = 0; i < rows.size() && i < limit; ++i)
+      out << std::setw(14) << rows[i].count << "  " << rows[i].label << "\n";
+    if (rows.size() > limit)
+      out << std::setw(14) << "..." << "  " << rows.size() - limit << " more\n";
+  }
+}
+
+void ExecutionStats::countCall(LoxCallable &callee) {
+  LoxFunction *function = dynamic_cast<LoxFunction*>(&callee);
+  std::pair<const void*, int> key { &callee, 0 };
+  if (function != nullptr)
+    key = { function->getDeclaration().get(), function->getDeclaration()->name.line };
+
+  auto [entry, inserted] = callCounts.try_emplace(key, 0);
+  entry->second++;
+  if (!inserted)
+    return;
+  if (function != nullptr) {
+    declarations.push_back(function->getDeclaration());
+    callNames[key] = function->getDeclaration()->name.lexeme->str() + " (line " + std::to_string(key.second) + ")";
+  } else if (LoxNative *native = dynamic_cast<LoxNative*>(&callee)) {
+    callNames[key] = native->name + " (native)";
+  } else if (LoxClass *klass = dynamic_cast<LoxClass*>(&callee)) {
+    callNames[key] = klass->name->str() + " (class)";
+  } else {
+    callNames[key] = "<native>";
+  }
+}
+
+std::map<int, uint64_t> ExecutionStats::lineCounts() const {
+  NodeDescriber describer;
+  std::map<int, uint64_t> lines;
+  for (auto &[stmt, counter] : stmts) {
+    // blocks and function bodies would double count the lines they contain
+    if (dynamic_cast<Block*>(counter.node.get()) != nullptr)
+      continue;
+    int line = describer.describe(*counter.node).line;
+    if (line != 0)
+      lines[line] += counter.count;
+  }
+  return lines;
+}
+
+void ExecutionStats::report(std::ostream &out, size_t limit) const {
+  NodeDescriber describer;
+  uint64_t stmtTotal = 0, exprTotal = 0, callTotal = 0;
+  for (auto &[stmt, counter] : stmts)
+    stmtTotal += counter.count;
+  for (auto &[expr, counter] : exprs)
+    exprTotal += counter.count;
+  for (auto &[key, count] : callCounts)
+    callTotal += count;
+
+  out << "== execution stats ==\n"
+      << std::setw(14) << stmtTotal << "  statements executed\n"
+      << std::setw(14) << exprTotal << "  expressions evaluated\n"
+      << std::setw(14) << callTotal << "  calls\n";
+
+  out << "\n== hot lines ==\n";
+  std::vector<Row> rows;
+  for (auto &[line, count] : lineCounts())
+    rows.push_back({ "line " + std::to_string(line), count });
+  printRows(out, rows, limit);
+
+  out << "\n== statements ==\n";
+  rows.clear();
+  for (auto &[stmt, counter] : stmts) {
+    NodeInfo info = describer.describe(*counter.node);
+    rows.push_back({ std::string(info.kind) + " (line " + std::to_string(info.line) + ")", counter.count });
+  }
+  printRows(out, rows, limit);
+
+  out << "\n== expressions ==\n";
+  rows.clear();
+  for (auto &[expr, counter] : exprs) {
+    NodeInfo info = describer.describe(*counter.node);
+    rows.push_back({ std::string(info.kind) + " (line " + std::to_string(info.line) + ")", counter.count });
+  }
+  printRows(out, rows, limit);
+
+  out << "\n== environment lookups by chain depth ==\n";
+  out << std::setw(6) << "depth" << std::setw(14) << "get" << std::setw(14) << "assign" << "\n";
+  for (size_t depth = 0; depth < std::max(getDepths.size(), assignDepths.size()); ++depth) {
+    out << std::setw(6) << depth
+        << std::setw(14) << (depth < getDepths.size() ? getDepths[depth] : 0)
+        << std::setw(14) << (depth < assignDepths.size() ? assignDepths[depth] : 0) << "\n";
+  }
+
+  out << "\n== calls per function ==\n";
+  rows.clear();
+  for (auto &[key, count] : callCounts)
+    rows.push_back({ callNames.at(key), count });
+  printRows(out, rows, limit);
+}
+
+void ExecutionStats::annotate(std::ostream &out) const {
+  std::map<int, uint64_t> lines = lineCounts();
+  std::istringstream in(source);
+  std::string text;
+  for (int line = 1; std::getline(in, text); ++line) {
+    auto found = lines.find(line);
+    if (found != lines.end())
+      out << std::setw(12) << found->second;
+    else
+      out << std::setw(12) << "";
+    out << " | " << text << "\n";
+  }
+}
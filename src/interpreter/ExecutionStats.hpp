@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Expr.hpp"
+#include "LoxCallable.hpp"
+#include "Stmt.hpp"
+
+// Exact execution counters for --stats: how often every Stmt and Expr node
+// ran, how far Environment lookups had to walk, and how often each function
+// was called. Counting is driven by the Interpreter, which only calls in
+// here when a stats object is attached.
+class ExecutionStats {
+  template<typename Node>
+  struct Counter {
+    std::shared_ptr<Node> node;
+    uint64_t count;
+  };
+
+  std::unordered_map<const Stmt*, Counter<Stmt>> stmts;
+  std::unordered_map<const Expr*, Counter<Expr>> exprs;
+  std::vector<uint64_t> getDepths;
+  std::vector<uint64_t> assignDepths;
+  std::map<std::pair<const void*, int>, uint64_t> callCounts;
+  std::map<std::pair<const void*, int>, std::string> callNames;
+  std::vector<std::shared_ptr<Function>> declarations;
+  std::string source;
+
+  std::map<int, uint64_t> lineCounts() const;
+
+public:
+  void count(std::shared_ptr<Stmt> &stmt) {
+    auto [entry, inserted] = stmts.try_emplace(stmt.get(), Counter<Stmt> { stmt, 0 });
+    entry->second.count++;
+  }
+  void count(std::shared_ptr<Expr> &expr) {
+    auto [entry, inserted] = exprs.try_emplace(expr.get(), Counter<Expr> { expr, 0 });
+    entry->second.count++;
+  }
+  void countGet(int depth) { countDepth(getDepths, depth); }
+  void countAssign(int depth) { countDepth(assignDepths, depth); }
+  void countCall(LoxCallable &callee);
+
+  // remembered for the annotated listing, line numbers refer to it
+  void setSource(std::string source) { this->source = source; }
+
+  void report(std::ostream &out, size_t limit = 40) const;
+  void annotate(std::ostream &out) const;
+
+private:
+  static void countDepth(std::vector<uint64_t> &depths, int depth) {
+    if (depth < 0)
+      return;
+    if (depths.size() <= static_cast<size_t>(depth))
+      depths.resize(depth + 1);
+    depths[depth]++;
+  }
+};
@@ -1,12 +1,28 @@
 #pragma once
 
 #include <any>
+#include <cstdint>
 #include <vector>
 #include "Token.hpp"
+#include "Shape.hpp"
 
 struct ExprVisitor;
 
+// Set by TypeInference on expressions proven to produce a number from
+// operands that are proven numbers too. The interpreter evaluates these
+// without boxing intermediate results or checking operand types.
+enum class NumericForm : uint8_t {
+  None,
+  Literal,
+  Variable,
+  Grouping,
+  Negate,
+  Arithmetic,
+};
+
 struct Expr {
+  NumericForm numeric { NumericForm::None };
+
   virtual std::any accept(ExprVisitor &visitor) = 0;
   virtual ~Expr() = default;
 };
@@ -15,6 +31,14 @@ struct Assign;
 struct Grouping;
 struct Binary;
 struct Call;
+struct Get;
+struct Set;
+struct This;
+struct Super;
+struct ArrayLiteral;
+struct MapLiteral;
+struct Index;
+struct IndexSet;
 struct Literal;
 struct Logical;
 struct Logic;
@@ -26,6 +50,14 @@ struct ExprVisitor {
   virtual std::any visitGroupingExpr(Grouping &expr) = 0;
   virtual std::any visitBinaryExpr(Binary &expr) = 0;
   virtual std::any visitCallExpr(Call &expr) = 0;
+  virtual std::any visitGetExpr(Get &expr) = 0;
+  virtual std::any visitSetExpr(Set &expr) = 0;
+  virtual std::any visitThisExpr(This &expr) = 0;
+  virtual std::any visitSuperExpr(Super &expr) = 0;
+  virtual std::any visitArrayLiteralExpr(ArrayLiteral &expr) = 0;
+  virtual std::any visitMapLiteralExpr(MapLiteral &expr) = 0;
+  virtual std::any visitIndexExpr(Index &expr) = 0;
+  virtual std::any visitIndexSetExpr(IndexSet &expr) = 0;
   virtual std::any visitLiteralExpr(Literal &expr) = 0;
   virtual std::any visitLogicalExpr(Logical &expr) = 0;
   virtual std::any visitUnaryExpr(Unary &expr) = 0;
@@ -35,6 +67,8 @@ struct ExprVisitor {
 struct Assign : public Expr {
   Token name;
   std::shared_ptr<Expr> value;
+  // Resolver: local declaration in the same function, or -1
+  int local { -1 };
   Assign(Token &name, std::shared_ptr<Expr> &value) : name { name }, value { std::move(value) } {};
 
   std::any accept(ExprVisitor &visitor) override {
@@ -73,9 +107,96 @@ struct Call : public Expr {
   }
 };
 
+struct Get : public Expr {
+  std::shared_ptr<Expr> object;
+  Token name;
+  PropertyCache cache;
+  Get(std::shared_ptr<Expr> &object, Token &name) : object { std::move(object) }, name { name } {};
+
+  std::any accept(ExprVisitor &visitor) override {
+    return visitor.visitGetExpr(*this);
+  }
+};
+
+struct Set : public Expr {
+  std::shared_ptr<Expr> object;
+  Token name;
+  std::shared_ptr<Expr> value;
+  PropertyCache cache;
+  Set(std::shared_ptr<Expr> &object, Token &name, std::shared_ptr<Expr> &value) : object { std::move(object) }, name { name }, value { std::move(value) } {};
+
+  std::any accept(ExprVisitor &visitor) override {
+    return visitor.visitSetExpr(*this);
+  }
+};
+
+struct This : public Expr {
+  Token keyword;
+  This(Token keyword) : keyword { keyword } {};
+
+  std::any accept(ExprVisitor &visitor) override {
+    return visitor.visitThisExpr(*this);
+  }
+};
+
+struct Super : public Expr {
+  Token keyword;
+  Token method;
+  Super(Token keyword, Token method) : keyword { keyword }, method { method } {};
+
+  std::any accept(ExprVisitor &visitor) override {
+    return visitor.visitSuperExpr(*this);
+  }
+};
+
+struct ArrayLiteral : public Expr {
+  Token bracket;
+  std::vector<std::shared_ptr<Expr>> elements;
+  ArrayLiteral(Token &bracket, std::vector<std::shared_ptr<Expr>> &elements) : bracket { bracket }, elements { std::move(elements) } {};
+
+  std::any accept(ExprVisitor &visitor) override {
+    return visitor.visitArrayLiteralExpr(*this);
+  }
+};
+
+struct MapLiteral : public Expr {
+  Token brace;
+  std::vector<std::shared_ptr<Expr>> keys;
+  std::vector<std::shared_ptr<Expr>> values;
+  MapLiteral(Token &brace, std::vector<std::shared_ptr<Expr>> &keys, std::vector<std::shared_ptr<Expr>> &values) : brace { brace }, keys { std::move(keys) }, values { std::move(values) } {};
+
+  std::any accept(ExprVisitor &visitor) override {
+    return visitor.visitMapLiteralExpr(*this);
+  }
+};
+
+struct Index : public Expr {
+  std::shared_ptr<Expr> object;
+  Token bracket;
+  std::shared_ptr<Expr> index;
+  Index(std::shared_ptr<Expr> &object, Token &bracket, std::shared_ptr<Expr> &index) : object { std::move(object) }, bracket { bracket }, index { std::move(index) } {};
+
+  std::any accept(ExprVisitor &visitor) override {
+    return visitor.visitIndexExpr(*this);
+  }
+};
+
+struct IndexSet : public Expr {
+  std::shared_ptr<Expr> object;
+  Token bracket;
+  std::shared_ptr<Expr> index;
+  std::shared_ptr<Expr> value;
+  IndexSet(std::shared_ptr<Expr> &object, Token &bracket, std::shared_ptr<Expr> &index, std::shared_ptr<Expr> &value) : object { std::move(object) }, bracket { bracket }, index { std::move(index) }, value { std::move(value) } {};
+
+  std::any accept(ExprVisitor &visitor) override {
+    return visitor.visitIndexSetExpr(*this);
+  }
+};
+
 struct Literal : public Expr {
   std::any value;
-  Literal(std::any value) : value { value } {};
+  int line;
+  Literal(std::any value, int line) : value { value }, line { line } {};
 
   std::any accept(ExprVisitor &visitor) override {
     return visitor.visitLiteralExpr(*this);
@@ -86,7 +207,7 @@ struct Logical : public Expr {
   std::shared_ptr<Expr> right;
   std::shared_ptr<Expr> left;
   Token op;
-  Logical(std::shared_ptr<Expr> &left, Token op, std::shared_ptr<Expr> &right) : right { std::move(right)}, op { op }, left { std::move(left) } {};
+  Logical(std::shared_ptr<Expr> &left, Token op, std::shared_ptr<Expr> &right) : right { std::move(right)}, left { std::move(left) }, op { op } {};
 
   std::any accept(ExprVisitor &visitor) override {
     return visitor.visitLogicalExpr(*this);
@@ -106,6 +227,8 @@ struct Unary : public Expr {
 
 struct Variable : public Expr {
   Token name;
+  // Resolver: local declaration in the same function, or -1
+  int local { -1 };
   Variable(Token name) : name { name } {};
 
   std::any accept(ExprVisitor &visitor) override {
@@ -0,0 +1,142 @@
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "Foreign.hpp"
+#include "LoxString.hpp"
+#include "Number.hpp"
+
+#if (defined(__x86_64__) || defined(__aarch64__)) && !defined(_WIN32)
+#include <dlfcn.h>
+#define LOX_FOREIGN_CALLS 1
+#endif
+
+#ifdef LOX_FOREIGN_CALLS
+namespace {
+  enum class CType { Double, Int64, String, Void };
+
+  struct Signature {
+    CType result;
+    std::vector<CType> parameters;
+  };
+
+  constexpr size_t integerRegisters = 6;
+  constexpr size_t doubleRegisters = 8;
+
+  std::string_view trim(std::string_view text) {
+    size_t first = text.find_first_not_of(" \t");
+    if (first == std::string_view::npos)
+      return {};
+    return text.substr(first, text.find_last_not_of(" \t") - first + 1);
+  }
+
+  CType typeNamed(std::string_view name) {
+    name = trim(name);
+    if (name == "double")
+      return CType::Double;
+    if (name == "int64")
+      return CType::Int64;
+    if (name == "string")
+      return CType::String;
+    if (name == "void")
+      return CType::Void;
+    throw NativeError("Unknown type '" + std::string(name) + "' in signature.");
+  }
+
+  Signature parseSignature(std::string_view text) {
+    text = trim(text);
+    size_t open = text.find('(');
+    if (open == std::string_view::npos || text.find(')') != text.size() - 1)
+      throw NativeError("Signature must look like 'double(double, int64)'.");
+    Signature signature { typeNamed(text.substr(0, open)), {} };
+    std::string_view list = trim(text.substr(open + 1, text.size() - open - 2));
+    if (list == "void")
+      list = {};
+    size_t integers = 0, doubles = 0;
+    while (!list.empty()) {
+      size_t comma = list.find(',');
+      CType type = typeNamed(list.substr(0, comma));
+      if (type == CType::Void)
+        throw NativeError("A parameter cannot be void.");
+      (type == CType::Double ? doubles : integers)++;
+      signature.parameters.push_back(type);
+      list = comma == std::string_view::npos ? std::string_view {} : list.substr(comma + 1);
+      if (comma != std::string_view::npos && trim(list).empty())
+        throw NativeError("Signature must look like 'double(double, int64)'.");
+    }
+    if (integers > integerRegisters || doubles > doubleRegisters)
+      throw NativeError("Foreign functions take at most 6 int64 or string and 8 double parameters.");
+    return signature;
+  }
+
+  using IntegerCall = int64_t (*)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t,
+    double, double, double, double, double, double, double, double);
+  using DoubleCall = double (*)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t,
+    double, double, double, double, double, double, double, double);
+
+  void checkNumber(std::any &value, size_t index) {
+    if (!isNumber(value))
+      throw NativeError("Argument " + std::to_string(index + 1) + " must be a number.");
+  }
+
+  std::any call(void *symbol, const Signature &signature, std::vector<std::any> &arguments) {
+    int64_t i[integerRegisters] {};
+    double d[doubleRegisters] {};
+    size_t integers = 0, doubles = 0;
+    for (size_t index = 0; index < arguments.size(); ++index) {
+      std::any &argument = arguments[index];
+      switch (signature.parameters[index]) {
+        case CType::Double:
+          checkNumber(argument, index);
+          d[doubles++] = toDouble(argument);
+          break;
+        case CType::Int64:
+          checkNumber(argument, index);
+          // any whole number that fits is held as one
+          if (argument.type() != typeid(int64_t))
+            throw NativeError("Argument " + std::to_string(index + 1) + " must be an integer.");
+          i[integers++] = std::any_cast<int64_t>(argument);
+          break;
+        default:
+          if (argument.type() != typeid(StringRef))
+            throw NativeError("Argument " + std::to_string(index + 1) + " must be a string.");
+          i[integers++] = reinterpret_cast<intptr_t>(std::any_cast<StringRef&>(argument)->str().c_str());
+          break;
+      }
+    }
+
+    if (signature.result == CType::Double)
+      return boxNumber(reinterpret_cast<DoubleCall>(symbol)(i[0], i[1], i[2], i[3], i[4], i[5], d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7]));
+    int64_t result = reinterpret_cast<IntegerCall>(symbol)(i[0], i[1], i[2], i[3], i[4], i[5], d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7]);
+    switch (signature.result) {
+      case CType::Int64:
+        return result;
+      case CType::String:
+        if (result == 0)
+          return (void*) nullptr;
+        return LoxString::create(reinterpret_cast<const char*>(result));
+      default:
+        return (void*) nullptr;
+    }
+  }
+}
+#endif
+
+std::shared_ptr<LoxCallable> loadForeign(const std::string &path, const std::string &name, const std::string &signature) {
+#ifdef LOX_FOREIGN_CALLS
+  Signature parsed = parseSignature(signature);
+  // never closed: the function may be called for as long as the process runs
+  void *library = dlopen(path.empty() ? nullptr : path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (library == nullptr)
+    throw NativeError("Could not load library: " + std::string(dlerror()) + ".");
+  void *symbol = dlsym(library, name.c_str());
+  if (symbol == nullptr)
+    throw NativeError("Undefined symbol '" + name + "' in " + (path.empty() ? "the program" : path) + ".");
+  int arity = parsed.parameters.size();
+  return std::make_shared<LoxForeign>(name, path, arity, [symbol, parsed](Interpreter &, std::vector<std::any> &arguments) {
+    return call(symbol, parsed, arguments);
+  });
+#else
+  throw NativeError("Foreign functions are not supported on this platform.");
+#endif
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <memory>
+#include <string>
+#include "LoxNative.hpp"
+
+// A C function from a shared library, called like any other native.
+//
+// Its signature is declared in C style, as in "double(double, int64)":
+// the return type is double, int64, string (a const char*, which becomes
+// a Lox string or nil if null) or void, and each parameter is double,
+// int64 (from a number that must be a whole one) or string (passed as a
+// const char* that lives for the call).
+//
+// Calls go straight through a function pointer with no libffi: on x86-64
+// and AArch64 integer and floating-point arguments are passed in separate
+// register files, so any mix of up to six integer or string parameters and
+// eight doubles lands where the callee expects it when called through one
+// pointer type taking six int64s then eight doubles. Signatures needing
+// more than that are refused, as is every signature on other platforms.
+class LoxForeign : public LoxNative {
+public:
+  const std::string library;
+
+  LoxForeign(std::string name, std::string library, int arity, Body body)
+      : LoxNative { std::move(name), arity, std::move(body) }, library { std::move(library) } {}
+};
+
+// Looks `name` up in the library at `path` (the running program and the
+// libraries it links when `path` is empty) and binds it to `signature`.
+// Throws NativeError if the library, the symbol or the signature is bad.
+std::shared_ptr<LoxCallable> loadForeign(const std::string &path, const std::string &name, const std::string &signature);
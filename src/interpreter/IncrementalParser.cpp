@@ -0,0 +1,328 @@
+#include <algorithm>
+#include "IncrementalParser.hpp"
+#include "Parser.hpp"
+#include "Resolver.hpp"
+#include "Scanner.hpp"
+#include "TypeInference.hpp"
+
+namespace {
+  // true if the statement ends in an `if` without an `else`, which an
+  // `else` following it would extend
+  bool takesElse(Stmt *stmt) {
+    if (If *branch = dynamic_cast<If*>(stmt))
+      return branch->elseBranch == nullptr || takesElse(branch->elseBranch.get());
+    if (While *loop = dynamic_cast<While*>(stmt))
+      return takesElse(loop->body.get());
+    if (For *loop = dynamic_cast<For*>(stmt))
+      return takesElse(loop->body.get());
+    return false;
+  }
+
+  // Copies a declaration, annotations and all, with every line moved by
+  // `delta`. The copy is cheaper than parsing, resolving and analyzing the
+  // declaration again, and the version it came from keeps its own nodes.
+  class Relocator : public ExprVisitor, public StmtVisitor {
+    int delta;
+
+    template<typename T>
+    std::shared_ptr<T> copy(T &node) {
+      return std::allocate_shared<T>(CountingAllocator<T, MemoryCategory::Ast> {}, node);
+    }
+
+    void relocate(std::vector<std::shared_ptr<Stmt>> &statements) {
+      for (std::shared_ptr<Stmt> &stmt : statements)
+        stmt = relocate(stmt);
+    }
+    void relocate(std::vector<std::shared_ptr<Expr>> &exprs) {
+      for (std::shared_ptr<Expr> &expr : exprs)
+        expr = relocate(expr);
+    }
+    std::shared_ptr<Expr> relocate(const std::shared_ptr<Expr> &expr) {
+      return expr == nullptr ? nullptr : std::any_cast<std::shared_ptr<Expr>>(expr->accept(*this));
+    }
+    std::shared_ptr<Function> relocate(const std::shared_ptr<Function> &function) {
+      return std::static_pointer_cast<Function>(relocate(std::shared_ptr<Stmt> { function }));
+    }
+
+    // the copy, as the type the caller stores it as
+    template<typename T>
+    std::any expr(std::shared_ptr<T> node) { return std::shared_ptr<Expr> { std::move(node) }; }
+    template<typename T>
+    std::any stmt(std::shared_ptr<T> node) { return std::shared_ptr<Stmt> { std::move(node) }; }
+
+  public:
+    explicit Relocator(int delta) : delta { delta } {}
+
+    std::shared_ptr<Stmt> relocate(const std::shared_ptr<Stmt> &stmt) {
+      return stmt == nullptr ? nullptr : std::any_cast<std::shared_ptr<Stmt>>(stmt->accept(*this));
+    }
+
+    std::any visitAssignExpr(Assign &node) override {
+      std::shared_ptr<Assign> moved = copy(node);
+      moved->name.line += delta;
+      moved->value = relocate(moved->value);
+      return expr(moved);
+    }
+    std::any visitGroupingExpr(Grouping &node) override {
+      std::shared_ptr<Grouping> moved = copy(node);
+      moved->expr = relocate(moved->expr);
+      return expr(moved);
+    }
+    std::any visitBinaryExpr(Binary &node) override {
+      std::shared_ptr<Binary> moved = copy(node);
+      moved->op.line += delta;
+      moved->left = relocate(moved->left);
+      moved->right = relocate(moved->right);
+      return expr(moved);
+    }
+    std::any visitCallExpr(Call &node) override {
+      std::shared_ptr<Call> moved = copy(node);
+      moved->paren.line += delta;
+      moved->callee = relocate(moved->callee);
+      relocate(moved->arguments);
+      return expr(moved);
+    }
+    std::any visitGetExpr(Get &node) override {
+      std::shared_ptr<Get> moved = copy(node);
+      moved->name.line += delta;
+      moved->object = relocate(moved->object);
+      return expr(moved);
+    }
+    std::any visitSetExpr(Set &node) override {
+      std::shared_ptr<Set> moved = copy(node);
+      moved->name.line += delta;
+      moved->object = relocate(moved->object);
+      moved->value = relocate(moved->value);
+      return expr(moved);
+    }
+    std::any visitThisExpr(This &node) override {
+      std::shared_ptr<This> moved = copy(node);
+      moved->keyword.line += delta;
+      return expr(moved);
+    }
+    std::any visitSuperExpr(Super &node) override {
+      std::shared_ptr<Super> moved = copy(node);
+      moved->keyword.line += delta;
+      moved->method.line += delta;
+      return expr(moved);
+    }
+    std::any visitArrayLiteralExpr(ArrayLiteral &node) override {
+      std::shared_ptr<ArrayLiteral> moved = copy(node);
+      moved->bracket.line += delta;
+      relocate(moved->elements);
+      return expr(moved);
+    }
+    std::any visitMapLiteralExpr(MapLiteral &node) override {
+      std::shared_ptr<MapLiteral> moved = copy(node);
+      moved->brace.line += delta;
+      relocate(moved->keys);
+      relocate(moved->values);
+      return expr(moved);
+    }
+    std::any visitIndexExpr(Index &node) override {
+      std::shared_ptr<Index> moved = copy(node);
+      moved->bracket.line += delta;
+      moved->object = relocate(moved->object);
+      moved->index = relocate(moved->index);
+      return expr(moved);
+    }
+    std::any visitIndexSetExpr(IndexSet &node) override {
+      std::shared_ptr<IndexSet> moved = copy(node);
+      moved->bracket.line += delta;
+      moved->object = relocate(moved->object);
+      moved->index = relocate(moved->index);
+      moved->value = relocate(moved->value);
+      return expr(moved);
+    }
+    std::any visitLiteralExpr(Literal &node) override {
+      std::shared_ptr<Literal> moved = copy(node);
+      moved->line += delta;
+      return expr(moved);
+    }
+    std::any visitLogicalExpr(Logical &node) override {
+      std::shared_ptr<Logical> moved = copy(node);
+      moved->op.line += delta;
+      moved->left = relocate(moved->left);
+      moved->right = relocate(moved->right);
+      return expr(moved);
+    }
+    std::any visitUnaryExpr(Unary &node) override {
+      std::shared_ptr<Unary> moved = copy(node);
+      moved->op.line += delta;
+      moved->right = relocate(moved->right);
+      return expr(moved);
+    }
+    std::any visitVariableExpr(Variable &node) override {
+      std::shared_ptr<Variable> moved = copy(node);
+      moved->name.line += delta;
+      return expr(moved);
+    }
+
+    std::any visitBlockStmt(Block &node) override {
+      std::shared_ptr<Block> moved = copy(node);
+      relocate(moved->statements);
+      return stmt(moved);
+    }
+    std::any visitVarStmt(Var &node) override {
+      std::shared_ptr<Var> moved = copy(node);
+      moved->name.line += delta;
+      moved->initializer = relocate(moved->initializer);
+      return stmt(moved);
+    }
+    std::any visitWhileStmt(While &node) override {
+      std::shared_ptr<While> moved = copy(node);
+      moved->condition = relocate(moved->condition);
+      moved->body = relocate(moved->body);
+      return stmt(moved);
+    }
+    std::any visitForStmt(For &node) override {
+      std::shared_ptr<For> moved = copy(node);
+      moved->initializer = relocate(moved->initializer);
+      moved->condition = relocate(moved->condition);
+      moved->increment = relocate(moved->increment);
+      moved->body = relocate(moved->body);
+      return stmt(moved);
+    }
+    std::any visitExpressionStmt(Expression &node) override {
+      std::shared_ptr<Expression> moved = copy(node);
+      moved->expr = relocate(moved->expr);
+      return stmt(moved);
+    }
+    std::any visitFunctionStmt(Function &node) override {
+      std::shared_ptr<Function> moved = copy(node);
+      moved->name.line += delta;
+      for (Token &param : moved->params)
+        param.line += delta;
+      relocate(moved->body);
+      return stmt(moved);
+    }
+    std::any visitClassStmt(Class &node) override {
+      std::shared_ptr<Class> moved = copy(node);
+      moved->name.line += delta;
+      moved->superclass = relocate(moved->superclass);
+      for (std::shared_ptr<Function> &method : moved->methods)
+        method = relocate(method);
+      return stmt(moved);
+    }
+    std::any visitIfStmt(If &node) override {
+      std::shared_ptr<If> moved = copy(node);
+      moved->condition = relocate(moved->condition);
+      moved->thenBranch = relocate(moved->thenBranch);
+      moved->elseBranch = relocate(moved->elseBranch);
+      return stmt(moved);
+    }
+    std::any visitPrintStmt(Print &node) override {
+      std::shared_ptr<Print> moved = copy(node);
+      moved->expr = relocate(moved->expr);
+      return stmt(moved);
+    }
+    std::any visitReturnStmt(Return &node) override {
+      std::shared_ptr<Return> moved = copy(node);
+      moved->keyword.line += delta;
+      moved->value = relocate(moved->value);
+      return stmt(moved);
+    }
+  };
+}
+
+void IncrementalParser::parse(std::string_view text, int begin, int end, int line, Diagnostics &diagnostics,
+    std::vector<Declaration> &parsed, int &stop, int &stopLine) {
+  Scanner scanner { text, diagnostics, begin, line };
+  std::vector<Token> tokens = scanner.scanTokens(end);
+  const std::vector<int> &offsets = scanner.getOffsets();
+  stop = scanner.getPosition();
+  stopLine = scanner.getLine();
+
+  Parser parser { tokens, diagnostics, true };
+  while (!parser.isAtEnd()) {
+    int first = parser.current;
+    std::shared_ptr<Stmt> stmt = parser.declaration();
+    const Token &last = tokens[parser.current - 1];
+    parsed.push_back({ std::move(stmt), offsets[first], offsets[parser.current - 1] + static_cast<int>(last.lexeme->size()),
+      tokens[first].line, last.line });
+  }
+}
+
+std::vector<std::shared_ptr<Stmt>> IncrementalParser::update(const std::string &next, Diagnostics &diagnostics) {
+  size_t limit = std::min(source.size(), next.size());
+  size_t prefix = std::mismatch(source.begin(), source.begin() + limit, next.begin()).first - source.begin();
+  size_t suffix = std::mismatch(source.rbegin(), source.rbegin() + (limit - prefix), next.rbegin()).first - source.rbegin();
+
+  // every declaration ends with a ';' or '}', which scans the same
+  // whatever follows it
+  size_t kept = 0;
+  while (kept < declarations.size() && static_cast<size_t>(declarations[kept].end) <= prefix)
+    ++kept;
+  // the one exception: the edit may put an `else` after a trailing `if`
+  if (kept > 0 && takesElse(declarations[kept - 1].stmt.get()))
+    --kept;
+  size_t resumed = declarations.size();
+  while (resumed > kept && static_cast<size_t>(declarations[resumed - 1].begin) >= source.size() - suffix)
+    --resumed;
+  int shift = static_cast<int>(next.size()) - static_cast<int>(source.size());
+
+  int begin = kept > 0 ? declarations[kept - 1].end : 0;
+  int line = kept > 0 ? declarations[kept - 1].endLine : 1;
+  std::vector<Declaration> parsed;
+  int stop, stopLine;
+  // lines the edit added above the declarations kept after it
+  int lines = 0;
+  if (resumed < declarations.size()) {
+    const Declaration &first = declarations[resumed];
+    Diagnostics attempt;
+    parse(next, begin, first.begin + shift, line, attempt, parsed, stop, stopLine);
+    lines = stopLine - first.line;
+    if (attempt.hasErrors() || stop != first.begin + shift) {
+      parsed.clear();
+      resumed = declarations.size();
+    }
+  }
+  if (resumed == declarations.size()) {
+    parse(next, begin, next.size(), line, diagnostics, parsed, stop, stopLine);
+    if (diagnostics.hasErrors()) {
+      source.clear();
+      declarations.clear();
+      reusedCount = 0;
+      return {};
+    }
+  }
+
+  std::vector<std::shared_ptr<Stmt>> fresh;
+  for (Declaration &declaration : parsed)
+    fresh.push_back(declaration.stmt);
+  // the declarations kept were resolved on their own terms: top-level
+  // code has no enclosing scope, so nothing around them changes that
+  Resolver resolver { diagnostics };
+  resolver.resolve(fresh);
+  if (diagnostics.hasErrors()) {
+    source.clear();
+    declarations.clear();
+    reusedCount = 0;
+    return {};
+  }
+  TypeInference { resolver }.analyze(fresh);
+
+  std::vector<Declaration> merged(declarations.begin(), declarations.begin() + kept);
+  merged.insert(merged.end(), parsed.begin(), parsed.end());
+  Relocator relocator { lines };
+  for (size_t i = resumed; i < declarations.size(); ++i) {
+    Declaration moved = declarations[i];
+    moved.begin += shift;
+    moved.end += shift;
+    if (lines != 0) {
+      moved.stmt = relocator.relocate(moved.stmt);
+      moved.line += lines;
+      moved.endLine += lines;
+    }
+    merged.push_back(std::move(moved));
+  }
+  reusedCount = kept + declarations.size() - resumed;
+  declarations = std::move(merged);
+  source = next;
+
+  std::vector<std::shared_ptr<Stmt>> statements;
+  statements.reserve(declarations.size());
+  for (Declaration &declaration : declarations)
+    statements.push_back(declaration.stmt);
+  return statements;
+}
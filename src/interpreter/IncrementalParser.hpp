@@ -0,0 +1,58 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Diagnostics.hpp"
+#include "Stmt.hpp"
+
+// Parses successive versions of one script, such as a file an editor or a
+// hot-reload loop sends again after every edit, reusing what the edit did
+// not touch.
+//
+// The unit of reuse is the top-level declaration, functions and classes
+// included. Declarations that lie wholly in the text before the first
+// changed byte are kept as they are, and so are those wholly in the text
+// after the last one; if the edit added or removed lines above those, they
+// are copied with their lines shifted to match. Only the text between the
+// two runs is scanned and parsed, and only the declarations found there
+// are resolved and analyzed. If that text does
+// not end exactly where the kept declarations begin (a string or comment
+// left open by the edit, say) or does not parse, the whole rest of the
+// script is scanned and parsed instead, so the statements and errors are
+// those a parse from scratch would give.
+//
+// Kept declarations that did not move are the same nodes as before: the
+// statements of the previous version must not be changed by anything but
+// running them, and are never changed by a later update.
+class IncrementalParser {
+public:
+  // the statements of `source`, parsed as a preparsing Parser would and
+  // then resolved and analyzed; empty, with the errors in `diagnostics`,
+  // if it does not parse or resolve
+  std::vector<std::shared_ptr<Stmt>> update(const std::string &source, Diagnostics &diagnostics);
+
+  // the declarations the last update took from the version before it
+  size_t reused() const { return reusedCount; }
+
+private:
+  struct Declaration {
+    std::shared_ptr<Stmt> stmt;
+    // from the start of its first token to the end of its last
+    int begin;
+    int end;
+    // the lines of its first and last tokens
+    int line;
+    int endLine;
+  };
+
+  // the last version, and its declarations if it parsed
+  std::string source;
+  std::vector<Declaration> declarations;
+  size_t reusedCount { 0 };
+
+  // scans and parses [begin, end) of `text`, counting lines from `line`;
+  // `stop` and `stopLine` are where scanning stopped
+  static void parse(std::string_view text, int begin, int end, int line, Diagnostics &diagnostics,
+    std::vector<Declaration> &parsed, int &stop, int &stopLine);
+};
@@ -6,13 +6,214 @@
 #include "LoxCallable.hpp"
 #include "ReturnException.hpp"
 #include "LoxFunction.hpp"
+#include "LoxClass.hpp"
+#include "LoxInstance.hpp"
+#include "LoxArray.hpp"
+#include "LoxMap.hpp"
+#include "Profiler.hpp"
+#include "ExecutionStats.hpp"
+#include "LoxNative.hpp"
+#include "MemoryStats.hpp"
+#include "LoxString.hpp"
+#include "Number.hpp"
+#include "StringTable.hpp"
+#include "Jit.hpp"
+#include "Parallel.hpp"
+#include "Foreign.hpp"
+#include "LoxFile.hpp"
+#include "ClosureEngine.hpp"
 #include <any>
+#include <chrono>
 #include <vector>
 #include <cmath>
 #include <sstream>
 #include <memory>
 #include "error.hpp"
 
+namespace {
+  LoxArray &arrayArgument(std::any &value) {
+    if (value.type() != typeid(ArrayRef))
+      throw NativeError("Argument must be an array.");
+    return *std::any_cast<ArrayRef&>(value);
+  }
+
+  LoxArray &numberArray(std::any &value) {
+    LoxArray &array = arrayArgument(value);
+    if (!array.numeric())
+      throw NativeError("Array must contain only numbers.");
+    return array;
+  }
+
+  LoxMap &mapArgument(std::any &value) {
+    if (value.type() != typeid(MapRef))
+      throw NativeError("Argument must be a map.");
+    return *std::any_cast<MapRef&>(value);
+  }
+
+  std::shared_ptr<LoxCallable> &callableArgument(std::any &value) {
+    if (value.type() != typeid(std::shared_ptr<LoxCallable>))
+      throw NativeError("Argument must be a function.");
+    return std::any_cast<std::shared_ptr<LoxCallable>&>(value);
+  }
+
+  const std::string &stringArgument(std::any &value) {
+    if (value.type() != typeid(StringRef))
+      throw NativeError("Argument must be a string.");
+    return std::any_cast<StringRef&>(value)->str();
+  }
+
+  // the number as it is held, for natives that keep integers exact
+  const std::any &exactNumberArgument(std::any &value) {
+    if (!isNumber(value))
+      throw NativeError("Argument must be a number.");
+    return value;
+  }
+
+  double numberArgument(std::any &value) {
+    return toDouble(exactNumberArgument(value));
+  }
+
+  LoxFile &fileArgument(std::any &value) {
+    LoxFile *file = nullptr;
+    if (value.type() == typeid(std::shared_ptr<LoxCallable>))
+      file = dynamic_cast<LoxFile*>(std::any_cast<std::shared_ptr<LoxCallable>&>(value).get());
+    if (file == nullptr)
+      throw NativeError("Argument must be a file.");
+    return *file;
+  }
+}
+
+Interpreter::Interpreter() {
+  auto native = [this](std::string name, int arity, LoxNative::Body body) {
+    std::shared_ptr<LoxCallable> function = std::make_shared<LoxNative>(name, arity, body);
+    nativeNames.push_back(StringTable::intern(name));
+    globals->define(nativeNames.back(), function);
+  };
+
+  native("clock", 0, [](Interpreter &, std::vector<std::any> &) -> std::any {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return boxNumber(std::chrono::duration<double>(now).count());
+  });
+  native("memoryUsage", 1, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    MemoryStats::Counters counters;
+    if (args[0].type() != typeid(StringRef) || !MemoryStats::lookup(std::any_cast<StringRef&>(args[0])->str(), counters))
+      return (void*) nullptr;
+    return counters.live;
+  });
+  native("memoryReport", 0, [](Interpreter &, std::vector<std::any> &) -> std::any {
+    std::ostringstream oss;
+    MemoryStats::report(oss);
+    return LoxString::create(oss.str());
+  });
+
+  native("len", 1, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    if (args[0].type() == typeid(StringRef))
+      return static_cast<int64_t>(std::any_cast<StringRef&>(args[0])->size());
+    if (args[0].type() == typeid(MapRef))
+      return static_cast<int64_t>(std::any_cast<MapRef&>(args[0])->size());
+    return static_cast<int64_t>(arrayArgument(args[0]).size());
+  });
+  native("push", 2, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    arrayArgument(args[0]).push(args[1]);
+    return (void*) nullptr;
+  });
+  native("pop", 1, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    return arrayArgument(args[0]).pop();
+  });
+  native("sum", 1, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    return numberArray(args[0]).sum();
+  });
+  native("dot", 2, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    LoxArray &left = numberArray(args[0]);
+    LoxArray &right = numberArray(args[1]);
+    if (left.size() != right.size())
+      throw NativeError("Arrays must have the same length.");
+    return left.dot(right);
+  });
+  native("scale", 2, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    LoxArray &array = numberArray(args[0]);
+    return array.scaled(exactNumberArgument(args[1]));
+  });
+  // adds a number to every element, or two arrays element by element
+  native("mapAdd", 2, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    LoxArray &array = numberArray(args[0]);
+    if (isNumber(args[1]))
+      return array.added(args[1]);
+    LoxArray &other = numberArray(args[1]);
+    if (array.size() != other.size())
+      throw NativeError("Arrays must have the same length.");
+    return array.added(other);
+  });
+  native("min", 1, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    return numberArray(args[0]).min();
+  });
+  native("max", 1, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    return numberArray(args[0]).max();
+  });
+  native("sort", 1, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    numberArray(args[0]).sort();
+    return args[0];
+  });
+
+  native("has", 2, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    return mapArgument(args[0]).contains(args[1]);
+  });
+  native("remove", 2, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    return mapArgument(args[0]).remove(args[1]);
+  });
+  // keys and values come out in insertion order
+  native("keys", 1, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    ArrayRef keys = LoxArray::create();
+    for (const LoxMap::Entry &entry : mapArgument(args[0]).entries()) {
+      if (entry.live)
+        keys->push(entry.key);
+    }
+    return keys;
+  });
+  native("values", 1, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    ArrayRef values = LoxArray::create();
+    for (const LoxMap::Entry &entry : mapArgument(args[0]).entries()) {
+      if (entry.live)
+        values->push(entry.value);
+    }
+    return values;
+  });
+
+  // spread over every hardware thread when the function is pure; see Parallel.hpp
+  native("parallelMap", 2, [](Interpreter &interpreter, std::vector<std::any> &args) -> std::any {
+    return parallelMap(interpreter, arrayArgument(args[0]), callableArgument(args[1]));
+  });
+  native("parallelReduce", 3, [](Interpreter &interpreter, std::vector<std::any> &args) -> std::any {
+    return parallelReduce(interpreter, arrayArgument(args[0]), callableArgument(args[1]), args[2]);
+  });
+
+  native("foreign", 3, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    return loadForeign(stringArgument(args[0]), stringArgument(args[1]), stringArgument(args[2]));
+  });
+
+  native("openFile", 2, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    return std::shared_ptr<LoxCallable>(LoxFile::open(stringArgument(args[0]), stringArgument(args[1])));
+  });
+  native("readLine", 1, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    return fileArgument(args[0]).readLine();
+  });
+  native("readChunk", 2, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    LoxFile &file = fileArgument(args[0]);
+    double size = numberArgument(args[1]);
+    if (size != std::floor(size) || size < 1)
+      throw NativeError("Chunk size must be a positive integer.");
+    return file.readChunk(std::min(size, 0x1p62));
+  });
+  native("writeAll", 2, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    LoxFile &file = fileArgument(args[0]);
+    file.writeAll(stringArgument(args[1]));
+    return (void*) nullptr;
+  });
+  native("closeFile", 1, [](Interpreter &, std::vector<std::any> &args) -> std::any {
+    fileArgument(args[0]).close();
+    return (void*) nullptr;
+  });
+}
 
 std::any Interpreter::visitLiteralExpr(Literal &expr) {
   return expr.value;
@@ -21,11 +222,20 @@ std::any Interpreter::visitGroupingExpr(Grouping &expr) {
   return evaluate(expr.expr);
 }
 std::any Interpreter::visitUnaryExpr(Unary &expr) {
+  if (expr.numeric != NumericForm::None) {
+    double right = number(expr.right);
+    if (!std::isnan(right))
+      return boxNumber(-right);
+  }
   std::any right = evaluate(expr.right);
   switch (expr.op.type) {
-    case TokenType::MINUS:
-      checkNumberOperand(expr.op, right);
-      return -(std::any_cast<double>(right));
+    case TokenType::MINUS: {
+      // empty when the operand is not a number
+      std::any negated = negateNumber(right);
+      if (!negated.has_value())
+        checkNumberOperand(expr.op, right);
+      return negated;
+    }
     case TokenType::BANG:
       return !isTruthy(right);
     default:
@@ -34,44 +244,60 @@ std::any Interpreter::visitUnaryExpr(Unary &expr) {
   return (void*) nullptr;
 }
 std::any Interpreter::visitBinaryExpr(Binary &expr) {
+  // the unboxed paths give NaN for numbers too big to be exact in a
+  // double, which are then worked out boxed
+  if (expr.numeric != NumericForm::None) {
+    double result = arithmetic(expr);
+    if (!std::isnan(result))
+      return boxNumber(result);
+  } else if (expr.left->numeric != NumericForm::None && expr.right->numeric != NumericForm::None) {
+    double left = number(expr.left);
+    double right = number(expr.right);
+    if (!std::isnan(left) && !std::isnan(right))
+      return compare(expr.op.type, left, right);
+  }
+
   std::any left = evaluate(expr.left);
   std::any right = evaluate(expr.right);
 
+  // the arithmetic on boxed numbers gives an empty result when an operand
+  // is not a number, so the operands are only checked then
   switch (expr.op.type) {
-    case TokenType::MINUS:
-      checkNumberOperand(expr.op, left, right);
-      return std::any_cast<double>(left) - std::any_cast<double>(right);
+    case TokenType::MINUS: {
+      std::any difference = subtractNumbers(left, right);
+      if (!difference.has_value())
+        checkNumberOperand(expr.op, left, right);
+      return difference;
+    }
     case TokenType::SLASH:
       checkNumberOperand(expr.op, left, right);
-      if (std::any_cast<double>(right) == 0)
+      if (toDouble(right) == 0)
         throw RuntimeError(expr.op, "Division by 0 not supported.");
-      return std::any_cast<double>(left) / std::any_cast<double>(right);
-    case TokenType::STAR:
-      checkNumberOperand(expr.op, left, right);
-      return std::any_cast<double>(left) * std::any_cast<double>(right);
-    case TokenType::PLUS:
-      if ((left.type() == typeid(double)) && (right.type() == typeid(double)))
-        return std::any_cast<double>(left) + std::any_cast<double>(right);
-      if ((left.type() == typeid(std::string)) && (right.type() == typeid(std::string)))
-        return std::any_cast<std::string>(left) + std::any_cast<std::string>(right);
-      if ((left.type() == typeid(std::string)) && (right.type() == typeid(double))) {
-        std::ostringstream oss;
-        oss << std::any_cast<std::string>(left) << std::any_cast<double>(right);
-        return oss.str();
-      }
+      return divideNumbers(left, right);
+    case TokenType::STAR: {
+      std::any product = multiplyNumbers(left, right);
+      if (!product.has_value())
+        checkNumberOperand(expr.op, left, right);
+      return product;
+    }
+    case TokenType::PLUS: {
+      std::any sum = addNumbers(left, right);
+      if (sum.has_value())
+        return sum;
+      if ((left.type() == typeid(StringRef)) && (right.type() == typeid(StringRef)))
+        return LoxString::concat(std::any_cast<StringRef&>(left), std::any_cast<StringRef&>(right));
+      if ((left.type() == typeid(StringRef)) && isNumber(right))
+        return LoxString::concat(std::any_cast<StringRef&>(left), LoxString::create(formatNumber(right)));
       throw RuntimeError(expr.op, "Operands must be two numbers or two strings.");
+    }
     case TokenType::GREATER:
-      checkNumberOperand(expr.op, left, right);
-      return std::any_cast<double>(left) > std::any_cast<double>(right);
+      return compareNumberOperands(expr.op, left, right) > 0;
     case TokenType::GREATER_EQUAL:
-      checkNumberOperand(expr.op, left, right);
-      return std::any_cast<double>(left) >= std::any_cast<double>(right);
+      return compareNumberOperands(expr.op, left, right) >= 0;
     case TokenType::LESS:
-      checkNumberOperand(expr.op, left, right);
-      return std::any_cast<double>(left) < std::any_cast<double>(right);
+      return compareNumberOperands(expr.op, left, right) < 0;
     case TokenType::LESS_EQUAL:
-      checkNumberOperand(expr.op, left, right);
-      return std::any_cast<double>(left) <= std::any_cast<double>(right);
+      return compareNumberOperands(expr.op, left, right) <= 0;
     case TokenType::BANG_EQUAL:
       return !isEqual(left, right);
     case TokenType::EQUAL_EQUAL:
@@ -93,21 +319,124 @@ std::any Interpreter::visitCallExpr(Call &expr) {
     throw RuntimeError(expr.paren, "Can only call functions and classes.");
 
   std::shared_ptr<LoxCallable> function = std::any_cast<std::shared_ptr<LoxCallable>>(callee);
-  if (args.size() != function->arity()) {
+  if (args.size() != static_cast<size_t>(function->arity())) {
     std::ostringstream oss;
     oss << "Expected " << function->arity() << " arguments but got " << args.size() << ".";
     throw RuntimeError(expr.paren, oss.str());
   }
 
-  return function->call(*this, args);
+  if (stats != nullptr)
+    stats->countCall(*function);
+  try {
+    if (profiler != nullptr) {
+      Profiler::Scope frame { *profiler, *function, expr.paren.line };
+      return function->call(*this, args);
+    }
+    return function->call(*this, args);
+  } catch (NativeError &error) {
+    throw RuntimeError(expr.paren, error.what());
+  }
+}
+
+std::any Interpreter::visitGetExpr(Get &expr) {
+  std::any object = evaluate(expr.object);
+  if (object.type() != typeid(std::shared_ptr<LoxInstance>))
+    throw RuntimeError(expr.name, "Only instances have properties.");
+  return std::any_cast<std::shared_ptr<LoxInstance>&>(object)->get(expr.name, expr.cache);
+}
+
+std::any Interpreter::visitSetExpr(Set &expr) {
+  std::any object = evaluate(expr.object);
+  if (object.type() != typeid(std::shared_ptr<LoxInstance>))
+    throw RuntimeError(expr.name, "Only instances have fields.");
+  std::any value = evaluate(expr.value);
+  std::any_cast<std::shared_ptr<LoxInstance>&>(object)->set(expr.name, value, expr.cache);
+  return value;
+}
+
+std::any Interpreter::visitThisExpr(This &expr) {
+  return environment->get(expr.keyword);
+}
+
+std::any Interpreter::visitSuperExpr(Super &expr) {
+  // methods of a subclass close over an environment binding "super", and
+  // calling one binds "this" in the environment just inside it
+  std::shared_ptr<LoxClass> superclass = std::static_pointer_cast<LoxClass>(
+    std::any_cast<std::shared_ptr<LoxCallable>>(environment->get(expr.keyword)));
+  Token self { TokenType::THIS, StringTable::thisName(), nullptr, expr.keyword.line };
+  std::shared_ptr<LoxInstance> object = std::any_cast<std::shared_ptr<LoxInstance>>(environment->get(self));
+
+  LoxFunction *method = superclass->findMethod(expr.method.lexeme.get());
+  if (method == nullptr)
+    throw RuntimeError(expr.method, "Undefined property '" + expr.method.lexeme->str() + "'.");
+  std::shared_ptr<LoxCallable> bound = method->bind(object);
+  return bound;
+}
+
+std::any Interpreter::visitArrayLiteralExpr(ArrayLiteral &expr) {
+  ArrayRef array = LoxArray::create();
+  for (std::shared_ptr<Expr> &element : expr.elements)
+    array->push(evaluate(element));
+  return array;
+}
+
+std::any Interpreter::visitMapLiteralExpr(MapLiteral &expr) {
+  MapRef map = LoxMap::create();
+  for (size_t i = 0; i < expr.keys.size(); ++i) {
+    std::any key = evaluate(expr.keys[i]);
+    map->set(key, evaluate(expr.values[i]));
+  }
+  return map;
+}
+
+std::any Interpreter::visitIndexExpr(Index &expr) {
+  std::any object = evaluate(expr.object);
+  if (object.type() == typeid(MapRef))
+    return std::any_cast<MapRef&>(object)->get(evaluate(expr.index));
+  if (object.type() != typeid(ArrayRef))
+    throw RuntimeError(expr.bracket, "Only arrays and maps can be indexed.");
+  LoxArray &array = *std::any_cast<ArrayRef&>(object);
+  return array.get(arrayIndex(expr.bracket, array, evaluate(expr.index)));
+}
+
+std::any Interpreter::visitIndexSetExpr(IndexSet &expr) {
+  std::any object = evaluate(expr.object);
+  bool isMap = object.type() == typeid(MapRef);
+  if (!isMap && object.type() != typeid(ArrayRef))
+    throw RuntimeError(expr.bracket, "Only arrays and maps can be indexed.");
+  std::any index = evaluate(expr.index);
+  std::any value = evaluate(expr.value);
+  if (isMap) {
+    std::any_cast<MapRef&>(object)->set(index, value);
+    return value;
+  }
+  LoxArray &array = *std::any_cast<ArrayRef&>(object);
+  array.set(arrayIndex(expr.bracket, array, index), value);
+  return value;
+}
+
+size_t Interpreter::arrayIndex(const Token &bracket, const LoxArray &array, const std::any &index) {
+  if (!isNumber(index))
+    throw RuntimeError(bracket, "Array index must be a number.");
+  const int64_t *position = std::any_cast<int64_t>(&index);
+  // a double is either fractional or beyond any array
+  if (position == nullptr && std::any_cast<double>(index) != std::floor(std::any_cast<double>(index)))
+    throw RuntimeError(bracket, "Array index must be an integer.");
+  if (position == nullptr || *position < 0 || static_cast<uint64_t>(*position) >= array.size())
+    throw RuntimeError(bracket, "Array index out of range.");
+  return static_cast<size_t>(*position);
 }
 
 std::any Interpreter::visitVariableExpr(Variable &expr) {
+  if (stats != nullptr)
+    stats->countGet(environment->depthOf(expr.name.lexeme));
   return environment->get(expr.name);
 }
 
 std::any Interpreter::visitAssignExpr(Assign &expr) {
   std::any value = evaluate(expr.value);
+  if (stats != nullptr)
+    stats->countAssign(environment->depthOf(expr.name.lexeme));
   environment->assign(expr.name, value);
   return value;
 }
@@ -117,10 +446,58 @@ std::any Interpreter::visitExpressionStmt(Expression &stmt) {
   return nullptr;
 }
 
+std::shared_ptr<Environment> Interpreter::closureFor(const Function &declaration, std::shared_ptr<Environment> &enclosing,
+    Environment &from) {
+  if (declaration.captures.empty())
+    return enclosing;
+  std::shared_ptr<Environment> closure { Environment::create(enclosing) };
+  for (const StringRef &name : declaration.captures)
+    closure->capture(name, from);
+  return closure;
+}
+
 std::any Interpreter::visitFunctionStmt(Function &stmt) {
-  std::string lexeme = stmt.name.lexeme;
-  std::shared_ptr<LoxCallable> function = std::make_shared<LoxFunction>(std::make_shared<Function>(std::move(stmt)), environment);
-  environment->define(lexeme, function);
+  // a recursive function captures its own name, so the cell must exist first
+  if (stmt.cell)
+    environment->define(stmt.name.lexeme, Environment::cell((void*) nullptr));
+  std::shared_ptr<LoxCallable> function = std::allocate_shared<LoxFunction>(
+    CountingAllocator<LoxFunction, MemoryCategory::Closure> {},
+    std::static_pointer_cast<Function>(stmt.shared_from_this()), closureFor(stmt, globals, *environment));
+  if (stmt.cell)
+    environment->assign(stmt.name, function);
+  else
+    environment->define(stmt.name.lexeme, function);
+  return nullptr;
+}
+
+std::any Interpreter::visitClassStmt(Class &stmt) {
+  std::shared_ptr<LoxClass> superclass;
+  if (stmt.superclass != nullptr) {
+    std::any value = evaluate(stmt.superclass);
+    if (value.type() == typeid(std::shared_ptr<LoxCallable>))
+      superclass = std::dynamic_pointer_cast<LoxClass>(std::any_cast<std::shared_ptr<LoxCallable>&>(value));
+    if (superclass == nullptr)
+      throw RuntimeError(static_cast<Variable&>(*stmt.superclass).name, "Superclass must be a class.");
+  }
+  std::any placeholder = (void*) nullptr;
+  if (stmt.cell)
+    placeholder = Environment::cell(placeholder);
+  environment->define(stmt.name.lexeme, placeholder);
+
+  std::shared_ptr<Environment> enclosing = globals;
+  if (superclass != nullptr) {
+    enclosing = Environment::create(globals);
+    enclosing->define(StringTable::superName(), std::shared_ptr<LoxCallable>(superclass));
+  }
+
+  LoxClass::Methods methods;
+  for (std::shared_ptr<Function> &method : stmt.methods) {
+    methods[method->name.lexeme.get()] = std::allocate_shared<LoxFunction>(
+      CountingAllocator<LoxFunction, MemoryCategory::Closure> {}, method, closureFor(*method, enclosing, *environment),
+      method->name.lexeme == StringTable::initName());
+  }
+  std::shared_ptr<LoxCallable> klass = std::make_shared<LoxClass>(stmt.name.lexeme, superclass, std::move(methods));
+  environment->assign(stmt.name, klass);
   return nullptr;
 }
 
@@ -133,14 +510,99 @@ std::any Interpreter::visitIfStmt(If &stmt) {
 }
 
 std::any Interpreter::visitWhileStmt(While &stmt) {
-  while (isTruthy(evaluate(stmt.condition)))
+  bool tryJit = jit != nullptr;
+  while (true) {
+    if (tryJit && jit->hotLoop(stmt)) {
+      if (jit->runLoop(stmt, environment))
+        break;
+      // bailed out; finish this run of the loop here
+      tryJit = false;
+    }
+    if (!isTruthy(evaluate(stmt.condition)))
+      break;
     execute(stmt.body);
+  }
   return nullptr;
 }
 
+std::any Interpreter::visitForStmt(For &stmt) {
+  if (stmt.initializer == nullptr) {
+    loop(stmt);
+    return nullptr;
+  }
+  std::shared_ptr<Environment> previous = environment;
+  environment = Environment::create(previous);
+  try {
+    execute(stmt.initializer);
+    loop(stmt);
+  } catch (...) {
+    environment = previous;
+    throw;
+  }
+  environment = previous;
+  return nullptr;
+}
+
+void Interpreter::loop(For &stmt) {
+  // compiled loops and execution counts need every step to go through the
+  // general path
+  if (stmt.counted && jit == nullptr && stats == nullptr && countedLoop(stmt))
+    return;
+  bool tryJit = jit != nullptr;
+  while (true) {
+    if (tryJit && jit->hotLoop(stmt)) {
+      if (jit->runLoop(stmt, environment))
+        break;
+      tryJit = false;
+    }
+    if (!isTruthy(evaluate(stmt.condition)))
+      break;
+    execute(stmt.body);
+    if (stmt.increment != nullptr)
+      evaluate(stmt.increment);
+  }
+}
+
+bool Interpreter::countedLoop(For &stmt) {
+  std::any *counter = environment->slot(static_cast<Var&>(*stmt.initializer).name.lexeme);
+  if (counter == nullptr || !isNumber(*counter))
+    return false;
+  Binary &test = static_cast<Binary&>(*stmt.condition);
+  std::any step = boxNumber(stmt.step);
+  while (true) {
+    std::any bound = evaluate(test.right);
+    std::partial_ordering order = compareNumberOperands(test.op, *counter, bound);
+    bool inside;
+    switch (test.op.type) {
+      case TokenType::GREATER:
+        inside = order > 0;
+        break;
+      case TokenType::GREATER_EQUAL:
+        inside = order >= 0;
+        break;
+      case TokenType::LESS:
+        inside = order < 0;
+        break;
+      default:
+        inside = order <= 0;
+        break;
+    }
+    if (!inside)
+      return true;
+    execute(stmt.body);
+    // TypeInference proved the increment yields a number, so the body
+    // must have left one here
+    *counter = addNumbers(*counter, step);
+  }
+}
+
 std::any Interpreter::visitPrintStmt(Print &stmt) {
   std::any val = evaluate(stmt.expr);
-  std::cout << stringify(val) << std::endl;
+  // skip the copy stringify would make of a long string
+  if (val.type() == typeid(StringRef))
+    std::cout << std::any_cast<StringRef&>(val)->str() << std::endl;
+  else
+    std::cout << stringify(val) << std::endl;
   return nullptr;
 }
 
@@ -160,28 +622,34 @@ std::any Interpreter::visitVarStmt(Var &stmt) {
   std::any val = (void*) nullptr;
   if (stmt.initializer != nullptr)
     val = evaluate(stmt.initializer);
+  if (stmt.cell)
+    val = Environment::cell(val);
   environment->define(stmt.name.lexeme, val);
   return nullptr;
 }
 
 std::any Interpreter::visitBlockStmt(Block &stmt) {
-  executeBlock(stmt.statements, std::make_shared<Environment>(Environment(environment)));
+  executeBlock(stmt.statements, Environment::create(environment));
   return nullptr;
 }
 
 std::any Interpreter::visitReturnStmt(Return &stmt) {
-  std::any value{ nullptr };
-  if (value.type() != typeid(void*))
+  std::any value{ (void*) nullptr };
+  if (stmt.value != nullptr)
     value = evaluate(stmt.value);
   
   throw ReturnException(value);
 }
 
 void Interpreter::interpret(std::vector<std::shared_ptr<Stmt>> &statements) {
+  if (engine != nullptr) {
+    engine->interpret(statements);
+    return;
+  }
   try {
     for (std::shared_ptr<Stmt> &stmt : statements)
       execute(stmt);
-  } catch (RuntimeError error) {
+  } catch (const RuntimeError &error) {
     runtimeError(error);
   }
 }
@@ -203,9 +671,65 @@ void Interpreter::executeBlock(std::vector<std::shared_ptr<Stmt>> &statements, s
   this->environment = previous;
 }
 std::any Interpreter::evaluate(std::shared_ptr<Expr> &expr) {
+  if (stats != nullptr)
+    stats->count(expr);
   return expr->accept(*this);
 }
-bool Interpreter::isTruthy(std::any value) {
+double Interpreter::number(std::shared_ptr<Expr> &expr) {
+  if (stats != nullptr)
+    stats->count(expr);
+  switch (expr->numeric) {
+    case NumericForm::Literal:
+      return unboxNumber(static_cast<Literal&>(*expr).value);
+    case NumericForm::Variable: {
+      Variable &variable = static_cast<Variable&>(*expr);
+      if (stats != nullptr)
+        stats->countGet(environment->depthOf(variable.name.lexeme));
+      return unboxNumber(environment->get(variable.name));
+    }
+    case NumericForm::Grouping:
+      return number(static_cast<Grouping&>(*expr).expr);
+    case NumericForm::Negate:
+      return -number(static_cast<Unary&>(*expr).right);
+    case NumericForm::Arithmetic:
+      return arithmetic(static_cast<Binary&>(*expr));
+    default:
+      return unboxNumber(expr->accept(*this));
+  }
+}
+double Interpreter::arithmetic(Binary &expr) {
+  double left = number(expr.left);
+  double right = number(expr.right);
+  switch (expr.op.type) {
+    case TokenType::PLUS:
+      return checked(left + right);
+    case TokenType::MINUS:
+      return checked(left - right);
+    case TokenType::STAR:
+      return checked(left * right);
+    default:
+      if (right == 0)
+        throw RuntimeError(expr.op, "Division by 0 not supported.");
+      return checked(left / right);
+  }
+}
+bool Interpreter::compare(TokenType op, double left, double right) {
+  switch (op) {
+    case TokenType::GREATER:
+      return left > right;
+    case TokenType::GREATER_EQUAL:
+      return left >= right;
+    case TokenType::LESS:
+      return left < right;
+    case TokenType::LESS_EQUAL:
+      return left <= right;
+    case TokenType::BANG_EQUAL:
+      return left != right;
+    default:
+      return left == right;
+  }
+}
+bool Interpreter::isTruthy(const std::any &value) {
   if (value.type() == typeid(void*))
     return false;
   if (value.type() == typeid(bool))
@@ -213,58 +737,108 @@ bool Interpreter::isTruthy(std::any value) {
   return true;
 }
 bool Interpreter::isEqual(std::any a, std::any b) {
+  if (isNumber(a) && isNumber(b))
+    return compareNumbers(a, b) == 0;
   if (a.type() != b.type())
     return false;
-  if (a.type() == typeid(double))
-    return std::any_cast<double>(a) == std::any_cast<double>(b);
-  if (a.type() == typeid(int))
-    return std::any_cast<int>(a) == std::any_cast<int>(b);
-  if (a.type() == typeid(std::string))
-    return std::any_cast<std::string>(a) == std::any_cast<std::string>(b);
+  if (a.type() == typeid(StringRef))
+    return std::any_cast<StringRef&>(a)->equals(*std::any_cast<StringRef&>(b));
+  if (a.type() == typeid(bool))
+    return std::any_cast<bool>(a) == std::any_cast<bool>(b);
   if (a.type() == typeid(void*))
     return true;
+  if (a.type() == typeid(std::shared_ptr<LoxCallable>))
+    return std::any_cast<std::shared_ptr<LoxCallable>&>(a) == std::any_cast<std::shared_ptr<LoxCallable>&>(b);
+  if (a.type() == typeid(ArrayRef))
+    return std::any_cast<ArrayRef&>(a) == std::any_cast<ArrayRef&>(b);
+  if (a.type() == typeid(MapRef))
+    return std::any_cast<MapRef&>(a) == std::any_cast<MapRef&>(b);
+  if (a.type() == typeid(std::shared_ptr<LoxInstance>))
+    return std::any_cast<std::shared_ptr<LoxInstance>&>(a) == std::any_cast<std::shared_ptr<LoxInstance>&>(b);
   return false;
 }
-void Interpreter::checkNumberOperand(Token op, std::any operand) {
-  if (operand.type() == typeid(double))
+void Interpreter::checkNumberOperand(const Token &op, const std::any &operand) {
+  if (isNumber(operand))
     return;
   throw RuntimeError(op, "Operand must be a number.");
 }
-void Interpreter::checkNumberOperand(Token op, std::any operand1, std::any operand2) {
-  if (operand1.type() == typeid(double) && operand2.type() == typeid(double))
+void Interpreter::checkNumberOperand(const Token &op, const std::any &operand1, const std::any &operand2) {
+  if (isNumber(operand1) && isNumber(operand2))
     return;
   throw RuntimeError(op, "Operands must be numbers.");
 }
+std::partial_ordering Interpreter::compareNumberOperands(const Token &op, const std::any &left, const std::any &right) {
+  std::partial_ordering order = compareNumbers(left, right);
+  // NaN is a number, and unordered too
+  if (order == std::partial_ordering::unordered)
+    checkNumberOperand(op, left, right);
+  return order;
+}
 std::string Interpreter::stringify(std::any value) {
   if (value.type() == typeid(void*))
     return "nil";
-  if (value.type() == typeid(double)) {
-    double num = std::any_cast<double>(value);
-    std::ostringstream oss;
-    if (num == std::floor(num))
-      oss << std::defaultfloat << num;
-    else
-      oss << num;
-    return oss.str();
-  }
-  if (value.type() == typeid(std::string)) {
-    return std::any_cast<std::string>(value);
-  }
-  if (value.type() == typeid(int)) {
-    return std::to_string(std::any_cast<int>(value));
+  if (isNumber(value))
+    return formatNumber(value);
+  if (value.type() == typeid(StringRef)) {
+    return std::any_cast<StringRef&>(value)->str();
   }
   if (value.type() == typeid(bool)) {
     return std::any_cast<bool>(value) ? "true" : "false";
   }
-  if (value.type() == typeid(LoxFunction)) {
+  if (value.type() == typeid(ArrayRef)) {
+    LoxArray &array = *std::any_cast<ArrayRef&>(value);
+    if (array.printing)
+      return "[...]";
+    array.printing = true;
+    std::string result = "[";
+    for (size_t i = 0; i < array.size(); ++i) {
+      if (i > 0)
+        result += ", ";
+      result += stringify(array.get(i));
+    }
+    array.printing = false;
+    return result + "]";
+  }
+  if (value.type() == typeid(MapRef)) {
+    LoxMap &map = *std::any_cast<MapRef&>(value);
+    if (map.printing)
+      return "{...}";
+    map.printing = true;
+    std::string result = "{";
+    bool first = true;
+    for (const LoxMap::Entry &entry : map.entries()) {
+      if (!entry.live)
+        continue;
+      if (!first)
+        result += ", ";
+      result += stringify(entry.key) + ": " + stringify(entry.value);
+      first = false;
+    }
+    map.printing = false;
+    return result + "}";
+  }
+  if (value.type() == typeid(std::shared_ptr<LoxInstance>))
+    return std::any_cast<std::shared_ptr<LoxInstance>&>(value)->klass->name->str() + " instance";
+  if (value.type() == typeid(std::shared_ptr<LoxCallable>)) {
+    LoxCallable *callable = std::any_cast<std::shared_ptr<LoxCallable>&>(value).get();
+    if (LoxClass *klass = dynamic_cast<LoxClass*>(callable))
+      return klass->name->str();
     std::ostringstream oss;
-    LoxFunction func = std::any_cast<LoxFunction>(value);
-    oss << func;
+    if (LoxFunction *function = dynamic_cast<LoxFunction*>(callable))
+      oss << *function;
+    else if (LoxFile *file = dynamic_cast<LoxFile*>(callable))
+      oss << "<file " << file->name << ">";
+    else if (LoxForeign *foreign = dynamic_cast<LoxForeign*>(callable))
+      oss << "<foreign fn " << foreign->name << ">";
+    else
+      oss << "<native fn " << static_cast<LoxNative*>(callable)->name << ">";
     return oss.str();
   }
   return "nil";
 }
 void Interpreter::execute(std::shared_ptr<Stmt> &stmt) {
+  if (stats != nullptr)
+    stats->count(stmt);
   stmt->accept(*this);
 }
 
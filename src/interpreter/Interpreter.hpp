@@ -3,33 +3,56 @@
 #include "Stmt.hpp"
 #include "Environment.hpp"
 #include <any>
+#include <compare>
 #include <vector>
 #include <memory>
 
+class Profiler;
+class ExecutionStats;
+class Jit;
+class ClosureEngine;
+class LoxArray;
+
 class Interpreter : public ExprVisitor, public StmtVisitor {
 public:
-  std::shared_ptr<Environment> globals { std::make_shared<Environment>() };
+  std::shared_ptr<Environment> globals { Environment::create() };
+  Profiler *profiler { nullptr };
+  ExecutionStats *stats { nullptr };
+  Jit *jit { nullptr };
+  // runs programs instead of this tree walker when set
+  ClosureEngine *engine { nullptr };
 private:
   std::shared_ptr<Environment> environment { globals };
+  // the globals are keyed by bare pointer, so the names of the natives are
+  // held here for StringTable::collect() to leave alone
+  std::vector<StringRef> nativeNames;
 public:
-  Interpreter() {
-    // globals.define("clock", ClockBuiltIn
-  };
+  Interpreter();
 
   std::any visitLiteralExpr(Literal &expr) override;
   std::any visitGroupingExpr(Grouping &expr) override;
   std::any visitUnaryExpr(Unary &expr) override;
   std::any visitBinaryExpr(Binary &expr) override;
   std::any visitCallExpr(Call &expr) override;
+  std::any visitGetExpr(Get &expr) override;
+  std::any visitSetExpr(Set &expr) override;
+  std::any visitThisExpr(This &expr) override;
+  std::any visitSuperExpr(Super &expr) override;
+  std::any visitArrayLiteralExpr(ArrayLiteral &expr) override;
+  std::any visitMapLiteralExpr(MapLiteral &expr) override;
+  std::any visitIndexExpr(Index &expr) override;
+  std::any visitIndexSetExpr(IndexSet &expr) override;
   std::any visitVariableExpr(Variable &expr) override;
   std::any visitAssignExpr(Assign &expr) override;
   std::any visitExpressionStmt(Expression &stmt) override;
   std::any visitIfStmt(If &stmt) override;
   std::any visitWhileStmt(While &stmt) override;
+  std::any visitForStmt(For &stmt) override;
   std::any visitPrintStmt(Print &stmt) override;
   std::any visitLogicalExpr(Logical &expr) override;
   std::any visitVarStmt(Var &stmt) override;
   std::any visitFunctionStmt(Function &stmt) override;
+  std::any visitClassStmt(Class &stmt) override;
   std::any visitBlockStmt(Block &stmt) override;
   std::any visitReturnStmt(Return &stmt) override;
 
@@ -37,10 +60,29 @@ public:
   void executeBlock(std::vector<std::shared_ptr<Stmt>> &statements, std::shared_ptr<Environment> environment);
 
   std::any evaluate(std::shared_ptr<Expr> &expr);
-  bool isTruthy(std::any value);
+  // unboxed evaluation of an expression TypeInference proved numeric; NaN
+  // if a number on the way is too big to be exact as a double
+  double number(std::shared_ptr<Expr> &expr);
+  double arithmetic(Binary &expr);
+  static bool compare(TokenType op, double left, double right);
+  static bool isTruthy(const std::any &value);
   bool isEqual(std::any a, std::any b);
-  void checkNumberOperand(Token op, std::any operand);
-  void checkNumberOperand(Token op, std::any operand1, std::any operand2);
+  void checkNumberOperand(const Token &op, const std::any &operand);
+  void checkNumberOperand(const Token &op, const std::any &operand1, const std::any &operand2);
+  // compareNumbers, throwing when an operand is not a number
+  std::partial_ordering compareNumberOperands(const Token &op, const std::any &left, const std::any &right);
+  // checks that an index names an element of the array
+  size_t arrayIndex(const Token &bracket, const LoxArray &array, const std::any &index);
   std::string stringify(std::any value);
   void execute(std::shared_ptr<Stmt> &stmt);
+  // the environment a function declared in `from` closes over: just the
+  // variables it captures, in front of `enclosing`
+  static std::shared_ptr<Environment> closureFor(const Function &declaration, std::shared_ptr<Environment> &enclosing,
+    Environment &from);
+private:
+  // the iterations of a for loop after its initializer
+  void loop(For &stmt);
+  // runs a loop TypeInference marked counted with the counter updated in
+  // place, or returns false if the counter does not start out a number
+  bool countedLoop(For &stmt);
 };
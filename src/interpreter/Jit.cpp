@@ -0,0 +1,798 @@
+#include <any>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Expr.hpp"
+#include "Interpreter.hpp"
+#include "Jit.hpp"
+#include "LoxFunction.hpp"
+#include "Number.hpp"
+#include "RuntimeError.hpp"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define LOX_JIT 1
+#include <sys/mman.h>
+#endif
+
+// Passed to compiled code in rbx. Compiled functions count their native
+// recursion depth here and bail out instead of overflowing the stack.
+struct JitContext {
+  Interpreter *interpreter;
+  int32_t depth;
+  int32_t maxDepth;
+};
+
+// A variable a compiled loop reads or writes that lives in an Environment.
+// Its value is copied in on entry and written back on exit.
+struct OuterVariable {
+  Token name;
+  // read before it is written in some iteration, or only written on some
+  // paths, so the entry value has to be a number
+  bool guarded;
+  bool assigned;
+};
+
+struct CompiledCode {
+  void *memory { nullptr };
+  size_t size { 0 };
+  std::vector<OuterVariable> outers;
+  bool selfCalls { false };
+
+  ~CompiledCode() {
+#ifdef LOX_JIT
+    if (memory != nullptr)
+      munmap(memory, size);
+#endif
+  }
+};
+
+namespace {
+  constexpr int32_t maxNativeDepth = 20000;
+
+  using FunctionEntry = int (*)(double *arguments, JitContext *context, double *result);
+  using LoopEntry = int (*)(double *variables, JitContext *context);
+
+  void printNumber(JitContext *context, double value) {
+    std::cout << context->interpreter->stringify(boxNumber(value)) << std::endl;
+  }
+}
+
+#ifdef LOX_JIT
+namespace {
+  // condition codes for jcc
+  constexpr uint8_t JB = 0x2, JAE = 0x3, JE = 0x4, JNE = 0x5, JBE = 0x6, JA = 0x7, JP = 0xA, JG = 0xF;
+
+  // rbp addresses the native frame, r12 the caller-provided array holding
+  // function arguments or a loop's outer variables
+  enum class Base { Rbp, R12 };
+
+  class Assembler {
+  public:
+    using Label = size_t;
+    std::vector<uint8_t> code;
+
+    Label label() {
+      labels.push_back(-1);
+      return labels.size() - 1;
+    }
+    void bind(Label label) { labels[label] = code.size(); }
+
+    void emit(std::initializer_list<uint8_t> bytes) { code.insert(code.end(), bytes); }
+    void imm32(uint32_t value) {
+      for (int i = 0; i < 4; ++i)
+        code.push_back(value >> (8 * i));
+    }
+    void imm64(uint64_t value) {
+      for (int i = 0; i < 8; ++i)
+        code.push_back(value >> (8 * i));
+    }
+    void patch32(size_t at, uint32_t value) { std::memcpy(&code[at], &value, 4); }
+
+    // movsd xmm, [base + disp] and movsd [base + disp], xmm
+    void load(int xmm, Base base, int32_t disp) { memoryOp(0x10, xmm, base, disp); }
+    void store(Base base, int32_t disp, int xmm) { memoryOp(0x11, xmm, base, disp); }
+    // addsd 0x58, mulsd 0x59, subsd 0x5C, divsd 0x5E on xmm0, xmm1
+    void arith(uint8_t opcode) { emit({ 0xF2, 0x0F, opcode, 0xC1 }); }
+    void move(int dst, int src) { emit({ 0xF2, 0x0F, 0x10, modrm(dst, src) }); }
+    void ucomisd(int a, int b) { emit({ 0x66, 0x0F, 0x2E, modrm(a, b) }); }
+    void xorpd(int dst, int src) { emit({ 0x66, 0x0F, 0x57, modrm(dst, src) }); }
+    void andpd(int dst, int src) { emit({ 0x66, 0x0F, 0x54, modrm(dst, src) }); }
+    void constant(int xmm, double value) {
+      uint64_t pattern;
+      std::memcpy(&pattern, &value, sizeof pattern);
+      bits(xmm, pattern);
+    }
+    void bits(int xmm, uint64_t pattern) {
+      emit({ 0x48, 0xB8 }); // mov rax, imm64
+      imm64(pattern);
+      emit({ 0x66, 0x48, 0x0F, 0x6E, modrm(xmm, 0) }); // movq xmm, rax
+    }
+
+    void jmp(Label target) {
+      code.push_back(0xE9);
+      fixup(target);
+    }
+    void jcc(uint8_t condition, Label target) {
+      emit({ 0x0F, static_cast<uint8_t>(0x80 | condition) });
+      fixup(target);
+    }
+    void call(Label target) {
+      code.push_back(0xE8);
+      fixup(target);
+    }
+    void callAbsolute(const void *function) {
+      emit({ 0x48, 0xB8 }); // mov rax, imm64
+      imm64(reinterpret_cast<uint64_t>(function));
+      emit({ 0xFF, 0xD0 }); // call rax
+    }
+
+    void finish() {
+      for (auto [at, target] : fixups)
+        patch32(at, static_cast<uint32_t>(labels[target] - static_cast<int64_t>(at + 4)));
+    }
+
+  private:
+    std::vector<int64_t> labels;
+    std::vector<std::pair<size_t, Label>> fixups;
+
+    static uint8_t modrm(int reg, int rm) { return 0xC0 | (reg << 3) | rm; }
+    void fixup(Label target) {
+      fixups.push_back({ code.size(), target });
+      imm32(0);
+    }
+    void memoryOp(uint8_t opcode, int xmm, Base base, int32_t disp) {
+      code.push_back(0xF2);
+      if (base == Base::R12)
+        code.push_back(0x41);
+      emit({ 0x0F, opcode });
+      code.push_back(0x80 | (xmm << 3) | (base == Base::R12 ? 4 : 5));
+      if (base == Base::R12)
+        code.push_back(0x24);
+      imm32(disp);
+    }
+  };
+
+  struct Unsupported {};
+
+  struct Slot {
+    Base base;
+    int index;
+  };
+
+  // Compiles one function or loop, throwing Unsupported as soon as it meets
+  // anything that is not provably numeric. Expressions leave their value in
+  // xmm0; intermediate values are spilled to frame slots.
+  class Compiler : public ExprVisitor, public StmtVisitor {
+    Assembler as;
+    const Function *self { nullptr };
+    std::vector<std::unordered_map<const LoxString*, Slot>> scopes;
+    std::vector<OuterVariable> outers;
+    std::vector<bool> assigned; // outer variables definitely written in this iteration
+    int slotTop { 0 };
+    int maxSlots { 0 };
+    bool hasPrint { false };
+    bool hasBailout { false };
+    bool selfCalls { false };
+    size_t frameSizeAt { 0 };
+    Assembler::Label body { as.label() };
+    Assembler::Label bailout { as.label() };
+    Assembler::Label epilogue { as.label() };
+
+  public:
+    static std::unique_ptr<CompiledCode> function(const Function &declaration) {
+      Compiler compiler;
+      try {
+        return compiler.compileFunction(declaration);
+      } catch (Unsupported &) {
+        return nullptr;
+      }
+    }
+    static std::unique_ptr<CompiledCode> loop(Stmt &loop) {
+      Compiler compiler;
+      try {
+        if (While *whileLoop = dynamic_cast<While*>(&loop))
+          return compiler.compileLoop(*whileLoop->condition, whileLoop->body, nullptr);
+        For &forLoop = static_cast<For&>(loop);
+        return compiler.compileLoop(*forLoop.condition, forLoop.body, forLoop.increment.get());
+      } catch (Unsupported &) {
+        return nullptr;
+      }
+    }
+
+  private:
+    static int32_t frameDisp(int slot) { return -24 - 8 * slot; }
+    static int32_t disp(Slot slot) { return slot.base == Base::Rbp ? frameDisp(slot.index) : 8 * slot.index; }
+
+    int allocate(int count = 1) {
+      int slot = slotTop;
+      slotTop += count;
+      if (slotTop > maxSlots)
+        maxSlots = slotTop;
+      return slot;
+    }
+
+    std::unique_ptr<CompiledCode> compileFunction(const Function &declaration) {
+      self = &declaration;
+      // C++ entry: int entry(double *arguments, JitContext *context, double *result)
+      as.emit({ 0x55, 0x48, 0x89, 0xE5 });       // push rbp; mov rbp, rsp
+      as.emit({ 0x52, 0x48, 0x83, 0xEC, 0x08 }); // push rdx; sub rsp, 8
+      as.call(body);
+      as.emit({ 0x48, 0x8B, 0x55, 0xF8 });       // mov rdx, [rbp - 8]
+      as.emit({ 0xF2, 0x0F, 0x11, 0x02 });       // movsd [rdx], xmm0
+      as.emit({ 0x48, 0x89, 0xEC, 0x5D, 0xC3 }); // mov rsp, rbp; pop rbp; ret
+
+      prologue();
+      scopes.emplace_back();
+      for (size_t i = 0; i < declaration.params.size(); ++i)
+        scopes.back()[declaration.params[i].lexeme.get()] = Slot { Base::R12, static_cast<int>(i) };
+      for (const std::shared_ptr<Stmt> &stmt : declaration.body)
+        compile(stmt);
+      // falling off the end returns nil
+      hasBailout = true;
+      as.jmp(bailout);
+      return finish();
+    }
+
+    // the loop from its condition on; a for loop's initializer has run
+    std::unique_ptr<CompiledCode> compileLoop(Expr &test, const std::shared_ptr<Stmt> &body, Expr *increment) {
+      // C++ entry: int entry(double *variables, JitContext *context)
+      prologue();
+      Assembler::Label head = as.label(), exit = as.label();
+      as.bind(head);
+      condition(test, exit, false);
+      compile(body);
+      if (increment != nullptr)
+        increment->accept(*this);
+
+      // Commit the iteration: the interpreter resumes from these copies if
+      // a later iteration bails out.
+      int count = outers.size();
+      for (int i = 0; i < count; ++i) {
+        if (!outers[i].assigned)
+          continue;
+        if (!assigned[i])
+          outers[i].guarded = true;
+        as.load(0, Base::R12, 8 * i);
+        as.store(Base::R12, 8 * (count + i), 0);
+      }
+      as.emit({ 0x49, 0x83, 0x84, 0x24 }); // add qword [r12 + disp32], 1
+      as.imm32(8 * 2 * count);
+      as.emit({ 0x01 });
+      as.jmp(head);
+
+      as.bind(exit);
+      as.emit({ 0x31, 0xC0 }); // xor eax, eax
+      as.jmp(epilogue);
+      return finish();
+    }
+
+    void prologue() {
+      as.bind(body);
+      as.emit({ 0x55, 0x48, 0x89, 0xE5 }); // push rbp; mov rbp, rsp
+      as.emit({ 0x53, 0x41, 0x54 });       // push rbx; push r12
+      as.emit({ 0x48, 0x81, 0xEC });       // sub rsp, imm32
+      frameSizeAt = as.code.size();
+      as.imm32(0);
+      as.emit({ 0x48, 0x89, 0xF3 });       // mov rbx, rsi
+      as.emit({ 0x49, 0x89, 0xFC });       // mov r12, rdi
+
+      uint8_t depth = offsetof(JitContext, depth), maxDepth = offsetof(JitContext, maxDepth);
+      as.emit({ 0x83, 0x43, depth, 0x01 }); // add dword [rbx + depth], 1
+      as.emit({ 0x8B, 0x43, depth });       // mov eax, [rbx + depth]
+      as.emit({ 0x3B, 0x43, maxDepth });    // cmp eax, [rbx + maxDepth]
+      as.jcc(JG, bailout);
+    }
+
+    std::unique_ptr<CompiledCode> finish() {
+      // output that has been printed cannot be taken back
+      if (hasPrint && hasBailout)
+        throw Unsupported();
+
+      as.bind(bailout);
+      as.emit({ 0xB8, 0x01, 0x00, 0x00, 0x00 }); // mov eax, 1
+      as.bind(epilogue);
+      as.emit({ 0x83, 0x6B, static_cast<uint8_t>(offsetof(JitContext, depth)), 0x01 }); // sub dword [rbx + depth], 1
+      as.emit({ 0x48, 0x8D, 0x65, 0xF0 }); // lea rsp, [rbp - 16]
+      as.emit({ 0x41, 0x5C, 0x5B, 0x5D }); // pop r12; pop rbx; pop rbp
+      as.emit({ 0xC3 });
+      as.patch32(frameSizeAt, (8 * maxSlots + 15) & ~15);
+      as.finish();
+
+      auto code = std::make_unique<CompiledCode>();
+      code->size = (as.code.size() + 4095) & ~size_t { 4095 };
+      void *memory = mmap(nullptr, code->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (memory == MAP_FAILED)
+        return nullptr;
+      code->memory = memory;
+      std::memcpy(memory, as.code.data(), as.code.size());
+      if (mprotect(memory, code->size, PROT_READ | PROT_EXEC) != 0)
+        return nullptr;
+      code->outers = std::move(outers);
+      code->selfCalls = selfCalls;
+      return code;
+    }
+
+    void compile(const std::shared_ptr<Stmt> &stmt) {
+      if (stmt == nullptr)
+        throw Unsupported();
+      stmt->accept(*this);
+    }
+    void number(const std::shared_ptr<Expr> &expr) {
+      if (expr == nullptr)
+        throw Unsupported();
+      expr->accept(*this);
+    }
+
+    Slot resolve(const Token &name, bool write) {
+      for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+        auto found = scope->find(name.lexeme.get());
+        if (found != scope->end())
+          return found->second;
+      }
+      // functions may only touch their parameters and locals
+      if (self != nullptr)
+        throw Unsupported();
+
+      size_t index = 0;
+      while (index < outers.size() && outers[index].name.lexeme != name.lexeme)
+        ++index;
+      if (index == outers.size()) {
+        outers.push_back(OuterVariable { name, false, false });
+        assigned.push_back(false);
+      }
+      if (write)
+        outers[index].assigned = true;
+      else if (!assigned[index])
+        outers[index].guarded = true;
+      return Slot { Base::R12, static_cast<int>(index) };
+    }
+
+    // evaluates both operands, leaving left in xmm0 and right in xmm1
+    void operands(Binary &expr) {
+      int temp = allocate();
+      number(expr.left);
+      as.store(Base::Rbp, frameDisp(temp), 0);
+      number(expr.right);
+      as.move(1, 0);
+      as.load(0, Base::Rbp, frameDisp(temp));
+      slotTop--;
+    }
+
+    // jumps to target when the truthiness of expr equals jumpIf
+    void condition(Expr &expr, Assembler::Label target, bool jumpIf) {
+      if (Grouping *grouping = dynamic_cast<Grouping*>(&expr)) {
+        condition(*grouping->expr, target, jumpIf);
+      } else if (Literal *literal = dynamic_cast<Literal*>(&expr)) {
+        bool truthy = true;
+        if (literal->value.type() == typeid(bool))
+          truthy = std::any_cast<bool>(literal->value);
+        else if (literal->value.type() == typeid(void*))
+          truthy = false;
+        if (truthy == jumpIf)
+          as.jmp(target);
+      } else if (Unary *unary = dynamic_cast<Unary*>(&expr); unary != nullptr && unary->op.type == TokenType::BANG) {
+        condition(*unary->right, target, !jumpIf);
+      } else if (Logical *logical = dynamic_cast<Logical*>(&expr)) {
+        bool isOr = logical->op.type == TokenType::OR;
+        if (isOr == jumpIf) {
+          condition(*logical->left, target, jumpIf);
+          condition(*logical->right, target, jumpIf);
+        } else {
+          Assembler::Label skip = as.label();
+          condition(*logical->left, skip, !jumpIf);
+          condition(*logical->right, target, jumpIf);
+          as.bind(skip);
+        }
+      } else if (Binary *binary = dynamic_cast<Binary*>(&expr); binary != nullptr && isComparison(binary->op.type)) {
+        comparison(*binary, target, jumpIf);
+      } else {
+        // numbers are always truthy
+        expr.accept(*this);
+        if (jumpIf)
+          as.jmp(target);
+      }
+    }
+
+    static bool isComparison(TokenType type) {
+      switch (type) {
+        case TokenType::EQUAL_EQUAL:
+        case TokenType::BANG_EQUAL:
+        case TokenType::GREATER:
+        case TokenType::GREATER_EQUAL:
+        case TokenType::LESS:
+        case TokenType::LESS_EQUAL:
+          return true;
+        default:
+          return false;
+      }
+    }
+
+    void comparison(Binary &expr, Assembler::Label target, bool jumpIf) {
+      TokenType type = expr.op.type;
+      if (type == TokenType::EQUAL_EQUAL || type == TokenType::BANG_EQUAL) {
+        operands(expr);
+        as.ucomisd(0, 1);
+        // unordered sets ZF and PF, NaN is never equal
+        if ((type == TokenType::EQUAL_EQUAL) == jumpIf) {
+          Assembler::Label skip = as.label();
+          as.jcc(JP, skip);
+          as.jcc(JE, target);
+          as.bind(skip);
+        } else {
+          as.jcc(JP, target);
+          as.jcc(JNE, target);
+        }
+        return;
+      }
+
+      // a > b and b < a both become "above", which is false when unordered
+      bool swap;
+      bool orEqual;
+      switch (type) {
+        case TokenType::GREATER: swap = false; orEqual = false; break;
+        case TokenType::GREATER_EQUAL: swap = false; orEqual = true; break;
+        case TokenType::LESS: swap = true; orEqual = false; break;
+        default: swap = true; orEqual = true; break;
+      }
+      operands(expr);
+      if (swap)
+        as.ucomisd(1, 0);
+      else
+        as.ucomisd(0, 1);
+      if (jumpIf)
+        as.jcc(orEqual ? JAE : JA, target);
+      else
+        as.jcc(orEqual ? JB : JBE, target);
+    }
+
+    std::vector<bool> padded(std::vector<bool> state) {
+      state.resize(outers.size(), false);
+      return state;
+    }
+
+  public:
+    std::any visitLiteralExpr(Literal &expr) override {
+      if (!isNumber(expr.value) || std::isnan(unboxNumber(expr.value)))
+        throw Unsupported();
+      as.constant(0, unboxNumber(expr.value));
+      return {};
+    }
+    std::any visitGroupingExpr(Grouping &expr) override {
+      number(expr.expr);
+      return {};
+    }
+    std::any visitVariableExpr(Variable &expr) override {
+      Slot slot = resolve(expr.name, false);
+      as.load(0, slot.base, disp(slot));
+      return {};
+    }
+    std::any visitAssignExpr(Assign &expr) override {
+      number(expr.value);
+      Slot slot = resolve(expr.name, true);
+      as.store(slot.base, disp(slot), 0);
+      if (self == nullptr && slot.base == Base::R12)
+        assigned[slot.index] = true;
+      return {};
+    }
+    std::any visitUnaryExpr(Unary &expr) override {
+      if (expr.op.type != TokenType::MINUS)
+        throw Unsupported();
+      number(expr.right);
+      as.constant(1, -0.0);
+      as.xorpd(0, 1);
+      return {};
+    }
+    std::any visitBinaryExpr(Binary &expr) override {
+      uint8_t opcode;
+      switch (expr.op.type) {
+        case TokenType::PLUS: opcode = 0x58; break;
+        case TokenType::MINUS: opcode = 0x5C; break;
+        case TokenType::STAR: opcode = 0x59; break;
+        case TokenType::SLASH: opcode = 0x5E; break;
+        default: throw Unsupported();
+      }
+      operands(expr);
+      if (expr.op.type == TokenType::SLASH) {
+        Literal *divisor = dynamic_cast<Literal*>(expr.right.get());
+        bool nonZero = divisor != nullptr && isNumber(divisor->value) && toDouble(divisor->value) != 0;
+        if (!nonZero) {
+          // the interpreter reports division by zero
+          hasBailout = true;
+          Assembler::Label ok = as.label();
+          as.xorpd(2, 2);
+          as.ucomisd(1, 2);
+          as.jcc(JP, ok);
+          as.jcc(JE, bailout);
+          as.bind(ok);
+        }
+      }
+      as.arith(opcode);
+
+      // results past 2^53 may not be exact, and the interpreter works
+      // them out on integers instead
+      hasBailout = true;
+      as.bits(2, 0x7FFFFFFFFFFFFFFF);
+      as.andpd(2, 0);
+      as.constant(1, exactLimit);
+      // not above |result|, or unordered because it is NaN
+      as.ucomisd(1, 2);
+      as.jcc(JBE, bailout);
+      return {};
+    }
+    std::any visitCallExpr(Call &expr) override {
+      Variable *callee = dynamic_cast<Variable*>(expr.callee.get());
+      if (self == nullptr || callee == nullptr || callee->name.lexeme != self->name.lexeme)
+        throw Unsupported();
+      for (auto &scope : scopes)
+        if (scope.count(callee->name.lexeme.get()))
+          throw Unsupported();
+      if (expr.arguments.size() != self->params.size())
+        throw Unsupported();
+
+      // arguments are laid out in ascending addresses for the callee's r12
+      int count = expr.arguments.size();
+      int base = allocate(count);
+      for (int i = 0; i < count; ++i) {
+        number(expr.arguments[i]);
+        as.store(Base::Rbp, frameDisp(base + count - 1 - i), 0);
+      }
+      as.emit({ 0x48, 0x8D, 0xBD }); // lea rdi, [rbp + disp32]
+      as.imm32(frameDisp(base + count - 1));
+      as.emit({ 0x48, 0x89, 0xDE }); // mov rsi, rbx
+      as.call(body);
+      as.emit({ 0x85, 0xC0 });       // test eax, eax
+      as.jcc(JNE, epilogue);         // propagate the bailout
+      slotTop -= count;
+      hasBailout = true;
+      selfCalls = true;
+      return {};
+    }
+    std::any visitLogicalExpr(Logical &expr) override {
+      throw Unsupported();
+    }
+    std::any visitGetExpr(Get &expr) override {
+      throw Unsupported();
+    }
+    std::any visitSetExpr(Set &expr) override {
+      throw Unsupported();
+    }
+    std::any visitThisExpr(This &expr) override {
+      throw Unsupported();
+    }
+    std::any visitSuperExpr(Super &expr) override {
+      throw Unsupported();
+    }
+    std::any visitArrayLiteralExpr(ArrayLiteral &expr) override {
+      throw Unsupported();
+    }
+    std::any visitMapLiteralExpr(MapLiteral &expr) override {
+      throw Unsupported();
+    }
+    std::any visitIndexExpr(Index &expr) override {
+      throw Unsupported();
+    }
+    std::any visitIndexSetExpr(IndexSet &expr) override {
+      throw Unsupported();
+    }
+
+    std::any visitExpressionStmt(Expression &stmt) override {
+      number(stmt.expr);
+      return {};
+    }
+    std::any visitPrintStmt(Print &stmt) override {
+      number(stmt.expr);
+      as.emit({ 0x48, 0x89, 0xDF }); // mov rdi, rbx
+      as.callAbsolute(reinterpret_cast<const void*>(&printNumber));
+      hasPrint = true;
+      return {};
+    }
+    std::any visitVarStmt(Var &stmt) override {
+      if (stmt.initializer == nullptr || scopes.empty())
+        throw Unsupported();
+      number(stmt.initializer);
+      int slot = allocate();
+      as.store(Base::Rbp, frameDisp(slot), 0);
+      scopes.back()[stmt.name.lexeme.get()] = Slot { Base::Rbp, slot };
+      return {};
+    }
+    std::any visitBlockStmt(Block &stmt) override {
+      scopes.emplace_back();
+      int saved = slotTop;
+      for (const std::shared_ptr<Stmt> &inner : stmt.statements)
+        compile(inner);
+      slotTop = saved;
+      scopes.pop_back();
+      return {};
+    }
+    std::any visitIfStmt(If &stmt) override {
+      Assembler::Label otherwise = as.label(), end = as.label();
+      condition(*stmt.condition, otherwise, false);
+      std::vector<bool> before = assigned;
+      compile(stmt.thenBranch);
+      std::vector<bool> afterThen = padded(assigned);
+      if (stmt.elseBranch != nullptr)
+        as.jmp(end);
+      as.bind(otherwise);
+      assigned = padded(before);
+      if (stmt.elseBranch != nullptr)
+        compile(stmt.elseBranch);
+      assigned = padded(assigned);
+      for (size_t i = 0; i < assigned.size(); ++i)
+        assigned[i] = assigned[i] && afterThen[i];
+      as.bind(end);
+      return {};
+    }
+    std::any visitWhileStmt(While &stmt) override {
+      Assembler::Label head = as.label(), exit = as.label();
+      as.bind(head);
+      condition(*stmt.condition, exit, false);
+      std::vector<bool> before = assigned;
+      compile(stmt.body);
+      // the body may not run at all
+      assigned = padded(before);
+      as.jmp(head);
+      as.bind(exit);
+      return {};
+    }
+    std::any visitForStmt(For &stmt) override {
+      scopes.emplace_back();
+      int saved = slotTop;
+      if (stmt.initializer != nullptr)
+        compile(stmt.initializer);
+      Assembler::Label head = as.label(), exit = as.label();
+      as.bind(head);
+      condition(*stmt.condition, exit, false);
+      std::vector<bool> before = assigned;
+      compile(stmt.body);
+      if (stmt.increment != nullptr)
+        number(stmt.increment);
+      assigned = padded(before);
+      as.jmp(head);
+      as.bind(exit);
+      slotTop = saved;
+      scopes.pop_back();
+      return {};
+    }
+    std::any visitReturnStmt(Return &stmt) override {
+      if (self == nullptr || stmt.value == nullptr)
+        throw Unsupported();
+      number(stmt.value);
+      as.emit({ 0x31, 0xC0 }); // xor eax, eax
+      as.jmp(epilogue);
+      return {};
+    }
+    std::any visitFunctionStmt(Function &stmt) override {
+      throw Unsupported();
+    }
+    std::any visitClassStmt(Class &stmt) override {
+      throw Unsupported();
+    }
+  };
+}
+#endif
+
+Jit::Jit(Interpreter &interpreter, uint32_t callThreshold, uint32_t loopThreshold)
+  : interpreter { interpreter }, callThreshold { callThreshold }, loopThreshold { loopThreshold } {}
+
+Jit::~Jit() = default;
+
+bool Jit::supported() {
+#ifdef LOX_JIT
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool Jit::call(const std::shared_ptr<Function> &declaration, std::shared_ptr<Environment> &closure,
+               std::vector<std::any> &arguments, std::any &result) {
+#ifdef LOX_JIT
+  auto [entry, inserted] = functions.try_emplace(declaration.get());
+  FunctionState &state = entry->second;
+  if (inserted)
+    state.declaration = declaration;
+  if (state.code == nullptr) {
+    if (state.failed || ++state.calls < callThreshold)
+      return false;
+    state.code = Compiler::function(*declaration);
+    if (state.code == nullptr) {
+      state.failed = true;
+      return false;
+    }
+  }
+
+  std::vector<double> numbers(arguments.size());
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    if (!isNumber(arguments[i]))
+      return false;
+    numbers[i] = unboxNumber(arguments[i]);
+    if (std::isnan(numbers[i]))
+      return false;
+  }
+
+  // recursive calls are compiled as direct calls, so the name has to still
+  // refer to this function
+  if (state.code->selfCalls) {
+    std::any self;
+    try {
+      self = closure->get(declaration->name);
+    } catch (RuntimeError &) {
+      return false;
+    }
+    if (self.type() != typeid(std::shared_ptr<LoxCallable>))
+      return false;
+    LoxFunction *function = dynamic_cast<LoxFunction*>(std::any_cast<std::shared_ptr<LoxCallable>>(self).get());
+    if (function == nullptr || function->getDeclaration() != declaration)
+      return false;
+  }
+
+  JitContext context { &interpreter, 0, maxNativeDepth };
+  double value;
+  FunctionEntry function = reinterpret_cast<FunctionEntry>(state.code->memory);
+  if (function(numbers.data(), &context, &value) != 0)
+    return false;
+  result = boxNumber(value);
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool Jit::hotLoop(Stmt &loop) {
+#ifdef LOX_JIT
+  auto [entry, inserted] = loops.try_emplace(&loop);
+  LoopState &state = entry->second;
+  if (inserted)
+    state.loop = loop.shared_from_this();
+  if (state.code != nullptr)
+    return true;
+  if (state.failed || ++state.iterations < loopThreshold)
+    return false;
+  state.code = Compiler::loop(loop);
+  state.failed = state.code == nullptr;
+  return !state.failed;
+#else
+  return false;
+#endif
+}
+
+bool Jit::runLoop(Stmt &loop, std::shared_ptr<Environment> &environment) {
+#ifdef LOX_JIT
+  CompiledCode &code = *loops.at(&loop).code;
+  size_t count = code.outers.size();
+  // working values, committed values, iteration count
+  std::vector<double> memory(2 * count + 1);
+  for (size_t i = 0; i < count; ++i) {
+    std::any value;
+    try {
+      value = environment->get(code.outers[i].name);
+    } catch (RuntimeError &) {
+      return false;
+    }
+    double number = isNumber(value) ? unboxNumber(value) : NAN;
+    if (!std::isnan(number))
+      memory[i] = memory[count + i] = number;
+    else if (code.outers[i].guarded)
+      return false;
+  }
+
+  JitContext context { &interpreter, 0, maxNativeDepth };
+  LoopEntry entry = reinterpret_cast<LoopEntry>(code.memory);
+  int status = entry(memory.data(), &context);
+
+  int64_t iterations;
+  std::memcpy(&iterations, &memory[2 * count], sizeof iterations);
+  for (size_t i = 0; i < count; ++i) {
+    const OuterVariable &outer = code.outers[i];
+    if (outer.assigned && (outer.guarded || iterations > 0))
+      environment->assign(outer.name, boxNumber(memory[count + i]));
+  }
+  return status == 0;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <any>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "Environment.hpp"
+#include "Stmt.hpp"
+
+class Interpreter;
+struct CompiledCode;
+
+// Baseline x86-64 compiler for numeric code. Functions are compiled once
+// they have been called callThreshold times, loops once they have run
+// loopThreshold iterations. Only code that provably works on numbers alone
+// is compiled: parameters, locals and literals combined with arithmetic,
+// comparisons, if/while/for, return, print and calls to the function itself.
+// Argument and variable types are guarded on entry; division by zero, a
+// result too big to be exact in a double and other failures bail out to
+// the interpreter, which re-executes from a state the compiled code has
+// not yet modified.
+class Jit {
+public:
+  Jit(Interpreter &interpreter, uint32_t callThreshold = 100, uint32_t loopThreshold = 1000);
+  ~Jit();
+
+  // true if compiled code ran the call to completion and stored its result
+  bool call(const std::shared_ptr<Function> &declaration, std::shared_ptr<Environment> &closure,
+            std::vector<std::any> &arguments, std::any &result);
+
+  // Called with a While or For before each evaluation of the loop
+  // condition. True once the loop is compiled (compiling it when it has
+  // become hot) and should be entered.
+  bool hotLoop(Stmt &loop);
+  // true if compiled code ran the remaining iterations; on false the
+  // interpreter continues from the loop condition
+  bool runLoop(Stmt &loop, std::shared_ptr<Environment> &environment);
+
+  static bool supported();
+
+private:
+  struct FunctionState {
+    std::shared_ptr<Function> declaration;
+    uint32_t calls { 0 };
+    bool failed { false };
+    std::unique_ptr<CompiledCode> code;
+  };
+  struct LoopState {
+    std::shared_ptr<Stmt> loop;
+    uint32_t iterations { 0 };
+    bool failed { false };
+    std::unique_ptr<CompiledCode> code;
+  };
+
+  Interpreter &interpreter;
+  uint32_t callThreshold;
+  uint32_t loopThreshold;
+  std::unordered_map<const Function*, FunctionState> functions;
+  std::unordered_map<const Stmt*, LoopState> loops;
+};
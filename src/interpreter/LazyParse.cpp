@@ -0,0 +1,20 @@
+#include "LazyParse.hpp"
+#include "Resolver.hpp"
+#include "TypeInference.hpp"
+
+bool ensureResolved(Function &function, Diagnostics &diagnostics) {
+  if (!function.deferred)
+    return true;
+  function.deferred = false;
+
+  std::vector<std::shared_ptr<Stmt>> statements { function.shared_from_this() };
+  Resolver resolver { diagnostics };
+  resolver.resolve(statements);
+  if (diagnostics.hasErrors()) {
+    // left as it was, so the next call reports the errors again
+    function.deferred = true;
+    return false;
+  }
+  TypeInference { resolver }.analyze(statements);
+  return true;
+}
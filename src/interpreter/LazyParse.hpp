@@ -0,0 +1,11 @@
+#pragma once
+#include "Diagnostics.hpp"
+#include "Stmt.hpp"
+
+// Finishes a function whose body a preparsing Parser left deferred:
+// resolves and analyzes it as the whole-script passes would have. Only
+// top-level functions and methods are deferred, and those capture nothing,
+// so they can be resolved on their own. Does nothing for a body that is
+// not deferred; returns false, with the errors in `diagnostics` and the
+// function left deferred, if it does not resolve.
+bool ensureResolved(Function &function, Diagnostics &diagnostics);
@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "LoxArray.hpp"
+#include "Number.hpp"
+
+namespace {
+  // integers past 2^53 are the only numbers a double would not hold exactly
+  bool packable(const std::any &value, double &number) {
+    if (value.type() == typeid(double)) {
+      number = std::any_cast<double>(value);
+      return true;
+    }
+    if (value.type() != typeid(int64_t))
+      return false;
+    number = unboxNumber(value);
+    return !std::isnan(number);
+  }
+
+  // Kernels are written against GCC/Clang vector extensions, which lower
+  // to whatever SIMD the target has (two SSE2 registers per vector on
+  // baseline x86-64, one AVX register with -mavx). Elsewhere only the
+  // scalar tail loops remain.
+#if defined(__GNUC__) || defined(__clang__)
+#define LOX_VECTOR_EXTENSIONS
+  // these helpers never leave this file, so how a vector is passed without
+  // AVX is no ABI anyone else depends on
+#if !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+  typedef double Lanes __attribute__((vector_size(32)));
+  constexpr size_t laneCount = sizeof(Lanes) / sizeof(double);
+
+  // the buffers are only aligned for double
+  Lanes load(const double *data) {
+    Lanes lanes;
+    std::memcpy(&lanes, data, sizeof lanes);
+    return lanes;
+  }
+  void store(double *data, Lanes lanes) {
+    std::memcpy(data, &lanes, sizeof lanes);
+  }
+  Lanes broadcast(double value) {
+    return Lanes {} + value;
+  }
+  double total(Lanes lanes) {
+    double result = 0;
+    for (size_t i = 0; i < laneCount; ++i)
+      result += lanes[i];
+    return result;
+  }
+#endif
+
+  double sum(const double *data, size_t count) {
+    size_t i = 0;
+    double result = 0;
+#ifdef LOX_VECTOR_EXTENSIONS
+    // two accumulators hide the latency of the adds
+    Lanes a {}, b {};
+    for (; i + 2 * laneCount <= count; i += 2 * laneCount) {
+      a += load(data + i);
+      b += load(data + i + laneCount);
+    }
+    result = total(a + b);
+#endif
+    for (; i < count; ++i)
+      result += data[i];
+    return result;
+  }
+
+  double dot(const double *left, const double *right, size_t count) {
+    size_t i = 0;
+    double result = 0;
+#ifdef LOX_VECTOR_EXTENSIONS
+    Lanes a {}, b {};
+    for (; i + 2 * laneCount <= count; i += 2 * laneCount) {
+      a += load(left + i) * load(right + i);
+      b += load(left + i + laneCount) * load(right + i + laneCount);
+    }
+    result = total(a + b);
+#endif
+    for (; i < count; ++i)
+      result += left[i] * right[i];
+    return result;
+  }
+
+  void scale(double *out, const double *data, size_t count, double factor) {
+    size_t i = 0;
+#ifdef LOX_VECTOR_EXTENSIONS
+    Lanes factors = broadcast(factor);
+    for (; i + laneCount <= count; i += laneCount)
+      store(out + i, load(data + i) * factors);
+#endif
+    for (; i < count; ++i)
+      out[i] = data[i] * factor;
+  }
+
+  void add(double *out, const double *data, size_t count, double addend) {
+    size_t i = 0;
+#ifdef LOX_VECTOR_EXTENSIONS
+    Lanes addends = broadcast(addend);
+    for (; i + laneCount <= count; i += laneCount)
+      store(out + i, load(data + i) + addends);
+#endif
+    for (; i < count; ++i)
+      out[i] = data[i] + addend;
+  }
+
+  void add(double *out, const double *left, const double *right, size_t count) {
+    size_t i = 0;
+#ifdef LOX_VECTOR_EXTENSIONS
+    for (; i + laneCount <= count; i += laneCount)
+      store(out + i, load(left + i) + load(right + i));
+#endif
+    for (; i < count; ++i)
+      out[i] = left[i] + right[i];
+  }
+
+  // Starting from +/-infinity and only taking elements that compare
+  // smaller (larger) leaves NaNs out without a separate check.
+  double min(const double *data, size_t count) {
+    size_t i = 0;
+    double result = std::numeric_limits<double>::infinity();
+#ifdef LOX_VECTOR_EXTENSIONS
+    Lanes lanes = broadcast(result);
+    for (; i + laneCount <= count; i += laneCount) {
+      Lanes next = load(data + i);
+      lanes = next < lanes ? next : lanes;
+    }
+    for (size_t lane = 0; lane < laneCount; ++lane)
+      result = lanes[lane] < result ? lanes[lane] : result;
+#endif
+    for (; i < count; ++i)
+      result = data[i] < result ? data[i] : result;
+    return result;
+  }
+
+  double max(const double *data, size_t count) {
+    size_t i = 0;
+    double result = -std::numeric_limits<double>::infinity();
+#ifdef LOX_VECTOR_EXTENSIONS
+    Lanes lanes = broadcast(result);
+    for (; i + laneCount <= count; i += laneCount) {
+      Lanes next = load(data + i);
+      lanes = next > lanes ? next : lanes;
+    }
+    for (size_t lane = 0; lane < laneCount; ++lane)
+      result = lanes[lane] > result ? lanes[lane] : result;
+#endif
+    for (; i < count; ++i)
+      result = data[i] > result ? data[i] : result;
+    return result;
+  }
+}
+
+ArrayRef LoxArray::create() {
+  return std::allocate_shared<LoxArray>(CountingAllocator<LoxArray, MemoryCategory::Object> {});
+}
+
+ArrayRef LoxArray::create(Numbers numbers) {
+  return std::allocate_shared<LoxArray>(CountingAllocator<LoxArray, MemoryCategory::Object> {}, std::move(numbers));
+}
+
+LoxArray::~LoxArray() {
+  for (std::any &value : values)
+    MemoryStats::untrackValue(value);
+}
+
+void LoxArray::unpack() {
+  values.reserve(numbers.capacity());
+  for (double number : numbers)
+    values.push_back(boxNumber(number));
+  packed = false;
+  Numbers {}.swap(numbers);
+}
+
+std::any LoxArray::get(size_t index) const {
+  if (packed)
+    return boxNumber(numbers[index]);
+  return values[index];
+}
+
+void LoxArray::set(size_t index, std::any value) {
+  if (packed) {
+    if (packable(value, numbers[index]))
+      return;
+    unpack();
+  }
+  MemoryStats::trackValue(value);
+  MemoryStats::untrackValue(values[index]);
+  values[index] = std::move(value);
+}
+
+void LoxArray::push(std::any value) {
+  if (packed) {
+    double number;
+    if (packable(value, number)) {
+      numbers.push_back(number);
+      return;
+    }
+    unpack();
+  }
+  MemoryStats::trackValue(value);
+  values.push_back(std::move(value));
+}
+
+std::any LoxArray::pop() {
+  if (size() == 0)
+    return (void*) nullptr;
+  if (packed) {
+    double last = numbers.back();
+    numbers.pop_back();
+    return boxNumber(last);
+  }
+  std::any last = std::move(values.back());
+  values.pop_back();
+  MemoryStats::untrackValue(last);
+  return last;
+}
+
+bool LoxArray::numeric() {
+  if (packed)
+    return true;
+  Numbers repacked;
+  repacked.reserve(values.size());
+  bool fits = true;
+  for (const std::any &value : values) {
+    if (!isNumber(value))
+      return false;
+    double number;
+    if (fits && packable(value, number))
+      repacked.push_back(number);
+    else
+      fits = false;
+  }
+  if (fits) {
+    for (std::any &value : values)
+      MemoryStats::untrackValue(value);
+    Values {}.swap(values);
+    numbers = std::move(repacked);
+    packed = true;
+  }
+  return true;
+}
+
+std::any LoxArray::sum() const {
+  if (packed)
+    return boxNumber(::sum(numbers.data(), numbers.size()));
+  std::any total = int64_t { 0 };
+  for (const std::any &value : values)
+    total = addNumbers(total, value);
+  return total;
+}
+
+std::any LoxArray::dot(const LoxArray &other) const {
+  if (packed && other.packed)
+    return boxNumber(::dot(numbers.data(), other.numbers.data(), numbers.size()));
+  std::any total = int64_t { 0 };
+  for (size_t i = 0; i < size(); ++i)
+    total = addNumbers(total, multiplyNumbers(get(i), other.get(i)));
+  return total;
+}
+
+ArrayRef LoxArray::scaled(const std::any &factor) const {
+  if (!packed) {
+    ArrayRef result = create();
+    for (const std::any &value : values)
+      result->push(multiplyNumbers(value, factor));
+    return result;
+  }
+  Numbers result(numbers.size());
+  scale(result.data(), numbers.data(), numbers.size(), toDouble(factor));
+  return create(std::move(result));
+}
+
+ArrayRef LoxArray::added(const std::any &addend) const {
+  if (!packed) {
+    ArrayRef result = create();
+    for (const std::any &value : values)
+      result->push(addNumbers(value, addend));
+    return result;
+  }
+  Numbers result(numbers.size());
+  add(result.data(), numbers.data(), numbers.size(), toDouble(addend));
+  return create(std::move(result));
+}
+
+ArrayRef LoxArray::added(const LoxArray &other) const {
+  if (!packed || !other.packed) {
+    ArrayRef result = create();
+    for (size_t i = 0; i < size(); ++i)
+      result->push(addNumbers(get(i), other.get(i)));
+    return result;
+  }
+  Numbers result(numbers.size());
+  add(result.data(), numbers.data(), other.numbers.data(), numbers.size());
+  return create(std::move(result));
+}
+
+std::any LoxArray::min() const {
+  if (size() == 0)
+    return (void*) nullptr;
+  if (packed)
+    return boxNumber(::min(numbers.data(), numbers.size()));
+  // NaNs compare unordered, so they are never taken
+  std::any result = boxNumber(std::numeric_limits<double>::infinity());
+  for (const std::any &value : values)
+    result = compareNumbers(value, result) < 0 ? value : result;
+  return result;
+}
+
+std::any LoxArray::max() const {
+  if (size() == 0)
+    return (void*) nullptr;
+  if (packed)
+    return boxNumber(::max(numbers.data(), numbers.size()));
+  std::any result = boxNumber(-std::numeric_limits<double>::infinity());
+  for (const std::any &value : values)
+    result = compareNumbers(value, result) > 0 ? value : result;
+  return result;
+}
+
+void LoxArray::sort() {
+  if (!packed) {
+    std::sort(values.begin(), values.end(), [](const std::any &a, const std::any &b) {
+      bool aNan = compareNumbers(a, a) != 0, bNan = compareNumbers(b, b) != 0;
+      return !aNan && (bNan || compareNumbers(a, b) < 0);
+    });
+    return;
+  }
+  // sorting the unboxed buffer is what makes this fast; a comparison sort
+  // does not vectorize the way the reductions do
+  std::sort(numbers.begin(), numbers.end(), [](double a, double b) {
+    return !std::isnan(a) && (std::isnan(b) || a < b);
+  });
+}
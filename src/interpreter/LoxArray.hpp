@@ -0,0 +1,72 @@
+#pragma once
+#include <any>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "MemoryStats.hpp"
+
+class LoxArray;
+using ArrayRef = std::shared_ptr<LoxArray>;
+
+// A growable array value. While every element is a number a double holds
+// exactly (any but an integer past 2^53) the elements are kept unboxed in a
+// packed buffer of doubles, which the bulk operations below run over with
+// SIMD. Storing anything else moves the array to boxed storage, which
+// numeric() moves it back out of once every element fits again.
+class LoxArray {
+public:
+  using Numbers = std::vector<double, CountingAllocator<double, MemoryCategory::Object>>;
+  using Values = std::vector<std::any, CountingAllocator<std::any, MemoryCategory::Object>>;
+
+  // arrays are allocated through here so they show up in MemoryStats
+  static ArrayRef create();
+  static ArrayRef create(Numbers numbers);
+
+  LoxArray() = default;
+  explicit LoxArray(Numbers numbers) : numbers { std::move(numbers) } {}
+  ~LoxArray();
+
+  size_t size() const { return packed ? numbers.size() : values.size(); }
+  bool isPacked() const { return packed; }
+  // the packed buffer; only meaningful while isPacked()
+  const Numbers &elements() const { return numbers; }
+
+  // indexes are checked by the caller
+  std::any get(size_t index) const;
+  void set(size_t index, std::any value);
+  void push(std::any value);
+  // the removed element, or nil if the array is empty
+  std::any pop();
+
+  // true if every element is a number, repacking the array if they all
+  // fit in doubles; the bulk operations below need it to be
+  bool numeric();
+
+  // Bulk operations over arrays of numbers. Over packed arrays they run
+  // with SIMD, and reductions accumulate in several lanes at once, so their
+  // rounding may differ from a left-to-right loop. Over a boxed array (one
+  // holding an integer past 2^53) they go element by element with the exact
+  // arithmetic of the operators.
+  std::any sum() const;
+  // both arrays must have the same size
+  std::any dot(const LoxArray &other) const;
+  ArrayRef scaled(const std::any &factor) const;
+  ArrayRef added(const std::any &addend) const;
+  // both arrays must have the same size
+  ArrayRef added(const LoxArray &other) const;
+  // NaNs are skipped; nil for an empty array
+  std::any min() const;
+  std::any max() const;
+  // ascending, NaNs last
+  void sort();
+
+  // set while the array is being printed, to cut off cycles
+  bool printing { false };
+
+private:
+  bool packed { true };
+  Numbers numbers;
+  Values values;
+
+  void unpack();
+};
@@ -0,0 +1,25 @@
+#include "Interpreter.hpp"
+#include "LoxClass.hpp"
+#include "LoxInstance.hpp"
+#include "StringTable.hpp"
+
+LoxFunction *LoxClass::findMethod(const LoxString *name) {
+  for (LoxClass *klass = this; klass != nullptr; klass = klass->superclass.get()) {
+    auto found = klass->methods.find(name);
+    if (found != klass->methods.end())
+      return found->second.get();
+  }
+  return nullptr;
+}
+
+std::any LoxClass::call(Interpreter &interpreter, std::vector<std::any> arguments) {
+  std::shared_ptr<LoxInstance> instance = LoxInstance::create(shared_from_this());
+  if (LoxFunction *initializer = findMethod(StringTable::initName().get()))
+    initializer->bind(instance)->call(interpreter, arguments);
+  return instance;
+}
+
+int LoxClass::arity() {
+  LoxFunction *initializer = findMethod(StringTable::initName().get());
+  return initializer != nullptr ? initializer->arity() : 0;
+}
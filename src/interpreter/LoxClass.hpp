@@ -0,0 +1,34 @@
+#pragma once
+#include <any>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "LoxCallable.hpp"
+#include "LoxFunction.hpp"
+#include "Shape.hpp"
+#include "StringTable.hpp"
+
+// A class: its methods, its superclass and the root of the shape tree its
+// instances move through as they gain fields.
+class LoxClass : public LoxCallable, public std::enable_shared_from_this<LoxClass> {
+public:
+  using Methods = std::unordered_map<const LoxString*, std::shared_ptr<LoxFunction>, SymbolHash>;
+
+  const StringRef name;
+  const std::shared_ptr<LoxClass> superclass;
+  Shape root;
+
+  LoxClass(StringRef name, std::shared_ptr<LoxClass> superclass, Methods methods)
+    : name { std::move(name) }, superclass { std::move(superclass) }, methods { std::move(methods) } {}
+
+  // searches the superclass chain; null if there is no such method
+  LoxFunction *findMethod(const LoxString *name);
+  // only the methods the class itself declares
+  const Methods &methodTable() const { return methods; }
+
+  std::any call(Interpreter &interpreter, std::vector<std::any> arguments) override;
+  int arity() override;
+
+private:
+  Methods methods;
+};
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "LoxFile.hpp"
+#include "LoxString.hpp"
+
+namespace {
+  NativeError systemError(const std::string &what) {
+    return NativeError(what + ": " + std::strerror(errno) + ".");
+  }
+}
+
+std::shared_ptr<LoxFile> LoxFile::open(const std::string &path, const std::string &mode) {
+  Mode parsed;
+  int flags;
+  if (mode == "r")
+    parsed = Mode::Read, flags = O_RDONLY;
+  else if (mode == "w")
+    parsed = Mode::Write, flags = O_WRONLY | O_CREAT | O_TRUNC;
+  else if (mode == "a")
+    parsed = Mode::Append, flags = O_WRONLY | O_CREAT | O_APPEND;
+  else
+    throw NativeError("Mode must be \"r\", \"w\" or \"a\".");
+  int descriptor = ::open(path.c_str(), flags | O_CLOEXEC, 0666);
+  if (descriptor < 0)
+    throw systemError("Could not open '" + path + "'");
+  return std::make_shared<LoxFile>(path, parsed, descriptor);
+}
+
+LoxFile::LoxFile(std::string path, Mode mode, int descriptor)
+    : LoxNative { std::move(path), 0, nullptr }, mode { mode }, descriptor { descriptor } {
+  struct stat info;
+  if (mode != Mode::Read || fstat(descriptor, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+    return;
+  void *region = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  // too big for the address space, say; read() still works
+  if (region == MAP_FAILED)
+    return;
+  madvise(region, info.st_size, MADV_SEQUENTIAL);
+  mapped = static_cast<const char*>(region);
+  mappedSize = info.st_size;
+}
+
+LoxFile::~LoxFile() {
+  // a write that fails now has nobody left to report it to
+  try {
+    close();
+  } catch (NativeError &) {}
+}
+
+std::any LoxFile::readLine() {
+  check(true);
+  // bytes already searched for a newline, kept across refills
+  size_t scanned = 0;
+  while (true) {
+    std::string_view rest = available();
+    size_t newline = rest.find('\n', scanned);
+    if (newline != std::string_view::npos) {
+      size_t length = newline > 0 && rest[newline - 1] == '\r' ? newline - 1 : newline;
+      StringRef line = LoxString::create(std::string(rest.substr(0, length)));
+      consume(newline + 1);
+      return line;
+    }
+    scanned = rest.size();
+    if (!fill()) {
+      if (rest.empty())
+        return (void*) nullptr;
+      StringRef line = LoxString::create(std::string(rest));
+      consume(rest.size());
+      return line;
+    }
+  }
+}
+
+std::any LoxFile::readChunk(size_t size) {
+  check(true);
+  while (available().size() < size && fill())
+    ;
+  std::string_view rest = available();
+  if (rest.empty())
+    return (void*) nullptr;
+  StringRef chunk = LoxString::create(std::string(rest.substr(0, size)));
+  consume(std::min(size, rest.size()));
+  return chunk;
+}
+
+void LoxFile::writeAll(std::string_view data) {
+  check(false);
+  pending.append(data);
+  if (pending.size() >= bufferSize)
+    flush();
+}
+
+void LoxFile::close() {
+  if (descriptor < 0)
+    return;
+  // the file is closed even when the last write fails
+  std::string failure;
+  try {
+    flush();
+  } catch (NativeError &error) {
+    failure = error.what();
+    pending.clear();
+  }
+  if (mapped != nullptr)
+    munmap(const_cast<char*>(mapped), mappedSize);
+  mapped = nullptr;
+  buffer.clear();
+  int result = ::close(descriptor);
+  descriptor = -1;
+  if (!failure.empty())
+    throw NativeError(failure);
+  if (result != 0)
+    throw systemError("Could not close '" + name + "'");
+}
+
+void LoxFile::check(bool reading) const {
+  if (descriptor < 0)
+    throw NativeError("File is closed.");
+  if (reading && mode != Mode::Read)
+    throw NativeError("File is not open for reading.");
+  if (!reading && mode == Mode::Read)
+    throw NativeError("File is not open for writing.");
+}
+
+std::string_view LoxFile::available() const {
+  if (mapped != nullptr)
+    return { mapped + position, mappedSize - position };
+  return std::string_view { buffer }.substr(position);
+}
+
+bool LoxFile::fill() {
+  if (mapped != nullptr || atEnd)
+    return false;
+  buffer.erase(0, position);
+  position = 0;
+  // grow with the bytes held so that a long line is not copied down once
+  // per read
+  size_t kept = buffer.size();
+  size_t wanted = std::max(bufferSize, kept);
+  buffer.resize(kept + wanted);
+  ssize_t count;
+  do {
+    count = ::read(descriptor, buffer.data() + kept, wanted);
+  } while (count < 0 && errno == EINTR);
+  buffer.resize(kept + std::max<ssize_t>(count, 0));
+  if (count < 0)
+    throw systemError("Could not read '" + name + "'");
+  atEnd = count == 0;
+  return !atEnd;
+}
+
+void LoxFile::consume(size_t count) {
+  position += count;
+  if (mapped == nullptr || position - released < releaseWindow)
+    return;
+  // the mapping starts on a page, so whole pages behind the reader can go
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t end = position / page * page;
+  madvise(const_cast<char*>(mapped) + released, end - released, MADV_DONTNEED);
+  released = end;
+}
+
+void LoxFile::flush() {
+  size_t written = 0;
+  while (written < pending.size()) {
+    ssize_t count = ::write(descriptor, pending.data() + written, pending.size() - written);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count < 0) {
+      pending.erase(0, written);
+      throw systemError("Could not write '" + name + "'");
+    }
+    written += count;
+  }
+  pending.clear();
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <any>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "LoxNative.hpp"
+
+// An open file. It is a callable taking no arguments that returns the next
+// line each time it is called, so a handle doubles as a lazy line iterator.
+//
+// A regular file opened for reading is mapped into memory and read in
+// place: lines are copied straight from the mapping into their strings,
+// and the pages already read are dropped from the mapping as the reader
+// moves on, so a file of any size is read in a few megabytes. Anything
+// that cannot be mapped (a pipe, a terminal, an empty file) is read with
+// read() through a buffer instead. Writes are buffered and go out when
+// the buffer fills and when the file is closed.
+//
+// Every method throws NativeError when the file is closed, not open in the
+// right mode, or the system call fails.
+class LoxFile : public LoxNative {
+public:
+  enum class Mode { Read, Write, Append };
+
+  // `mode` is "r", "w" (created or truncated) or "a" (created or appended to)
+  static std::shared_ptr<LoxFile> open(const std::string &path, const std::string &mode);
+
+  LoxFile(std::string path, Mode mode, int descriptor);
+  ~LoxFile();
+
+  // the next line without its "\n" or "\r\n", or nil at the end of the file;
+  // the last line need not end in a newline
+  std::any readLine();
+  // the next `size` bytes, fewer at the end of the file, or nil once there
+  // is nothing left
+  std::any readChunk(size_t size);
+  void writeAll(std::string_view data);
+  // flushes what is left to write; closing twice is harmless
+  void close();
+
+  std::any call(Interpreter &interpreter, std::vector<std::any> arguments) override { return readLine(); }
+
+private:
+  static constexpr size_t bufferSize = 1 << 16;
+  // how far the reader gets past the start of the mapping it still holds
+  // before the pages behind it are dropped
+  static constexpr size_t releaseWindow = 1 << 25;
+
+  const Mode mode;
+  int descriptor;
+
+  // the mapping of a regular file, if it has one
+  const char *mapped { nullptr };
+  size_t mappedSize { 0 };
+  size_t released { 0 };
+  // otherwise what read() returned and nobody has consumed yet
+  std::string buffer;
+  bool atEnd { false };
+  // where the unread bytes begin in the mapping or the buffer
+  size_t position { 0 };
+
+  std::string pending;
+
+  // throws unless the file is open for reading, or for writing
+  void check(bool reading) const;
+  // the bytes read but not yet consumed
+  std::string_view available() const;
+  // reads more into the buffer; false at the end of the file
+  bool fill();
+  void consume(size_t count);
+  void flush();
+};
@@ -1,22 +1,59 @@
 #include <any>
 #include <vector>
 #include "Interpreter.hpp"
+#include "ClosureEngine.hpp"
 #include "ReturnException.hpp"
+#include "RuntimeError.hpp"
 #include "LoxFunction.hpp"
+#include "Jit.hpp"
+#include "LazyParse.hpp"
+#include "LoxInstance.hpp"
+#include "StringTable.hpp"
+
+std::shared_ptr<LoxFunction> LoxFunction::bind(std::shared_ptr<LoxInstance> instance) {
+  std::shared_ptr<Environment> environment { Environment::create(closure) };
+  environment->define(StringTable::thisName(), instance);
+  return std::allocate_shared<LoxFunction>(CountingAllocator<LoxFunction, MemoryCategory::Closure> {},
+    declaration, environment, isInitializer);
+}
 
 std::any LoxFunction::call(Interpreter &interpreter, std::vector<std::any> arguments) {
-  std::shared_ptr<Environment> environment{ new Environment(closure) };
+  if (declaration->deferred) {
+    Diagnostics diagnostics;
+    if (!ensureResolved(*declaration, diagnostics)) {
+      diagnostics.print(std::cout);
+      throw RuntimeError(declaration->name, "Could not resolve the body of '" + declaration->name.lexeme->str() + "'.");
+    }
+  }
+
+  if (interpreter.engine != nullptr)
+    return interpreter.engine->call(*this, arguments);
+
+  // initializers return `this`, which compiled code knows nothing about
+  if (interpreter.jit != nullptr && !isInitializer) {
+    std::any result;
+    if (interpreter.jit->call(declaration, closure, arguments, result))
+      return result;
+  }
+
+  std::shared_ptr<Environment> environment{ Environment::create(closure) };
   
-  for (int i = 0; i < declaration.get()->params.size(); ++i) {
-    environment->define(declaration.get()->params[i].lexeme, arguments[i]);
+  for (size_t i = 0; i < declaration.get()->params.size(); ++i) {
+    if (declaration->cellParams[i])
+      environment->define(declaration.get()->params[i].lexeme, Environment::cell(arguments[i]));
+    else
+      environment->define(declaration.get()->params[i].lexeme, arguments[i]);
   }
 
   try {
     interpreter.executeBlock(declaration.get()->body, environment);
   } catch (ReturnException& returnValue) {
-
+      if (isInitializer)
+        return closure->getAt(0, StringTable::thisName());
       return returnValue.value;
   };
+  if (isInitializer)
+    return closure->getAt(0, StringTable::thisName());
   return nullptr;
 }
 
@@ -25,7 +62,7 @@ int LoxFunction::arity() {
 }
 
 std::ostream& operator<<(std::ostream& out, const LoxFunction& function) {
-  std::cout << "<fn " << function.declaration.get()->name.lexeme << ">";
+  out << "<fn " << function.declaration.get()->name.lexeme->str() << ">";
   return out;
 }
 
@@ -4,12 +4,21 @@
 #include "Interpreter.hpp"
 #include "Environment.hpp"
 
+class LoxInstance;
+
 class LoxFunction : public LoxCallable {
   std::shared_ptr<Function> declaration;
   std::shared_ptr<Environment> closure;
+  bool isInitializer;
 public:
-  LoxFunction(std::shared_ptr<Function> declaration, std::shared_ptr<Environment> closure) : declaration{ declaration }, closure{ closure } {};
+  LoxFunction(std::shared_ptr<Function> declaration, std::shared_ptr<Environment> closure, bool isInitializer = false)
+    : declaration{ declaration }, closure{ closure }, isInitializer{ isInitializer } {};
+  // the method with `this` bound to instance
+  std::shared_ptr<LoxFunction> bind(std::shared_ptr<LoxInstance> instance);
   std::any call(Interpreter &interpreter, std::vector<std::any> arguments) override;
   int arity() override;
+  const std::shared_ptr<Function> &getDeclaration() const { return declaration; }
+  const std::shared_ptr<Environment> &getClosure() const { return closure; }
+  bool initializer() const { return isInitializer; }
   friend std::ostream& operator<<(std::ostream& out, const LoxFunction& function);
 };
@@ -0,0 +1,69 @@
+#include "LoxInstance.hpp"
+#include "RuntimeError.hpp"
+
+std::shared_ptr<LoxInstance> LoxInstance::create(std::shared_ptr<LoxClass> klass) {
+  return std::allocate_shared<LoxInstance>(CountingAllocator<LoxInstance, MemoryCategory::Object> {}, std::move(klass));
+}
+
+LoxInstance::~LoxInstance() {
+  for (std::any &field : fields)
+    MemoryStats::untrackValue(field);
+}
+
+std::any LoxInstance::bind(LoxFunction &method) {
+  std::shared_ptr<LoxCallable> bound = method.bind(shared_from_this());
+  return bound;
+}
+
+std::vector<std::pair<const LoxString*, std::any>> LoxInstance::fieldList() const {
+  std::vector<std::pair<const LoxString*, std::any>> list;
+  std::vector<const LoxString*> names = shape->fieldNames();
+  for (size_t i = 0; i < names.size(); ++i)
+    list.emplace_back(names[i], fields[i]);
+  return list;
+}
+
+std::any LoxInstance::get(const Token &name, PropertyCache &cache) {
+  if (const PropertyCache::Entry *hit = cache.find(shape->id)) {
+    if (hit->slot >= 0)
+      return fields[hit->slot];
+    return bind(*hit->method);
+  }
+
+  // fields shadow methods; either answer holds for as long as the instance
+  // keeps this shape
+  int slot = shape->find(name.lexeme.get());
+  LoxFunction *method = slot < 0 ? klass->findMethod(name.lexeme.get()) : nullptr;
+  if (slot < 0 && method == nullptr)
+    throw RuntimeError(name, "Undefined property '" + name.lexeme->str() + "'.");
+  if (!cache.megamorphic)
+    cache.add({ shape->id, slot, method, nullptr });
+  if (slot >= 0)
+    return fields[slot];
+  return bind(*method);
+}
+
+void LoxInstance::set(const Token &name, std::any value, PropertyCache &cache) {
+  MemoryStats::trackValue(value);
+  const PropertyCache::Entry *hit = cache.find(shape->id);
+  PropertyCache::Entry miss;
+  if (hit == nullptr) {
+    miss.shape = shape->id;
+    miss.slot = shape->find(name.lexeme.get());
+    if (miss.slot < 0) {
+      miss.transition = shape->withField(name.lexeme.get());
+      miss.slot = shape->slotCount;
+    }
+    if (!cache.megamorphic)
+      cache.add(miss);
+    hit = &miss;
+  }
+
+  if (hit->transition != nullptr) {
+    shape = hit->transition;
+    fields.push_back(std::move(value));
+    return;
+  }
+  MemoryStats::untrackValue(fields[hit->slot]);
+  fields[hit->slot] = std::move(value);
+}
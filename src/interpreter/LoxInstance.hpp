@@ -0,0 +1,35 @@
+#pragma once
+#include <any>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "LoxClass.hpp"
+#include "MemoryStats.hpp"
+#include "Shape.hpp"
+#include "Token.hpp"
+
+// An instance stores its fields in a flat slot array laid out by its shape.
+// Property accesses go through the inline cache of the access site, so a
+// site that keeps seeing the same shapes skips the name lookup.
+class LoxInstance : public std::enable_shared_from_this<LoxInstance> {
+public:
+  const std::shared_ptr<LoxClass> klass;
+
+  explicit LoxInstance(std::shared_ptr<LoxClass> klass) : klass { klass }, shape { &klass->root } {}
+  ~LoxInstance();
+
+  // instances are allocated through here so they show up in MemoryStats
+  static std::shared_ptr<LoxInstance> create(std::shared_ptr<LoxClass> klass);
+
+  // a field, or a method bound to this instance
+  std::any get(const Token &name, PropertyCache &cache);
+  void set(const Token &name, std::any value, PropertyCache &cache);
+  // every field with its name, in slot order
+  std::vector<std::pair<const LoxString*, std::any>> fieldList() const;
+
+private:
+  Shape *shape;
+  std::vector<std::any, CountingAllocator<std::any, MemoryCategory::Object>> fields;
+
+  std::any bind(LoxFunction &method);
+};
@@ -0,0 +1,204 @@
+#include <bit>
+#include <functional>
+#include "LoxArray.hpp"
+#include "LoxCallable.hpp"
+#include "LoxInstance.hpp"
+#include "LoxMap.hpp"
+#include "LoxString.hpp"
+#include "Number.hpp"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+  constexpr int8_t emptyControl = -128;
+  constexpr int8_t deletedControl = -2;
+
+  // bit i is set where control byte i of the group equals `value`
+  uint32_t match(const int8_t *group, int8_t value) {
+#if defined(__SSE2__)
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(value)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < LoxMap::groupSize; ++i)
+      mask |= uint32_t(group[i] == value) << i;
+    return mask;
+#endif
+  }
+
+  // the object behind a reference value, or null for anything else
+  const void *identity(const std::any &value) {
+    const std::type_info &type = value.type();
+    if (type == typeid(std::shared_ptr<LoxCallable>))
+      return std::any_cast<const std::shared_ptr<LoxCallable>&>(value).get();
+    if (type == typeid(std::shared_ptr<LoxInstance>))
+      return std::any_cast<const std::shared_ptr<LoxInstance>&>(value).get();
+    if (type == typeid(ArrayRef))
+      return std::any_cast<const ArrayRef&>(value).get();
+    if (type == typeid(MapRef))
+      return std::any_cast<const MapRef&>(value).get();
+    return nullptr;
+  }
+
+  // identity hashes are just addresses, with the low bits always zero;
+  // every hash is spread over the whole word before it is split into the
+  // group index and the control byte
+  size_t mix(size_t hash) {
+    uint64_t product = static_cast<uint64_t>(hash) * 0x9e3779b97f4a7c15ull;
+    return static_cast<size_t>(product ^ (product >> 32));
+  }
+
+  size_t hashKey(const std::any &key) {
+    const std::type_info &type = key.type();
+    if (isNumber(key))
+      return mix(hashNumber(key));
+    if (type == typeid(StringRef))
+      return mix(std::any_cast<const StringRef&>(key)->hash());
+    if (type == typeid(bool))
+      return mix(std::any_cast<bool>(key) ? 1 : 2);
+    if (type == typeid(void*))
+      return mix(3);
+    return mix(reinterpret_cast<size_t>(identity(key)));
+  }
+
+  // the same rules as Interpreter::isEqual
+  bool keysEqual(const std::any &a, const std::any &b) {
+    if (isNumber(a) && isNumber(b))
+      return compareNumbers(a, b) == 0;
+    const std::type_info &type = a.type();
+    if (type != b.type())
+      return false;
+    if (type == typeid(StringRef))
+      return std::any_cast<const StringRef&>(a)->equals(*std::any_cast<const StringRef&>(b));
+    if (type == typeid(bool))
+      return std::any_cast<bool>(a) == std::any_cast<bool>(b);
+    if (type == typeid(void*))
+      return true;
+    const void *object = identity(a);
+    return object != nullptr && object == identity(b);
+  }
+
+  int8_t tagOf(size_t hash) {
+    return static_cast<int8_t>(hash & 0x7f);
+  }
+}
+
+MapRef LoxMap::create() {
+  return std::allocate_shared<LoxMap>(CountingAllocator<LoxMap, MemoryCategory::Object> {});
+}
+
+LoxMap::~LoxMap() {
+  for (Entry &entry : entryList) {
+    MemoryStats::untrackValue(entry.key);
+    MemoryStats::untrackValue(entry.value);
+  }
+}
+
+long LoxMap::find(const std::any &key, size_t hash) const {
+  if (control.empty())
+    return -1;
+  size_t groupMask = control.size() / groupSize - 1;
+  size_t group = (hash >> 7) & groupMask;
+  int8_t tag = tagOf(hash);
+  // triangular probing visits every group of a power-of-two table
+  for (size_t probe = 1; ; ++probe) {
+    const int8_t *bytes = control.data() + group * groupSize;
+    for (uint32_t candidates = match(bytes, tag); candidates != 0; candidates &= candidates - 1) {
+      size_t slot = group * groupSize + std::countr_zero(candidates);
+      const Entry &entry = entryList[slots[slot]];
+      if (entry.hash == hash && keysEqual(entry.key, key))
+        return slot;
+    }
+    // an insert would have stopped at the first group with room, and
+    // growthLeft keeps some slots empty, so the key is not further on
+    if (match(bytes, emptyControl) != 0)
+      return -1;
+    group = (group + probe) & groupMask;
+  }
+}
+
+void LoxMap::insertSlot(size_t hash, uint32_t entry) {
+  size_t groupMask = control.size() / groupSize - 1;
+  size_t group = (hash >> 7) & groupMask;
+  for (size_t probe = 1; ; ++probe) {
+    const int8_t *bytes = control.data() + group * groupSize;
+    if (uint32_t room = match(bytes, emptyControl) | match(bytes, deletedControl)) {
+      size_t slot = group * groupSize + std::countr_zero(room);
+      if (control[slot] == emptyControl)
+        growthLeft--;
+      control[slot] = tagOf(hash);
+      slots[slot] = entry;
+      return;
+    }
+    group = (group + probe) & groupMask;
+  }
+}
+
+void LoxMap::rehash(size_t capacity) {
+  // drop removed entries; the survivors keep their order
+  size_t kept = 0;
+  for (size_t i = 0; i < entryList.size(); ++i) {
+    if (!entryList[i].live)
+      continue;
+    if (i != kept)
+      entryList[kept] = std::move(entryList[i]);
+    kept++;
+  }
+  entryList.resize(kept);
+
+  control.assign(capacity, emptyControl);
+  slots.assign(capacity, 0);
+  growthLeft = capacity - capacity / 8;
+  for (size_t i = 0; i < entryList.size(); ++i)
+    insertSlot(entryList[i].hash, i);
+}
+
+std::any LoxMap::get(const std::any &key) const {
+  long slot = find(key, hashKey(key));
+  if (slot < 0)
+    return (void*) nullptr;
+  return entryList[slots[slot]].value;
+}
+
+bool LoxMap::contains(const std::any &key) const {
+  return find(key, hashKey(key)) >= 0;
+}
+
+void LoxMap::set(const std::any &key, std::any value) {
+  size_t hash = hashKey(key);
+  MemoryStats::trackValue(value);
+  long slot = find(key, hash);
+  if (slot >= 0) {
+    Entry &entry = entryList[slots[slot]];
+    MemoryStats::untrackValue(entry.value);
+    entry.value = std::move(value);
+    return;
+  }
+
+  // inserts that reuse removed slots never use up growthLeft, so removed
+  // entries are also dropped once there are half as many as slots
+  if (growthLeft == 0 || entryList.size() - count >= control.size() / 2) {
+    // a table clogged with removed slots is rebuilt at the same size
+    size_t capacity = control.size();
+    size_t maxLoad = capacity - capacity / 8;
+    rehash(capacity == 0 ? groupSize : count >= maxLoad / 2 ? capacity * 2 : capacity);
+  }
+  MemoryStats::trackValue(key);
+  entryList.push_back({ key, std::move(value), hash, true });
+  insertSlot(hash, entryList.size() - 1);
+  count++;
+}
+
+bool LoxMap::remove(const std::any &key) {
+  long slot = find(key, hashKey(key));
+  if (slot < 0)
+    return false;
+  Entry &entry = entryList[slots[slot]];
+  MemoryStats::untrackValue(entry.key);
+  MemoryStats::untrackValue(entry.value);
+  entry = { std::any {}, std::any {}, 0, false };
+  control[slot] = deletedControl;
+  count--;
+  return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <any>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "MemoryStats.hpp"
+
+class LoxMap;
+using MapRef = std::shared_ptr<LoxMap>;
+
+// A hash map keyed by Lox values, laid out like a Swiss table: one control
+// byte per slot holds 7 bits of the key's hash, and a lookup compares a
+// whole group of 16 control bytes against them at once, touching the slots
+// only on a match. Slots point into a dense entry vector kept in insertion
+// order, which is the order iteration follows.
+//
+// Numbers, booleans and nil hash by value, strings by content (through the
+// hash the string caches), and everything else by identity, matching `==`.
+class LoxMap {
+public:
+  struct Entry {
+    std::any key;
+    std::any value;
+    size_t hash;
+    bool live;
+  };
+  using Entries = std::vector<Entry, CountingAllocator<Entry, MemoryCategory::Object>>;
+
+  static constexpr size_t groupSize = 16;
+
+  // maps are allocated through here so they show up in MemoryStats
+  static MapRef create();
+
+  ~LoxMap();
+
+  size_t size() const { return count; }
+  // nil if the key is missing
+  std::any get(const std::any &key) const;
+  void set(const std::any &key, std::any value);
+  bool contains(const std::any &key) const;
+  // true if the key was present
+  bool remove(const std::any &key);
+  // live entries in insertion order, with removed ones left as gaps
+  const Entries &entries() const { return entryList; }
+
+  // set while the map is being printed, to cut off cycles
+  bool printing { false };
+
+private:
+  std::vector<int8_t, CountingAllocator<int8_t, MemoryCategory::Object>> control;
+  // index into entryList for every full slot
+  std::vector<uint32_t, CountingAllocator<uint32_t, MemoryCategory::Object>> slots;
+  Entries entryList;
+  size_t count { 0 };
+  // inserts left before the table must grow; removed slots stay taken
+  // until the next rehash
+  size_t growthLeft { 0 };
+
+  // slot holding the key, or -1
+  long find(const std::any &key, size_t hash) const;
+  void insertSlot(size_t hash, uint32_t entry);
+  void rehash(size_t capacity);
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include <any>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "LoxCallable.hpp"
+
+// Thrown by a native body for bad arguments; the interpreter reports it at
+// the call site.
+struct NativeError : public std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+// A function implemented in C++ and bound to a global name.
+class LoxNative : public LoxCallable {
+public:
+  using Body = std::function<std::any(Interpreter &interpreter, std::vector<std::any> &arguments)>;
+
+  const std::string name;
+
+  LoxNative(std::string name, int arity, Body body) : name { name }, argCount { arity }, body { body } {}
+  std::any call(Interpreter &interpreter, std::vector<std::any> arguments) override {
+    return body(interpreter, arguments);
+  }
+  int arity() override { return argCount; }
+
+private:
+  int argCount;
+  Body body;
+};
@@ -0,0 +1,117 @@
+#include <functional>
+#include <utility>
+#include <vector>
+#include "LoxString.hpp"
+#include "MemoryStats.hpp"
+
+namespace {
+  using StringAllocator = CountingAllocator<LoxString, MemoryCategory::Value>;
+  // interned strings come from source text, so they count as token memory
+  using InternedAllocator = CountingAllocator<LoxString, MemoryCategory::Token>;
+
+  MemoryCategory categoryOf(bool source) {
+    return source ? MemoryCategory::Token : MemoryCategory::Value;
+  }
+}
+
+void LoxString::release(StringRef &left, StringRef &right) {
+  // A rope built by appending in a loop is as deep as the loop ran long;
+  // releasing it recursively would overflow the stack, so nodes we hold the
+  // last reference to are taken apart here instead.
+  std::vector<StringRef> pending;
+  if (left != nullptr)
+    pending.push_back(std::move(left));
+  if (right != nullptr)
+    pending.push_back(std::move(right));
+  while (!pending.empty()) {
+    StringRef node = std::move(pending.back());
+    pending.pop_back();
+    if (node.use_count() == 1 && node->isRope()) {
+      pending.push_back(std::move(node->left));
+      pending.push_back(std::move(node->right));
+    }
+  }
+}
+
+StringRef LoxString::create(std::string chars) {
+  return std::allocate_shared<LoxString>(StringAllocator {}, std::move(chars));
+}
+
+StringRef LoxString::createInterned(std::string chars) {
+  StringRef string = std::allocate_shared<LoxString>(InternedAllocator {}, std::move(chars), true);
+  string->hash();
+  return string;
+}
+
+StringRef LoxString::createSource(std::string chars) {
+  return std::allocate_shared<LoxString>(InternedAllocator {}, std::move(chars), false, true);
+}
+
+StringRef LoxString::concat(const StringRef &left, const StringRef &right) {
+  if (left->size() == 0)
+    return right;
+  if (right->size() == 0)
+    return left;
+  if (left->size() + right->size() < flatLimit)
+    return create(left->str() + right->str());
+  return std::allocate_shared<LoxString>(StringAllocator {}, left, right);
+}
+
+LoxString::LoxString(std::string chars, bool interned, bool source)
+    : chars { std::move(chars) }, length { this->chars.size() }, interned { interned }, source { interned || source } {
+  if (size_t bytes = MemoryStats::stringBytes(this->chars))
+    MemoryStats::allocated(categoryOf(this->source), bytes);
+}
+
+LoxString::LoxString(StringRef left, StringRef right)
+    : left { std::move(left) }, right { std::move(right) }, length { this->left->size() + this->right->size() } {}
+
+LoxString::~LoxString() {
+  if (size_t bytes = MemoryStats::stringBytes(chars))
+    MemoryStats::freed(categoryOf(source), bytes);
+  release(left, right);
+}
+
+const std::string &LoxString::str() const {
+  if (isRope())
+    flatten();
+  return chars;
+}
+
+void LoxString::flatten() const {
+  chars.reserve(length);
+  // walk the leaves left to right without recursing
+  std::vector<const LoxString*> pending { right.get(), left.get() };
+  while (!pending.empty()) {
+    const LoxString *node = pending.back();
+    pending.pop_back();
+    if (node->isRope()) {
+      pending.push_back(node->right.get());
+      pending.push_back(node->left.get());
+    } else {
+      chars += node->chars;
+    }
+  }
+  if (size_t bytes = MemoryStats::stringBytes(chars))
+    MemoryStats::allocated(MemoryCategory::Value, bytes);
+  release(left, right);
+}
+
+size_t LoxString::hash() const {
+  if (!hashed) {
+    hashValue = std::hash<std::string_view>()(str());
+    hashed = true;
+  }
+  return hashValue;
+}
+
+bool LoxString::equals(const LoxString &other) const {
+  if (this == &other)
+    return true;
+  // two interned strings are equal only if they are the same object
+  if ((interned && other.interned) || length != other.length)
+    return false;
+  if (hashed && other.hashed && hashValue != other.hashValue)
+    return false;
+  return str() == other.str();
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+class LoxString;
+using StringRef = std::shared_ptr<LoxString>;
+
+// The runtime string value. Strings are immutable and shared by pointer,
+// so copying a value only bumps a reference count. Concatenating two
+// strings builds a rope node holding both halves; the characters are only
+// copied into one buffer the first time something needs them (printing,
+// comparison, hashing), and the node then drops its halves.
+class LoxString {
+public:
+  // concatenations shorter than this are copied straight away; a rope node
+  // costs more than copying a few bytes
+  static constexpr size_t flatLimit = 64;
+
+  // strings are allocated through here so they show up in MemoryStats
+  static StringRef create(std::string chars);
+  static StringRef concat(const StringRef &left, const StringRef &right);
+  // only for StringTable; use StringTable::intern
+  static StringRef createInterned(std::string chars);
+  // source text left out of the table, such as the quoted lexeme of a
+  // string literal; counted as token memory like interned strings
+  static StringRef createSource(std::string chars);
+
+  explicit LoxString(std::string chars, bool interned = false, bool source = false);
+  LoxString(StringRef left, StringRef right);
+  ~LoxString();
+
+  size_t size() const { return length; }
+  // flattens the rope on first use
+  const std::string &str() const;
+  std::string_view view() const { return str(); }
+  size_t hash() const;
+  bool equals(const LoxString &other) const;
+  bool isInterned() const { return interned; }
+
+private:
+  mutable std::string chars;
+  mutable StringRef left;
+  mutable StringRef right;
+  size_t length;
+  mutable size_t hashValue { 0 };
+  mutable bool hashed { false };
+  const bool interned { false };
+  // interned or made by createSource(), for MemoryStats
+  const bool source { false };
+
+  bool isRope() const { return left != nullptr; }
+  void flatten() const;
+  static void release(StringRef &left, StringRef &right);
+};
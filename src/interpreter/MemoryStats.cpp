@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <iomanip>
+#include <string>
+#include "MemoryStats.hpp"
+
+constinit thread_local MemoryStats::Counters MemoryStats::counters[static_cast<int>(MemoryCategory::COUNT)];
+constinit thread_local MemoryStats::Counters MemoryStats::total;
+
+size_t MemoryStats::stringBytes(const std::string &value) {
+  static const size_t inlineCapacity = std::string().capacity();
+  return value.capacity() > inlineCapacity ? value.capacity() + 1 : 0;
+}
+
+size_t MemoryStats::valueBytes(const std::any &value) {
+  const std::type_info &type = value.type();
+  if (type == typeid(double) || type == typeid(int64_t) || type == typeid(bool) || type == typeid(void*) || type == typeid(std::nullptr_t) || type == typeid(void))
+    return 0;
+  if (type == typeid(std::string)) {
+    const std::string &str = *std::any_cast<std::string>(&value);
+    return sizeof(std::string) + stringBytes(str);
+  }
+  // shared_ptr handles, including strings, and anything else too large for
+  // the inline buffer; a string's characters are counted once, by LoxString
+  return 2 * sizeof(void*);
+}
+
+const char *MemoryStats::name(MemoryCategory category) {
+  switch (category) {
+    case MemoryCategory::Environment:
+      return "environment";
+    case MemoryCategory::Value:
+      return "value";
+    case MemoryCategory::Token:
+      return "token";
+    case MemoryCategory::Ast:
+      return "ast";
+    case MemoryCategory::Closure:
+      return "closure";
+    case MemoryCategory::Object:
+      return "object";
+    default:
+      return "?";
+  }
+}
+
+bool MemoryStats::lookup(const std::string &name, Counters &out) {
+  if (name == "total") {
+    out = total;
+    return true;
+  }
+  for (int i = 0; i < static_cast<int>(MemoryCategory::COUNT); ++i) {
+    if (name == MemoryStats::name(static_cast<MemoryCategory>(i))) {
+      out = counters[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+void MemoryStats::report(std::ostream &out) {
+  out << "== memory ==\n"
+      << std::left << std::setw(12) << "category" << std::right
+      << std::setw(14) << "live bytes" << std::setw(14) << "peak bytes"
+      << std::setw(14) << "allocations" << std::setw(14) << "frees" << "\n";
+  auto row = [&](const char *label, const Counters &c) {
+    out << std::left << std::setw(12) << label << std::right
+        << std::setw(14) << c.live << std::setw(14) << c.peak
+        << std::setw(14) << c.allocations << std::setw(14) << c.frees << "\n";
+  };
+  for (int i = 0; i < static_cast<int>(MemoryCategory::COUNT); ++i)
+    row(name(static_cast<MemoryCategory>(i)), counters[i]);
+  row("total", total);
+}
+
+MemoryStats::Tally MemoryStats::tally() {
+  Tally tally;
+  for (int i = 0; i < static_cast<int>(MemoryCategory::COUNT); ++i)
+    tally.categories[i] = counters[i];
+  tally.total = total;
+  return tally;
+}
+
+MemoryStats::Tally MemoryStats::take() {
+  Tally taken = tally();
+  for (Counters &c : counters)
+    c = {};
+  total = {};
+  return taken;
+}
+
+void MemoryStats::absorb(const Tally &tally) {
+  auto add = [](Counters &into, const Counters &from) {
+    into.live += from.live;
+    into.allocations += from.allocations;
+    into.frees += from.frees;
+    into.peak = std::max(into.peak, into.live);
+  };
+  for (int i = 0; i < static_cast<int>(MemoryCategory::COUNT); ++i)
+    add(counters[i], tally.categories[i]);
+  add(total, tally.total);
+}
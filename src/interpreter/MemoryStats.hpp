@@ -0,0 +1,117 @@
+#pragma once
+#include <any>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+enum class MemoryCategory {
+  Environment,
+  Value,
+  Token,
+  Ast,
+  Closure,
+  Object,
+  COUNT,
+};
+
+// Byte and allocation counters per runtime category. Allocation sites
+// either allocate through CountingAllocator or report their sizes
+// directly; the counters are cheap enough to stay on permanently so a
+// script can query them at any point.
+//
+// Counters are kept per thread, so threads that parse or run code on the
+// side never race on them; reports show the calling thread's counts.
+class MemoryStats {
+public:
+  struct Counters {
+    int64_t live { 0 };
+    int64_t peak { 0 };
+    uint64_t allocations { 0 };
+    uint64_t frees { 0 };
+  };
+
+  static void allocated(MemoryCategory category, size_t bytes) {
+    Counters &c = counters[static_cast<int>(category)];
+    c.live += bytes;
+    c.allocations++;
+    if (c.live > c.peak)
+      c.peak = c.live;
+    total.live += bytes;
+    total.allocations++;
+    if (total.live > total.peak)
+      total.peak = total.live;
+  }
+  static void freed(MemoryCategory category, size_t bytes) {
+    Counters &c = counters[static_cast<int>(category)];
+    c.live -= bytes;
+    c.frees++;
+    total.live -= bytes;
+    total.frees++;
+  }
+
+  // heap bytes owned by a value: std::any boxes anything larger than a
+  // pointer, and strings own their character buffer on top of that
+  static size_t valueBytes(const std::any &value);
+  static size_t stringBytes(const std::string &value);
+  // account for a value stored in, or removed from, a variable or field
+  static void trackValue(const std::any &value) {
+    if (size_t bytes = valueBytes(value))
+      allocated(MemoryCategory::Value, bytes);
+  }
+  static void untrackValue(const std::any &value) {
+    if (size_t bytes = valueBytes(value))
+      freed(MemoryCategory::Value, bytes);
+  }
+
+  static const Counters &get(MemoryCategory category) { return counters[static_cast<int>(category)]; }
+  static const Counters &getTotal() { return total; }
+  static const char *name(MemoryCategory category);
+  // accepts the names printed by report() plus "total"
+  static bool lookup(const std::string &name, Counters &out);
+  static void report(std::ostream &out);
+
+  // every counter of the calling thread; a thread that builds values for
+  // another hands its tally over when it finishes, so the values it leaves
+  // behind are counted where they are freed
+  struct Tally {
+    Counters categories[static_cast<int>(MemoryCategory::COUNT)];
+    Counters total;
+  };
+  static Tally tally();
+  // tally() and zero the counters, for a thread that lives on and hands
+  // over what it did again later
+  static Tally take();
+  static void absorb(const Tally &tally);
+
+private:
+  static constinit thread_local Counters counters[static_cast<int>(MemoryCategory::COUNT)];
+  static constinit thread_local Counters total;
+};
+
+template<typename T, MemoryCategory category>
+struct CountingAllocator {
+  using value_type = T;
+
+  template<typename U>
+  struct rebind {
+    using other = CountingAllocator<U, category>;
+  };
+
+  CountingAllocator() = default;
+  template<typename U>
+  CountingAllocator(const CountingAllocator<U, category> &) {}
+
+  T *allocate(size_t n) {
+    MemoryStats::allocated(category, n * sizeof(T));
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T *p, size_t n) {
+    MemoryStats::freed(category, n * sizeof(T));
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template<typename U>
+  bool operator==(const CountingAllocator<U, category> &) const { return true; }
+};
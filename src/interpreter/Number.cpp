@@ -0,0 +1,73 @@
+#include <functional>
+#include <limits>
+#include <sstream>
+#include "Number.hpp"
+
+namespace {
+  std::partial_ordering compareMixed(int64_t integer, double number) {
+    if (std::isnan(number))
+      return std::partial_ordering::unordered;
+    if (number >= 0x1p63)
+      return std::partial_ordering::less;
+    if (number < -0x1p63)
+      return std::partial_ordering::greater;
+    // the whole part fits, and decides unless it is the integer itself
+    double whole = std::trunc(number);
+    int64_t truncated = static_cast<int64_t>(whole);
+    if (integer != truncated)
+      return integer <=> truncated;
+    return 0.0 <=> number - whole;
+  }
+}
+
+std::any divideNumbers(const std::any &a, const std::any &b) {
+  NumberView x { a }, y { b };
+  if (x.integer != nullptr && y.integer != nullptr) {
+    int64_t dividend = *x.integer, divisor = *y.integer;
+    // the minimum divided by -1 is the one quotient that does not fit
+    if (!(dividend == std::numeric_limits<int64_t>::min() && divisor == -1) && dividend % divisor == 0)
+      return dividend / divisor;
+  }
+  if (!x.valid() || !y.valid())
+    return {};
+  return boxNumber(x.toDouble() / y.toDouble());
+}
+
+std::any negateNumber(const std::any &a) {
+  NumberView x { a };
+  if (x.integer != nullptr && *x.integer != std::numeric_limits<int64_t>::min())
+    return -*x.integer;
+  if (!x.valid())
+    return {};
+  return boxNumber(-x.toDouble());
+}
+
+std::partial_ordering compareNumbers(const std::any &a, const std::any &b) {
+  NumberView x { a }, y { b };
+  if (!x.valid() || !y.valid())
+    return std::partial_ordering::unordered;
+  if (x.integer != nullptr && y.integer != nullptr)
+    return *x.integer <=> *y.integer;
+  if (x.integer != nullptr)
+    return compareMixed(*x.integer, *y.real);
+  if (y.integer != nullptr)
+    return 0 <=> compareMixed(*y.integer, *x.real);
+  return *x.real <=> *y.real;
+}
+
+// both take a double that should have been an integer for the integer
+std::string formatNumber(const std::any &number) {
+  std::any canonical = number.type() == typeid(double) ? boxNumber(std::any_cast<double>(number)) : number;
+  if (const int64_t *integer = std::any_cast<int64_t>(&canonical))
+    return std::to_string(*integer);
+  std::ostringstream oss;
+  oss << std::any_cast<double>(canonical);
+  return oss.str();
+}
+
+size_t hashNumber(const std::any &number) {
+  std::any canonical = number.type() == typeid(double) ? boxNumber(std::any_cast<double>(number)) : number;
+  if (const int64_t *integer = std::any_cast<int64_t>(&canonical))
+    return std::hash<int64_t>()(*integer);
+  return std::hash<double>()(std::any_cast<double>(canonical));
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <any>
+#include <cmath>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Lox has one number type held two ways. A number whose value is an
+// integer that fits in 64 bits is an int64_t; any other is a double. Which
+// one follows from the value alone, so 3.0 is held as 3 and 0.5 * 4 yields
+// the integer 2, and the two only differ in precision: +, -, * and / on
+// two integers are exact as long as the result is an integer that fits,
+// and are done in doubles otherwise. Numbers compare, hash and print by
+// value.
+//
+// The unboxed fast paths (the expressions TypeInference proves numeric,
+// run by the tree walker, the closure engine and the JIT) compute in
+// doubles, which agree with exact integer arithmetic while every value is
+// below 2^53 in magnitude. Past that an operand unboxes to NaN and a result
+// is checked into NaN, NaN carries through everything after it, and the
+// caller redoes the expression on boxed numbers.
+
+constexpr double exactLimit = 0x1p53;
+
+// Asking a std::any for a type it does not hold costs an indirect call, so
+// these look for an integer first, and for a double only once they know
+// the value is not one.
+
+inline bool isNumber(const std::any &value) {
+  return std::any_cast<int64_t>(&value) != nullptr || std::any_cast<double>(&value) != nullptr;
+}
+
+// the number a double stands for, held as an integer if it is one
+inline std::any boxNumber(double value) {
+  if (value >= -0x1p63 && value < 0x1p63) {
+    int64_t integer = static_cast<int64_t>(value);
+    if (static_cast<double>(integer) == value)
+      return integer;
+  }
+  return value;
+}
+
+// the nearest double; callers have checked that `number` is one
+inline double toDouble(const std::any &number) {
+  if (const int64_t *integer = std::any_cast<int64_t>(&number))
+    return static_cast<double>(*integer);
+  return *std::any_cast<double>(&number);
+}
+
+// A value looked at once as a number: the integer it holds, the double it
+// holds, or neither.
+struct NumberView {
+  const int64_t *integer;
+  const double *real;
+
+  explicit NumberView(const std::any &value)
+      : integer { std::any_cast<int64_t>(&value) }, real { integer != nullptr ? nullptr : std::any_cast<double>(&value) } {}
+
+  bool valid() const { return integer != nullptr || real != nullptr; }
+  double toDouble() const { return integer != nullptr ? static_cast<double>(*integer) : *real; }
+};
+
+// a number for the unboxed paths, NaN if it is an integer doubles cannot
+// hold exactly
+inline double unboxNumber(const std::any &number) {
+  if (const int64_t *integer = std::any_cast<int64_t>(&number))
+    return *integer > -exactLimit && *integer < exactLimit ? static_cast<double>(*integer) : NAN;
+  return *std::any_cast<double>(&number);
+}
+
+// an unboxed result, NaN if it is too big to be exact
+inline double checked(double value) {
+  return std::fabs(value) < exactLimit ? value : NAN;
+}
+
+// Arithmetic exact where both operands are integers. The result is empty
+// where an operand is not a number, for the caller to report.
+inline std::any addNumbers(const std::any &a, const std::any &b) {
+  NumberView x { a }, y { b };
+  int64_t result;
+  if (x.integer != nullptr && y.integer != nullptr && !__builtin_add_overflow(*x.integer, *y.integer, &result))
+    return result;
+  if (!x.valid() || !y.valid())
+    return {};
+  return boxNumber(x.toDouble() + y.toDouble());
+}
+inline std::any subtractNumbers(const std::any &a, const std::any &b) {
+  NumberView x { a }, y { b };
+  int64_t result;
+  if (x.integer != nullptr && y.integer != nullptr && !__builtin_sub_overflow(*x.integer, *y.integer, &result))
+    return result;
+  if (!x.valid() || !y.valid())
+    return {};
+  return boxNumber(x.toDouble() - y.toDouble());
+}
+inline std::any multiplyNumbers(const std::any &a, const std::any &b) {
+  NumberView x { a }, y { b };
+  int64_t result;
+  if (x.integer != nullptr && y.integer != nullptr && !__builtin_mul_overflow(*x.integer, *y.integer, &result))
+    return result;
+  if (!x.valid() || !y.valid())
+    return {};
+  return boxNumber(x.toDouble() * y.toDouble());
+}
+// `b` must not be zero
+std::any divideNumbers(const std::any &a, const std::any &b);
+std::any negateNumber(const std::any &a);
+
+// exact even between an integer and a double; unordered if either is NaN
+// or not a number
+std::partial_ordering compareNumbers(const std::any &a, const std::any &b);
+
+std::string formatNumber(const std::any &number);
+size_t hashNumber(const std::any &number);
@@ -0,0 +1,418 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+#include "Parallel.hpp"
+#include "Diagnostics.hpp"
+#include "LazyParse.hpp"
+#include "LoxFunction.hpp"
+#include "LoxMap.hpp"
+#include "LoxNative.hpp"
+#include "LoxString.hpp"
+#include "MemoryStats.hpp"
+
+namespace {
+  // natives that only read their arguments and return new values; foreign
+  // functions and files may be named like one but do anything
+  bool isPureNative(const LoxNative &native) {
+    static const std::unordered_set<std::string_view> names {
+      "len", "sum", "dot", "scale", "mapAdd", "min", "max", "has", "keys", "values",
+    };
+    return typeid(native) == typeid(LoxNative) && names.contains(native.name);
+  }
+
+  // Walks the bodies of a function and the global functions it calls,
+  // finishing any that were preparsed, and collects the values they read
+  // from outside themselves.
+  class PurityCheck : public ExprVisitor, public StmtVisitor {
+  public:
+    std::vector<std::any> shared;
+
+    bool check(LoxFunction &function) {
+      if (function.initializer())
+        return false;
+      Function &declaration = *function.getDeclaration();
+      if (!checked.insert(&declaration).second)
+        return true;
+      Diagnostics diagnostics;
+      // a body that does not resolve is reported by the serial call
+      if (!ensureResolved(declaration, diagnostics))
+        return false;
+      Environment *outer = closure;
+      closure = function.getClosure().get();
+      for (std::shared_ptr<Stmt> &stmt : declaration.body)
+        visit(stmt);
+      closure = outer;
+      return pure;
+    }
+
+    std::any visitAssignExpr(Assign &expr) override {
+      if (expr.local < 0)
+        pure = false;
+      return visit(expr.value);
+    }
+    std::any visitGroupingExpr(Grouping &expr) override {
+      return visit(expr.expr);
+    }
+    std::any visitBinaryExpr(Binary &expr) override {
+      visit(expr.left);
+      return visit(expr.right);
+    }
+    std::any visitCallExpr(Call &expr) override {
+      Variable *callee = dynamic_cast<Variable*>(expr.callee.get());
+      std::any value;
+      if (callee == nullptr || callee->local >= 0 || !lookup(callee->name.lexeme, value)
+          || value.type() != typeid(std::shared_ptr<LoxCallable>)) {
+        pure = false;
+      } else {
+        LoxCallable *function = std::any_cast<std::shared_ptr<LoxCallable>&>(value).get();
+        if (LoxNative *native = dynamic_cast<LoxNative*>(function))
+          pure = pure && isPureNative(*native);
+        else if (LoxFunction *called = dynamic_cast<LoxFunction*>(function))
+          pure = pure && check(*called);
+        else
+          pure = false;
+      }
+      for (std::shared_ptr<Expr> &argument : expr.arguments)
+        visit(argument);
+      return nullptr;
+    }
+    // properties go through the caches in the tree and may grow shapes
+    std::any visitGetExpr(Get &expr) override {
+      pure = false;
+      return nullptr;
+    }
+    std::any visitSetExpr(Set &expr) override {
+      pure = false;
+      return nullptr;
+    }
+    std::any visitThisExpr(This &expr) override {
+      pure = false;
+      return nullptr;
+    }
+    std::any visitSuperExpr(Super &expr) override {
+      pure = false;
+      return nullptr;
+    }
+    std::any visitArrayLiteralExpr(ArrayLiteral &expr) override {
+      for (std::shared_ptr<Expr> &element : expr.elements)
+        visit(element);
+      return nullptr;
+    }
+    std::any visitMapLiteralExpr(MapLiteral &expr) override {
+      for (size_t i = 0; i < expr.keys.size(); ++i) {
+        visit(expr.keys[i]);
+        visit(expr.values[i]);
+      }
+      return nullptr;
+    }
+    std::any visitIndexExpr(Index &expr) override {
+      visit(expr.object);
+      return visit(expr.index);
+    }
+    std::any visitIndexSetExpr(IndexSet &expr) override {
+      pure = false;
+      return nullptr;
+    }
+    std::any visitLiteralExpr(Literal &expr) override {
+      return nullptr;
+    }
+    std::any visitLogicalExpr(Logical &expr) override {
+      visit(expr.left);
+      return visit(expr.right);
+    }
+    std::any visitUnaryExpr(Unary &expr) override {
+      return visit(expr.right);
+    }
+    std::any visitVariableExpr(Variable &expr) override {
+      std::any value;
+      if (expr.local < 0 && lookup(expr.name.lexeme, value))
+        shared.push_back(std::move(value));
+      return nullptr;
+    }
+
+    std::any visitBlockStmt(Block &stmt) override {
+      for (std::shared_ptr<Stmt> &statement : stmt.statements)
+        visit(statement);
+      return nullptr;
+    }
+    std::any visitVarStmt(Var &stmt) override {
+      if (stmt.initializer != nullptr)
+        visit(stmt.initializer);
+      return nullptr;
+    }
+    std::any visitWhileStmt(While &stmt) override {
+      visit(stmt.condition);
+      return visit(stmt.body);
+    }
+    std::any visitForStmt(For &stmt) override {
+      if (stmt.initializer != nullptr)
+        visit(stmt.initializer);
+      visit(stmt.condition);
+      visit(stmt.body);
+      if (stmt.increment != nullptr)
+        visit(stmt.increment);
+      return nullptr;
+    }
+    std::any visitExpressionStmt(Expression &stmt) override {
+      return visit(stmt.expr);
+    }
+    std::any visitFunctionStmt(Function &stmt) override {
+      pure = false;
+      return nullptr;
+    }
+    std::any visitClassStmt(Class &stmt) override {
+      pure = false;
+      return nullptr;
+    }
+    std::any visitIfStmt(If &stmt) override {
+      visit(stmt.condition);
+      visit(stmt.thenBranch);
+      if (stmt.elseBranch != nullptr)
+        visit(stmt.elseBranch);
+      return nullptr;
+    }
+    std::any visitPrintStmt(Print &stmt) override {
+      pure = false;
+      return nullptr;
+    }
+    std::any visitReturnStmt(Return &stmt) override {
+      if (stmt.value != nullptr)
+        visit(stmt.value);
+      return nullptr;
+    }
+
+  private:
+    std::unordered_set<const Function*> checked;
+    Environment *closure { nullptr };
+    bool pure { true };
+
+    std::any visit(std::shared_ptr<Expr> &expr) {
+      if (pure)
+        expr->accept(*this);
+      return nullptr;
+    }
+    std::any visit(std::shared_ptr<Stmt> &stmt) {
+      if (pure)
+        stmt->accept(*this);
+      return nullptr;
+    }
+    bool lookup(const StringRef &name, std::any &value) {
+      int depth = closure->depthOf(name);
+      if (depth < 0)
+        return false;
+      value = closure->getAt(depth, name);
+      return true;
+    }
+  };
+
+  // Strings flatten and cache their hash the first time they are read,
+  // which would race between threads; doing it up front for every string
+  // the threads can reach leaves them nothing to write.
+  void freeze(const std::any &value, std::unordered_set<const void*> &seen) {
+    if (value.type() == typeid(StringRef)) {
+      std::any_cast<const StringRef&>(value)->hash();
+    } else if (value.type() == typeid(ArrayRef)) {
+      const LoxArray &array = *std::any_cast<const ArrayRef&>(value);
+      if (array.isPacked() || !seen.insert(&array).second)
+        return;
+      for (size_t i = 0; i < array.size(); ++i)
+        freeze(array.get(i), seen);
+    } else if (value.type() == typeid(MapRef)) {
+      const LoxMap &map = *std::any_cast<const MapRef&>(value);
+      if (!seen.insert(&map).second)
+        return;
+      for (const LoxMap::Entry &entry : map.entries()) {
+        if (entry.live) {
+          freeze(entry.key, seen);
+          freeze(entry.value, seen);
+        }
+      }
+    }
+  }
+
+  // the function if it can run on several threads at once, else null
+  LoxFunction *parallelizable(Interpreter &interpreter, const LoxArray &array, std::shared_ptr<LoxCallable> &function) {
+    LoxFunction *lox = dynamic_cast<LoxFunction*>(function.get());
+    if (lox == nullptr || interpreter.profiler != nullptr || interpreter.stats != nullptr)
+      return nullptr;
+    PurityCheck purity;
+    if (!purity.check(*lox))
+      return nullptr;
+    std::unordered_set<const void*> seen;
+    for (const std::any &value : purity.shared)
+      freeze(value, seen);
+    if (!array.isPacked()) {
+      for (size_t i = 0; i < array.size(); ++i)
+        freeze(array.get(i), seen);
+    }
+    return lox;
+  }
+
+  // parallelReduce folds the array in pieces of this many elements, so the
+  // order the function is applied in depends on the length alone
+  constexpr size_t reducePiece = 1024;
+  // a chunk makes at least this many calls, or handing it to another
+  // thread costs more than it saves
+  constexpr size_t minChunkCalls = 1024;
+
+  // how many chunks `calls` calls of the function are worth cutting into;
+  // one means running serially on the calling interpreter
+  size_t chunkCount(size_t calls) {
+    return std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), calls / minChunkCalls);
+  }
+
+  // One thread per hardware thread, started on the first parallel call and
+  // kept for the next, each with an Interpreter that lives as long as it.
+  // Only one call runs on the pool at a time.
+  class WorkerPool {
+  public:
+    using Task = std::function<void(Interpreter&, size_t)>;
+
+    // The pool is never destroyed, as its threads may still be waiting at
+    // exit. A forked child has none of its parent's threads, so it starts
+    // a pool of its own.
+    static WorkerPool &get() {
+      static WorkerPool *pool { nullptr };
+      static pid_t owner { 0 };
+      if (pool == nullptr || owner != getpid()) {
+        pool = new WorkerPool(std::max(1u, std::thread::hardware_concurrency()));
+        owner = getpid();
+      }
+      return *pool;
+    }
+
+    // runs task(interpreter, worker) on the first `count` workers and waits
+    // until all of them are done; the task must not throw
+    void run(size_t count, const Task &task) {
+      std::unique_lock<std::mutex> lock(mutex);
+      this->task = &task;
+      this->count = count;
+      pending = count;
+      ++generation;
+      wake.notify_all();
+      done.wait(lock, [this] { return pending == 0; });
+      this->task = nullptr;
+    }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const Task *task { nullptr };
+    size_t count { 0 };
+    size_t pending { 0 };
+    uint64_t generation { 0 };
+
+    explicit WorkerPool(size_t threads) {
+      for (size_t worker = 0; worker < threads; ++worker)
+        std::thread(&WorkerPool::loop, this, worker).detach();
+    }
+
+    void loop(size_t worker) {
+      Interpreter interpreter;
+      // the interpreter outlives every call, so no caller is handed its bytes
+      MemoryStats::take();
+      uint64_t seen = 0;
+      std::unique_lock<std::mutex> lock(mutex);
+      while (true) {
+        wake.wait(lock, [&] { return generation != seen; });
+        seen = generation;
+        if (worker >= count)
+          continue;
+        const Task &work = *task;
+        lock.unlock();
+        work(interpreter, worker);
+        lock.lock();
+        if (--pending == 0)
+          done.notify_one();
+      }
+    }
+  };
+
+  // Runs work(interpreter, begin, end, chunk) over `chunks` contiguous
+  // chunks of [0, size), each on a worker of the pool. The first error a
+  // chunk threw, in chunk order, is rethrown once all of them are done.
+  template<typename Work>
+  void runChunks(size_t size, size_t chunks, Work work) {
+    std::vector<std::exception_ptr> errors(chunks);
+    std::vector<MemoryStats::Tally> tallies(chunks);
+    WorkerPool::get().run(chunks, [&](Interpreter &interpreter, size_t chunk) {
+      try {
+        work(interpreter, size * chunk / chunks, size * (chunk + 1) / chunks, chunk);
+      } catch (...) {
+        errors[chunk] = std::current_exception();
+      }
+      tallies[chunk] = MemoryStats::take();
+    });
+    for (MemoryStats::Tally &tally : tallies)
+      MemoryStats::absorb(tally);
+    for (std::exception_ptr &error : errors) {
+      if (error)
+        std::rethrow_exception(error);
+    }
+  }
+}
+
+std::any parallelMap(Interpreter &interpreter, LoxArray &array, std::shared_ptr<LoxCallable> &function) {
+  if (function->arity() != 1)
+    throw NativeError("Function must take one argument.");
+  ArrayRef result = LoxArray::create();
+  size_t chunks = chunkCount(array.size());
+  LoxFunction *lox = chunks > 1 ? parallelizable(interpreter, array, function) : nullptr;
+  if (lox == nullptr) {
+    for (size_t i = 0; i < array.size(); ++i)
+      result->push(function->call(interpreter, { array.get(i) }));
+    return result;
+  }
+
+  std::vector<std::any> mapped(array.size());
+  runChunks(array.size(), chunks, [&](Interpreter &worker, size_t begin, size_t end, size_t) {
+    for (size_t i = begin; i < end; ++i)
+      mapped[i] = lox->call(worker, { array.get(i) });
+  });
+  for (std::any &value : mapped)
+    result->push(std::move(value));
+  return result;
+}
+
+std::any parallelReduce(Interpreter &interpreter, LoxArray &array, std::shared_ptr<LoxCallable> &function,
+    const std::any &initial) {
+  if (function->arity() != 2)
+    throw NativeError("Function must take two arguments.");
+  size_t pieces = (array.size() + reducePiece - 1) / reducePiece;
+  std::vector<std::any> folded(pieces);
+  auto fold = [&](Interpreter &worker, LoxCallable &callee, size_t piece) {
+    size_t begin = piece * reducePiece;
+    size_t end = std::min(array.size(), begin + reducePiece);
+    std::any value = piece == 0 ? initial : array.get(begin);
+    for (size_t i = piece == 0 ? begin : begin + 1; i < end; ++i)
+      value = callee.call(worker, { value, array.get(i) });
+    folded[piece] = std::move(value);
+  };
+
+  size_t chunks = std::min(pieces, chunkCount(array.size()));
+  LoxFunction *lox = chunks > 1 ? parallelizable(interpreter, array, function) : nullptr;
+  if (lox == nullptr) {
+    for (size_t piece = 0; piece < pieces; ++piece)
+      fold(interpreter, *function, piece);
+  } else {
+    runChunks(pieces, chunks, [&](Interpreter &worker, size_t begin, size_t end, size_t) {
+      for (size_t piece = begin; piece < end; ++piece)
+        fold(worker, *lox, piece);
+    });
+  }
+  if (pieces == 0)
+    return initial;
+  std::any result = std::move(folded[0]);
+  for (size_t piece = 1; piece < pieces; ++piece)
+    result = function->call(interpreter, { result, folded[piece] });
+  return result;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <any>
+#include <memory>
+#include "Interpreter.hpp"
+#include "LoxArray.hpp"
+#include "LoxCallable.hpp"
+
+// Data-parallel natives. The array is cut into one contiguous chunk per
+// hardware thread, and every chunk runs on a thread of a pool kept between
+// calls, each with its own Interpreter, calling the function over a heap
+// nothing is changing. An array too small to give every chunk about a
+// thousand calls runs serially instead.
+//
+// That holds only for a function that changes nothing the other chunks
+// can see, so the function is checked first. Its body, and those of the
+// global functions it calls, may assign only their own locals, and may not
+// print, declare functions or classes, use properties or assign to an
+// index; the only natives they may call are those that build new values
+// instead of changing old ones. Any other function runs serially on the
+// calling interpreter, as does everything while the profiler or execution
+// statistics are on.
+//
+// Both throw NativeError if `function` takes the wrong number of arguments.
+std::any parallelMap(Interpreter &interpreter, LoxArray &array, std::shared_ptr<LoxCallable> &function);
+// Folds the array in pieces of 1024 elements, the first from `initial` and
+// the others from their first element, then folds the piece results in
+// order. The grouping depends only on the length of the array, not on the
+// machine or on whether the function can run in parallel, and is the same
+// as a serial left fold from `initial` for a function that is associative
+// or an array of at most one piece.
+std::any parallelReduce(Interpreter &interpreter, LoxArray &array, std::shared_ptr<LoxCallable> &function,
+  const std::any &initial);
@@ -1,180 +1,305 @@
+#pragma once
 #include "Stmt.hpp"
 #include "Expr.hpp"
 #include "Token.hpp"
 #include "TokenType.hpp"
+#include <array>
+#include <expected>
 #include <vector>
-#include "error.hpp"
-#include <stdexcept>
+#include "Diagnostics.hpp"
+#include "MemoryStats.hpp"
 #include <sstream>
 
+// Recursive descent parser. Errors are recorded in the Diagnostics and
+// unwind as an unexpected Result up to the enclosing declaration, which
+// skips to the next statement and carries on.
+//
+// When preparsing, the bodies of functions and methods declared at the top
+// level are parsed, so their syntax errors are found up front, but marked
+// deferred: ensureResolved() (LazyParse.hpp) resolves and analyzes them on
+// first use.
 struct Parser {
-  std::vector<Token> tokens;
+  const std::vector<Token> &tokens;
   int current { 0 };
+  Diagnostics &diagnostics;
+  bool preparse { false };
+  // blocks and function bodies the parser is inside
+  int depth { 0 };
 
-  struct ParseError : std::runtime_error {
-    ParseError() : std::runtime_error("") {}
+  // the message is already in the Diagnostics
+  struct ParseError {};
+  template<typename T>
+  using Result = std::expected<T, ParseError>;
+
+  // the tokens must outlive the parser, though not the tree it builds
+  Parser(const std::vector<Token> &tokens, Diagnostics &diagnostics, bool preparse = false)
+    : tokens { tokens }, diagnostics { diagnostics }, preparse { preparse } {}
+
+  // AST nodes are allocated through here so they show up in MemoryStats
+  template<typename T, typename... Args>
+  std::shared_ptr<T> node(Args&&... args) {
+    return std::allocate_shared<T>(CountingAllocator<T, MemoryCategory::Ast> {}, std::forward<Args>(args)...);
+  }
+  // Expressions are parsed by precedence climbing over a table with, per
+  // token type, the handler for a token that starts an expression, the
+  // handler for one that follows a left operand, and the binding power of
+  // the latter.
+  enum class Precedence : uint8_t {
+    None,
+    Assignment,
+    Or,
+    And,
+    Equality,
+    Comparison,
+    Term,
+    Factor,
+    Unary,
+    Call,
+  };
+  using Prefix = Result<std::shared_ptr<Expr>> (Parser::*)();
+  using Infix = Result<std::shared_ptr<Expr>> (Parser::*)(std::shared_ptr<Expr> &left);
+  struct Rule {
+    Prefix prefix { nullptr };
+    Infix infix { nullptr };
+    Precedence precedence { Precedence::None };
   };
 
-  Parser(std::vector<Token> &tokens) : tokens { tokens } {}
-  std::shared_ptr<Expr> expression() {
-    return assignment();
+  static const Rule &rule(TokenType type) {
+    static const std::array<Rule, static_cast<size_t>(TokenType::END_OF_LINE) + 1> rules = [] {
+      std::array<Rule, static_cast<size_t>(TokenType::END_OF_LINE) + 1> rules {};
+      auto set = [&](TokenType type, Prefix prefix, Infix infix, Precedence precedence) {
+        rules[static_cast<size_t>(type)] = { prefix, infix, precedence };
+      };
+      set(TokenType::LEFT_PAREN, &Parser::grouping, &Parser::finishCall, Precedence::Call);
+      set(TokenType::DOT, nullptr, &Parser::property, Precedence::Call);
+      set(TokenType::LEFT_BRACKET, &Parser::arrayLiteral, &Parser::index, Precedence::Call);
+      set(TokenType::LEFT_BRACE, &Parser::mapLiteral, nullptr, Precedence::None);
+      set(TokenType::EQUAL, nullptr, &Parser::assignment, Precedence::Assignment);
+      set(TokenType::OR, nullptr, &Parser::logical, Precedence::Or);
+      set(TokenType::AND, nullptr, &Parser::logical, Precedence::And);
+      set(TokenType::BANG_EQUAL, &Parser::missingOperand, &Parser::binary, Precedence::Equality);
+      set(TokenType::EQUAL_EQUAL, &Parser::missingOperand, &Parser::binary, Precedence::Equality);
+      for (TokenType type : { TokenType::GREATER, TokenType::GREATER_EQUAL, TokenType::LESS, TokenType::LESS_EQUAL })
+        set(type, &Parser::missingOperand, &Parser::binary, Precedence::Comparison);
+      set(TokenType::MINUS, &Parser::unary, &Parser::binary, Precedence::Term);
+      set(TokenType::PLUS, &Parser::missingOperand, &Parser::binary, Precedence::Term);
+      set(TokenType::SLASH, &Parser::missingOperand, &Parser::binary, Precedence::Factor);
+      set(TokenType::STAR, &Parser::missingOperand, &Parser::binary, Precedence::Factor);
+      set(TokenType::BANG, &Parser::unary, nullptr, Precedence::None);
+      for (TokenType type : { TokenType::FALSE, TokenType::TRUE, TokenType::NIL, TokenType::NUMBER, TokenType::STRING })
+        set(type, &Parser::literal, nullptr, Precedence::None);
+      set(TokenType::IDENTIFIER, &Parser::variable, nullptr, Precedence::None);
+      set(TokenType::THIS, &Parser::self, nullptr, Precedence::None);
+      set(TokenType::SUPER, &Parser::super, nullptr, Precedence::None);
+      return rules;
+    }();
+    return rules[static_cast<size_t>(type)];
   }
-  std::shared_ptr<Expr> assignment() {
-    std::shared_ptr<Expr> expr = orExpr();
-    if (match(TokenType::EQUAL)) {
-      Token equals = previous();
-      std::shared_ptr<Expr> value = assignment();
 
-      if (Variable* varPtr = dynamic_cast<Variable*>(expr.get())) {
-        Token name = varPtr->name;
-        return std::make_shared<Assign>(name, value);
-      }
-      error(equals, "Invalid assignment target.");
-    }
-    return expr;
+  static Precedence above(Precedence precedence) {
+    return static_cast<Precedence>(static_cast<uint8_t>(precedence) + 1);
   }
-  std::shared_ptr<Expr> orExpr() {
-    std::shared_ptr<Expr> expr = andExpr();
 
-    while (match(TokenType::OR)) {
-      Token op = previous();
-      std::shared_ptr<Expr> right = andExpr();
-      expr = std::make_shared<Logical>(expr, op, right);
-    }
-    return expr;
+  Result<std::shared_ptr<Expr>> expression() {
+    return parsePrecedence(Precedence::Assignment);
   }
 
-  std::shared_ptr<Expr> andExpr() {
-    std::shared_ptr<Expr> expr = equality();
-
-    while (match(TokenType::OR)) {
-      Token op = previous();
-      std::shared_ptr<Expr> right = equality();
-      expr = std::make_shared<Logical>(expr, op, right);
+  // an expression whose operators all bind at least as tightly as `precedence`
+  Result<std::shared_ptr<Expr>> parsePrecedence(Precedence precedence) {
+    const Rule &start = rule(peek().type);
+    // a binary operator missing its left operand gets its own message, but
+    // only where an operand of its level could have started
+    if (start.prefix == nullptr || (start.prefix == &Parser::missingOperand && precedence > start.precedence)) {
+      error(peek(), "Expect expression.");
+      return fail();
+    }
+    advance();
+    Result<std::shared_ptr<Expr>> expr = (this->*start.prefix)();
+    while (expr && precedence <= rule(peek().type).precedence) {
+      Infix infix = rule(peek().type).infix;
+      advance();
+      expr = (this->*infix)(*expr);
     }
     return expr;
   }
 
-  std::shared_ptr<Expr> equality() {
-    if (match(TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL)) {
-      comparison(); // discard
-      error(peek(), "Expect finished expression.");
-      throw ParseError();
-    }
-    std::shared_ptr<Expr> expr = comparison();
-    while (match(TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL)) {
-      Token op = previous();
-      std::shared_ptr<Expr> right = comparison();
-      expr = std::make_shared<Binary>(expr, op, right);
+  Result<std::shared_ptr<Expr>> assignment(std::shared_ptr<Expr> &target) {
+    Token equals = previous();
+    // right-associative: the value may itself be an assignment
+    Result<std::shared_ptr<Expr>> value = parsePrecedence(Precedence::Assignment);
+    if (!value)
+      return value;
+
+    if (Variable* varPtr = dynamic_cast<Variable*>(target.get())) {
+      Token name = varPtr->name;
+      return node<Assign>(name, *value);
     }
-    return expr;
-  }
-  std::shared_ptr<Expr> comparison() {
-    if (match(TokenType::GREATER, TokenType::GREATER_EQUAL, TokenType::LESS, TokenType::LESS_EQUAL)) {
-      term(); // discard
-      error(peek(), "Expect finished expression.");
-      throw ParseError();
+    if (Get* getPtr = dynamic_cast<Get*>(target.get())) {
+      Token name = getPtr->name;
+      return node<Set>(getPtr->object, name, *value);
     }
-    std::shared_ptr<Expr> expr = term();
-    while (match(TokenType::GREATER, TokenType::GREATER_EQUAL, TokenType::LESS, TokenType::LESS_EQUAL)) {
-      Token op = previous();
-      std::shared_ptr<Expr> right = term();
-      expr = std::make_shared<Binary>(expr, op, right);
+    if (Index* indexPtr = dynamic_cast<Index*>(target.get())) {
+      Token bracket = indexPtr->bracket;
+      return node<IndexSet>(indexPtr->object, bracket, indexPtr->index, *value);
     }
-    return expr;
+    error(equals, "Invalid assignment target.");
+    return target;
   }
 
-  std::shared_ptr<Expr> term() {
-    if (match(TokenType::PLUS)) {
-      factor(); // discard
-      error(peek(), "Expect finished expression.");
-      throw ParseError();
-    }
-    std::shared_ptr<Expr> expr = factor();
-    while (match(TokenType::MINUS, TokenType::PLUS)) {
-      Token op = previous();
-      std::shared_ptr<Expr> right = factor();
-      expr = std::make_shared<Binary>(expr, op, right);
-    }
-    return expr;
+  Result<std::shared_ptr<Expr>> logical(std::shared_ptr<Expr> &left) {
+    Token op = previous();
+    Result<std::shared_ptr<Expr>> right = parsePrecedence(above(rule(op.type).precedence));
+    if (!right)
+      return right;
+    return node<Logical>(left, op, *right);
   }
-  
-  std::shared_ptr<Expr> factor() {
-    if (match(TokenType::SLASH, TokenType::STAR)) {
-      unary(); // discard
-      error(peek(), "Expect finished expression.");
-      throw ParseError();
-    }
-    std::shared_ptr<Expr> expr = unary();
-    while (match(TokenType::SLASH, TokenType::STAR)) {
-      Token op = previous();
-      std::shared_ptr<Expr> right = unary();
-      expr = std::make_shared<Binary>(expr, op, right);
-    }
-    return expr;
+
+  Result<std::shared_ptr<Expr>> binary(std::shared_ptr<Expr> &left) {
+    Token op = previous();
+    Result<std::shared_ptr<Expr>> right = parsePrecedence(above(rule(op.type).precedence));
+    if (!right)
+      return right;
+    return node<Binary>(left, op, *right);
   }
-  std::shared_ptr<Expr> unary() {
-    if (match(TokenType::BANG, TokenType::MINUS)) {
-      Token op = previous();
-      std::shared_ptr<Expr> right = unary();
-      return std::make_shared<Unary>(op, right);
-    }
-    return call();
+
+  // a binary operator where an operand should be: the right operand is
+  // parsed for the sake of later errors and dropped
+  Result<std::shared_ptr<Expr>> missingOperand() {
+    if (parsePrecedence(above(rule(previous().type).precedence)))
+      error(peek(), "Expect finished expression.");
+    return fail();
   }
 
-  std::shared_ptr<Expr>call() {
-    std::shared_ptr<Expr> expr = primary();
-    while (true) {
-      if (match(TokenType::LEFT_PAREN))
-        expr = finishCall(expr);
-      else
-        break;
-    }
-    return expr;
+  Result<std::shared_ptr<Expr>> unary() {
+    Token op = previous();
+    Result<std::shared_ptr<Expr>> right = parsePrecedence(Precedence::Unary);
+    if (!right)
+      return right;
+    return node<Unary>(op, *right);
   }
-  
-  std::shared_ptr<Expr>finishCall(std::shared_ptr<Expr> &callee) {
+
+  Result<std::shared_ptr<Expr>> finishCall(std::shared_ptr<Expr> &callee) {
     std::vector<std::shared_ptr<Expr>> args;
     if (!check(TokenType::RIGHT_PAREN)) {
-      args.push_back(expression());
-      while (match(TokenType::COMMA)) {
+      do {
         if (args.size() >= 255)
           error(peek(), "Can't have more than 255 arguments.");
-        args.push_back(expression());
-      }
+        Result<std::shared_ptr<Expr>> arg = expression();
+        if (!arg)
+          return arg;
+        args.push_back(*arg);
+      } while (match(TokenType::COMMA));
     }
-    Token paren = consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
-    return std::make_shared<Call>(callee, paren, args);
-  }
-
-  
-
-  std::shared_ptr<Expr> primary() {
-    if (match(TokenType::FALSE))
-      return std::make_shared<Literal>(false);
-    if (match(TokenType::TRUE))
-      return std::make_shared<Literal>(true);
-    if (match(TokenType::NIL))
-      return std::make_shared<Literal>((void*) nullptr);
-    if (match(TokenType::NUMBER, TokenType::STRING))
-      return std::make_shared<Literal>(previous().literal);
-    if (match(TokenType::IDENTIFIER)) {
-      return std::make_shared<Variable>(previous());
+    Result<Token> paren = consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
+    if (!paren)
+      return fail();
+    return node<Call>(callee, *paren, args);
+  }
+
+  Result<std::shared_ptr<Expr>> property(std::shared_ptr<Expr> &object) {
+    Result<Token> name = consume(TokenType::IDENTIFIER, "Expect property name after '.'.");
+    if (!name)
+      return fail();
+    return node<Get>(object, *name);
+  }
+
+  Result<std::shared_ptr<Expr>> index(std::shared_ptr<Expr> &object) {
+    Token bracket = previous();
+    Result<std::shared_ptr<Expr>> index = expression();
+    if (!index)
+      return index;
+    if (!consume(TokenType::RIGHT_BRACKET, "Expect ']' after index."))
+      return fail();
+    return node<Index>(object, bracket, *index);
+  }
+
+  Result<std::shared_ptr<Expr>> literal() {
+    switch (previous().type) {
+      case TokenType::FALSE: return node<Literal>(false, previous().line);
+      case TokenType::TRUE: return node<Literal>(true, previous().line);
+      case TokenType::NIL: return node<Literal>((void*) nullptr, previous().line);
+      default: return node<Literal>(previous().literal, previous().line);
     }
-    if (match(TokenType::LEFT_PAREN)) {
-      std::shared_ptr<Expr> expr = expression();
-      consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
-      return std::make_shared<Grouping>(expr);
+  }
+
+  Result<std::shared_ptr<Expr>> variable() {
+    return node<Variable>(previous());
+  }
+
+  Result<std::shared_ptr<Expr>> self() {
+    return node<This>(previous());
+  }
+
+  Result<std::shared_ptr<Expr>> super() {
+    Token keyword = previous();
+    if (!consume(TokenType::DOT, "Expect '.' after 'super'."))
+      return fail();
+    Result<Token> method = consume(TokenType::IDENTIFIER, "Expect superclass method name.");
+    if (!method)
+      return fail();
+    return node<Super>(keyword, *method);
+  }
+
+  Result<std::shared_ptr<Expr>> grouping() {
+    Result<std::shared_ptr<Expr>> expr = expression();
+    if (!expr)
+      return expr;
+    if (!consume(TokenType::RIGHT_PAREN, "Expect ')' after expression."))
+      return fail();
+    return node<Grouping>(*expr);
+  }
+
+  Result<std::shared_ptr<Expr>> arrayLiteral() {
+    Token bracket = previous();
+    std::vector<std::shared_ptr<Expr>> elements;
+    if (!check(TokenType::RIGHT_BRACKET)) {
+      do {
+        Result<std::shared_ptr<Expr>> element = expression();
+        if (!element)
+          return element;
+        elements.push_back(*element);
+      } while (match(TokenType::COMMA));
     }
-    error(peek(), "Expect expression.");
-    throw ParseError();
+    if (!consume(TokenType::RIGHT_BRACKET, "Expect ']' after array elements."))
+      return fail();
+    return node<ArrayLiteral>(bracket, elements);
   }
 
-  Token consume(TokenType type, std::string message) {
+  // a statement starting with '{' is a block, so here it is a map
+  Result<std::shared_ptr<Expr>> mapLiteral() {
+    Token brace = previous();
+    std::vector<std::shared_ptr<Expr>> keys;
+    std::vector<std::shared_ptr<Expr>> values;
+    if (!check(TokenType::RIGHT_BRACE)) {
+      do {
+        Result<std::shared_ptr<Expr>> key = expression();
+        if (!key)
+          return key;
+        if (!consume(TokenType::COLON, "Expect ':' after map key."))
+          return fail();
+        Result<std::shared_ptr<Expr>> value = expression();
+        if (!value)
+          return value;
+        keys.push_back(*key);
+        values.push_back(*value);
+      } while (match(TokenType::COMMA));
+    }
+    if (!consume(TokenType::RIGHT_BRACE, "Expect '}' after map entries."))
+      return fail();
+    return node<MapLiteral>(brace, keys, values);
+  }
+
+  Result<Token> consume(TokenType type, std::string message) {
     if (check(type)) 
       return advance();
     error(peek(), message);
-    throw ParseError();
+    return fail();
+  }
+  void error(const Token &token, std::string message) {
+    diagnostics.error(token, std::move(message));
+  }
+  std::unexpected<ParseError> fail() {
+    return std::unexpected(ParseError {});
   }
  
   template<typename... Args>
@@ -191,7 +316,7 @@ struct Parser {
     if (isAtEnd()) return false;
     return peek().type == type;
   }
-  Token advance() {
+  const Token &advance() {
     if (!isAtEnd())
       current++;
     return previous();
@@ -199,10 +324,10 @@ struct Parser {
   bool isAtEnd() {
     return peek().type == TokenType::END_OF_LINE;
   }
-  Token peek() {
+  const Token &peek() {
     return tokens[current];
   }
-  Token previous() {
+  const Token &previous() {
     return tokens[current - 1];
   }
   void synchronize() {
@@ -231,7 +356,7 @@ struct Parser {
       statements.push_back(declaration());
     return statements;
   }
-  std::shared_ptr<Stmt> statement() {
+  Result<std::shared_ptr<Stmt>> statement() {
     if (match(TokenType::IF)) 
       return ifStatement();
     if (match(TokenType::PRINT)) 
@@ -243,144 +368,220 @@ struct Parser {
     if (match(TokenType::FOR))
       return forStatement();
     if (match(TokenType::LEFT_BRACE)) {
-      std::vector<std::shared_ptr<Stmt>> stmt = block();
-      return std::make_shared<Block>(stmt);
+      Result<std::vector<std::shared_ptr<Stmt>>> stmt = block();
+      if (!stmt)
+        return fail();
+      return node<Block>(*stmt);
     }
     return expressionStatement();
   }
-  std::shared_ptr<Stmt> printStatement() {
-    std::shared_ptr<Expr> value = expression();
-    consume(TokenType::SEMICOLON, "Expect ';' after value.");
-    return std::make_shared<Print>(value);
+  Result<std::shared_ptr<Stmt>> printStatement() {
+    Result<std::shared_ptr<Expr>> value = expression();
+    if (!value || !consume(TokenType::SEMICOLON, "Expect ';' after value."))
+      return fail();
+    return node<Print>(*value);
   }
-  std::shared_ptr<Stmt> returnStatement() {
+  Result<std::shared_ptr<Stmt>> returnStatement() {
     Token keyword = previous();
     std::shared_ptr<Expr> value{ nullptr };
     if (!check(TokenType::SEMICOLON)) {
-      value = expression();
+      Result<std::shared_ptr<Expr>> result = expression();
+      if (!result)
+        return fail();
+      value = *result;
     }
-    consume(TokenType::SEMICOLON, "Expect ';' after return value.");
-    return std::make_shared<Return>(keyword, value);
-  }
-  std::shared_ptr<Stmt> whileStatement() {
-    consume(TokenType::LEFT_PAREN, "Expect '(' after if.");
-    std::shared_ptr<Expr> condition = expression();
-    consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
-    std::shared_ptr<Stmt> body { statement() };
-    return std::make_shared<While>(condition, body);
-  }
-  std::shared_ptr<Stmt> forStatement() {
-    consume(TokenType::LEFT_PAREN, "Expect '(' after if.");
+    if (!consume(TokenType::SEMICOLON, "Expect ';' after return value."))
+      return fail();
+    return node<Return>(keyword, value);
+  }
+  Result<std::shared_ptr<Stmt>> whileStatement() {
+    if (!consume(TokenType::LEFT_PAREN, "Expect '(' after if."))
+      return fail();
+    Result<std::shared_ptr<Expr>> condition = expression();
+    if (!condition || !consume(TokenType::RIGHT_PAREN, "Expect ')' after condition."))
+      return fail();
+    Result<std::shared_ptr<Stmt>> body = statement();
+    if (!body)
+      return body;
+    return node<While>(*condition, *body);
+  }
+  Result<std::shared_ptr<Stmt>> forStatement() {
+    int line = previous().line;
+    if (!consume(TokenType::LEFT_PAREN, "Expect '(' after if."))
+      return fail();
     std::shared_ptr<Stmt> initializer;
-    if (match(TokenType::SEMICOLON))
+    if (match(TokenType::SEMICOLON)) {
       initializer = nullptr;
-    else if (match(TokenType::VAR))
-      initializer = varDeclaration();
-    else
-      initializer = expressionStatement();
+    } else {
+      Result<std::shared_ptr<Stmt>> result = match(TokenType::VAR) ? varDeclaration() : expressionStatement();
+      if (!result)
+        return result;
+      initializer = *result;
+    }
 
     std::shared_ptr<Expr> condition = nullptr;
-    if (!check(TokenType::SEMICOLON))
-      condition = expression();
-    consume(TokenType::SEMICOLON, "Expect ';' after loop condition.");
+    if (!check(TokenType::SEMICOLON)) {
+      Result<std::shared_ptr<Expr>> result = expression();
+      if (!result)
+        return fail();
+      condition = *result;
+    }
+    if (!consume(TokenType::SEMICOLON, "Expect ';' after loop condition."))
+      return fail();
 
     std::shared_ptr<Expr> increment = nullptr;
-    if (!check(TokenType::SEMICOLON))
-      increment = expression();
-    consume(TokenType::RIGHT_PAREN, "Expect ')' after loop condition.");
-
-    std::shared_ptr<Stmt> body = statement();
-    if (increment != nullptr) {
-      std::vector<std::shared_ptr<Stmt>> blockStatements;
-      blockStatements.push_back(std::move(body));
-      blockStatements.push_back(std::make_shared<Expression>(increment));
-      body = std::make_shared<Block>(blockStatements);
+    if (!check(TokenType::RIGHT_PAREN)) {
+      Result<std::shared_ptr<Expr>> result = expression();
+      if (!result)
+        return fail();
+      increment = *result;
     }
+    if (!consume(TokenType::RIGHT_PAREN, "Expect ')' after loop condition."))
+      return fail();
 
+    Result<std::shared_ptr<Stmt>> result = statement();
+    if (!result)
+      return result;
+    std::shared_ptr<Stmt> body = *result;
     if (condition == nullptr)
-      condition = std::make_shared<Literal>(true);
-    
-    body = std::make_shared<While>(condition, body);
-
-    if (initializer != nullptr) {
-      std::vector<std::shared_ptr<Stmt>> blockStatements;
-      blockStatements.push_back(std::move(initializer));
-      blockStatements.push_back(std::move(body));
-      body = std::make_shared<Block>(blockStatements);
-    }
-
-    return body;
-  }
-  std::shared_ptr<Stmt> ifStatement() {
-    consume(TokenType::LEFT_PAREN, "Expect '(' after if.");
-    std::shared_ptr<Expr> condition = expression();
-    consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
-    std::shared_ptr<Stmt> thenBranch { statement() };
+      condition = node<Literal>(true, line);
+    return node<For>(initializer, condition, increment, body);
+  }
+  Result<std::shared_ptr<Stmt>> ifStatement() {
+    if (!consume(TokenType::LEFT_PAREN, "Expect '(' after if."))
+      return fail();
+    Result<std::shared_ptr<Expr>> condition = expression();
+    if (!condition || !consume(TokenType::RIGHT_PAREN, "Expect ')' after condition."))
+      return fail();
+    Result<std::shared_ptr<Stmt>> thenBranch = statement();
+    if (!thenBranch)
+      return thenBranch;
     std::shared_ptr<Stmt> elseBranch { nullptr };
-    if (match(TokenType::ELSE))
-        elseBranch = statement();
-    return std::make_shared<If>(condition, thenBranch, elseBranch);
+    if (match(TokenType::ELSE)) {
+      Result<std::shared_ptr<Stmt>> result = statement();
+      if (!result)
+        return result;
+      elseBranch = *result;
+    }
+    return node<If>(*condition, *thenBranch, elseBranch);
   }
-  std::shared_ptr<Stmt> expressionStatement() {
-    std::shared_ptr<Expr> value = expression();
-    consume(TokenType::SEMICOLON, "Expect ';' after value.");
-    return std::make_shared<Expression>(value);
+  Result<std::shared_ptr<Stmt>> expressionStatement() {
+    Result<std::shared_ptr<Expr>> value = expression();
+    if (!value || !consume(TokenType::SEMICOLON, "Expect ';' after value."))
+      return fail();
+    return node<Expression>(*value);
   }
+  // never fails: after an error it skips ahead and yields null
   std::shared_ptr<Stmt> declaration() {
-    try {
-      if (match(TokenType::FUN)) 
-        return function("function");
-      if (match(TokenType::VAR)) 
-        return varDeclaration();
-      return statement();
-    } catch (ParseError error) {
-      synchronize();
-      return nullptr;
+    Result<std::shared_ptr<Stmt>> result;
+    if (match(TokenType::CLASS))
+      result = classDeclaration();
+    else if (match(TokenType::FUN)) 
+      result = function("function");
+    else if (match(TokenType::VAR)) 
+      result = varDeclaration();
+    else
+      result = statement();
+    if (result)
+      return *result;
+    synchronize();
+    return nullptr;
+  }
+
+  Result<std::shared_ptr<Stmt>> classDeclaration() {
+    Result<Token> name = consume(TokenType::IDENTIFIER, "Expect class name.");
+    if (!name)
+      return fail();
+    std::shared_ptr<Expr> superclass { nullptr };
+    if (match(TokenType::LESS)) {
+      if (!consume(TokenType::IDENTIFIER, "Expect superclass name."))
+        return fail();
+      superclass = node<Variable>(previous());
     }
+    if (!consume(TokenType::LEFT_BRACE, "Expect '{' before class body."))
+      return fail();
+
+    std::vector<std::shared_ptr<Function>> methods;
+    while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
+      Result<std::shared_ptr<Stmt>> method = function("method");
+      if (!method)
+        return method;
+      methods.push_back(std::static_pointer_cast<Function>(*method));
+      methods.back()->isMethod = true;
+      methods.back()->hasSuperclass = superclass != nullptr;
+    }
+    if (!consume(TokenType::RIGHT_BRACE, "Expect '}' after class body."))
+      return fail();
+    return node<Class>(*name, superclass, methods);
   }
 
-  std::shared_ptr<Stmt> function(std::string_view kind) {
+  Result<std::shared_ptr<Stmt>> function(std::string_view kind) {
     std::ostringstream oss{};
     oss << "Expect " << kind << " name.";
-    Token name = consume(TokenType::IDENTIFIER, oss.str());
+    Result<Token> name = consume(TokenType::IDENTIFIER, oss.str());
+    if (!name)
+      return fail();
 
     oss.str("");
     oss << "Expect '(' after " << kind << " name.";
-    consume(TokenType::LEFT_PAREN, oss.str());
+    if (!consume(TokenType::LEFT_PAREN, oss.str()))
+      return fail();
 
     std::vector<Token> parameters{};
     if (!check(TokenType::RIGHT_PAREN)) {
-      parameters.push_back(consume(TokenType::IDENTIFIER, "Expect parameter name."));
-      while (match(TokenType::COMMA)) {
+      do {
         if (parameters.size() >= 255)
           error(peek(), "Can't have more than 255 parameters.");
-        parameters.push_back(consume(TokenType::IDENTIFIER, "Expect parameter name."));
-      }
+        Result<Token> parameter = consume(TokenType::IDENTIFIER, "Expect parameter name.");
+        if (!parameter)
+          return fail();
+        parameters.push_back(*parameter);
+      } while (match(TokenType::COMMA));
     }
-    consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters.");
+    if (!consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters."))
+      return fail();
 
     oss.str("");
     oss << "Expect '{' before " << kind << " body.";
-    consume(TokenType::LEFT_BRACE, oss.str());
+    if (!consume(TokenType::LEFT_BRACE, oss.str()))
+      return fail();
 
-    std::vector<std::shared_ptr<Stmt>> body = block();
-    return std::make_shared<Function>(name, parameters, body);
+    // nested functions may capture the locals around them, which only a
+    // resolver walking the enclosing body can tell, so they are resolved
+    // along with it
+    bool deferred = preparse && depth == 0;
+    Result<std::vector<std::shared_ptr<Stmt>>> body = block();
+    if (!body)
+      return fail();
+    std::shared_ptr<Function> function = node<Function>(*name, parameters, *body);
+    function->deferred = deferred;
+    return function;
   }
 
-  std::shared_ptr<Stmt> varDeclaration() {
-    Token name = consume(TokenType::IDENTIFIER, "Expect variable name.");
+  Result<std::shared_ptr<Stmt>> varDeclaration() {
+    Result<Token> name = consume(TokenType::IDENTIFIER, "Expect variable name.");
+    if (!name)
+      return fail();
     std::shared_ptr<Expr> initializer = nullptr;
-    if (match(TokenType::EQUAL))
-      initializer = expression();
-    consume(TokenType::SEMICOLON, "Expect ';' after variable declaration.");
-    return std::make_shared<Var>(name, initializer);
+    if (match(TokenType::EQUAL)) {
+      Result<std::shared_ptr<Expr>> result = expression();
+      if (!result)
+        return fail();
+      initializer = *result;
+    }
+    if (!consume(TokenType::SEMICOLON, "Expect ';' after variable declaration."))
+      return fail();
+    return node<Var>(*name, initializer);
   }
 
-  std::vector<std::shared_ptr<Stmt>> block() {
+  Result<std::vector<std::shared_ptr<Stmt>>> block() {
     std::vector<std::shared_ptr<Stmt>> statements;
+    depth++;
     while (!check(TokenType::RIGHT_BRACE) && !isAtEnd())
       statements.push_back(declaration());
-    consume(TokenType::RIGHT_BRACE, "Expect '}' after block");
+    depth--;
+    if (!consume(TokenType::RIGHT_BRACE, "Expect '}' after block"))
+      return fail();
     return statements;
   }
 };
@@ -0,0 +1,134 @@
+#include <csignal>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/time.h>
+#include "LoxClass.hpp"
+#include "LoxFunction.hpp"
+#include "LoxNative.hpp"
+#include "Profiler.hpp"
+
+namespace {
+  Profiler *active { nullptr };
+
+  // one sample is a depth word followed by that many frame ids
+  constexpr size_t bufferWords = 1 << 20;
+}
+
+Profiler::Profiler(int intervalUs) : intervalUs { intervalUs }, buffer(bufferWords) {}
+
+Profiler::~Profiler() {
+  stop();
+}
+
+void Profiler::start() {
+  if (running)
+    return;
+  active = this;
+  struct sigaction action {};
+  action.sa_handler = onSample;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGPROF, &action, nullptr);
+
+  itimerval timer {};
+  timer.it_interval.tv_usec = intervalUs;
+  timer.it_value.tv_usec = intervalUs;
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  running = true;
+}
+
+void Profiler::stop() {
+  if (!running)
+    return;
+  itimerval timer {};
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  signal(SIGPROF, SIG_IGN);
+  active = nullptr;
+  running = false;
+  drain();
+}
+
+void Profiler::onSample(int) {
+  if (active != nullptr)
+    active->takeSample();
+}
+
+void Profiler::takeSample() {
+  int frames = depth < maxDepth ? depth : maxDepth;
+  std::atomic_signal_fence(std::memory_order_acquire);
+  size_t start = used;
+  if (start + frames + 1 > buffer.size()) {
+    dropped = dropped + 1;
+    flushRequested = 1;
+    return;
+  }
+  buffer[start] = frames;
+  for (int i = 0; i < frames; ++i)
+    buffer[start + 1 + i] = stack[i];
+  used = start + frames + 1;
+  if (static_cast<size_t>(used) > buffer.size() / 2)
+    flushRequested = 1;
+}
+
+void Profiler::drain() {
+  sigset_t block, previous;
+  sigemptyset(&block);
+  sigaddset(&block, SIGPROF);
+  sigprocmask(SIG_BLOCK, &block, &previous);
+
+  size_t i = 0;
+  while (i < static_cast<size_t>(used)) {
+    uint32_t frames = buffer[i];
+    std::vector<uint32_t> sample(buffer.begin() + i + 1, buffer.begin() + i + 1 + frames);
+    stacks[sample]++;
+    i += frames + 1;
+  }
+  used = 0;
+  flushRequested = 0;
+
+  sigprocmask(SIG_SETMASK, &previous, nullptr);
+}
+
+uint32_t Profiler::frameId(LoxCallable &callee, int line) {
+  LoxFunction *function = dynamic_cast<LoxFunction*>(&callee);
+  const void *key = function != nullptr ? static_cast<const void*>(function->getDeclaration().get()) : &callee;
+  auto found = frameIds.find({ key, line });
+  if (found != frameIds.end())
+    return found->second;
+
+  std::ostringstream label;
+  if (function != nullptr) {
+    // keep the node alive so its address is never reused for another key
+    declarations.push_back(function->getDeclaration());
+    label << function->getDeclaration()->name.lexeme->str();
+  } else if (LoxNative *native = dynamic_cast<LoxNative*>(&callee)) {
+    label << native->name;
+  } else if (LoxClass *klass = dynamic_cast<LoxClass*>(&callee)) {
+    label << klass->name->str();
+  } else {
+    label << "<native>";
+  }
+  label << ":" << line;
+
+  uint32_t id = labels.size();
+  labels.push_back(label.str());
+  frameIds[{ key, line }] = id;
+  return id;
+}
+
+bool Profiler::write(const std::string &path) {
+  drain();
+  std::ofstream out(path);
+  if (!out)
+    return false;
+  for (auto &[sample, count] : stacks) {
+    out << "<script>";
+    for (uint32_t id : sample)
+      out << ";" << labels[id];
+    out << " " << count << "\n";
+  }
+  if (dropped > 0)
+    out << "<script>;<dropped> " << dropped << "\n";
+  return static_cast<bool>(out);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "LoxCallable.hpp"
+#include "Stmt.hpp"
+
+// Sampling profiler over Lox call frames. The interpreter pushes a frame
+// id for every call onto a fixed-size shadow stack; a SIGPROF timer copies
+// that stack into a preallocated sample buffer, which the interpreter
+// drains into aggregated stacks outside the signal handler. Output is the
+// folded-stack format understood by flamegraph.pl and speedscope.
+class Profiler {
+public:
+  static constexpr int maxDepth = 256;
+
+  struct Scope {
+    Profiler &profiler;
+    Scope(Profiler &profiler, LoxCallable &callee, int line) : profiler { profiler } {
+      profiler.enter(callee, line);
+    }
+    ~Scope() { profiler.exit(); }
+  };
+
+  explicit Profiler(int intervalUs = 1000);
+  ~Profiler();
+
+  void start();
+  void stop();
+  bool write(const std::string &path);
+
+  void enter(LoxCallable &callee, int line) {
+    if (flushRequested)
+      drain();
+    uint32_t id = frameId(callee, line);
+    if (depth < maxDepth)
+      stack[depth] = id;
+    std::atomic_signal_fence(std::memory_order_release);
+    depth = depth + 1;
+  }
+  void exit() { depth = depth - 1; }
+
+private:
+  static void onSample(int signal);
+  void takeSample();
+  void drain();
+  uint32_t frameId(LoxCallable &callee, int line);
+
+  int intervalUs;
+  bool running { false };
+
+  // written by the interpreter, read by the signal handler
+  uint32_t stack[maxDepth];
+  volatile sig_atomic_t depth { 0 };
+
+  // written by the signal handler, drained by the interpreter
+  std::vector<uint32_t> buffer;
+  volatile sig_atomic_t used { 0 };
+  volatile sig_atomic_t flushRequested { 0 };
+  volatile sig_atomic_t dropped { 0 };
+
+  std::map<std::pair<const void *, int>, uint32_t> frameIds;
+  std::vector<std::string> labels;
+  std::vector<std::shared_ptr<Function>> declarations;
+  std::map<std::vector<uint32_t>, uint64_t> stacks;
+};
@@ -0,0 +1,301 @@
+#include <algorithm>
+#include "Resolver.hpp"
+#include "StringTable.hpp"
+
+void Resolver::resolve(std::vector<std::shared_ptr<Stmt>> &statements) {
+  for (std::shared_ptr<Stmt> &stmt : statements)
+    resolve(stmt);
+}
+
+void Resolver::resolve(std::shared_ptr<Stmt> &stmt) {
+  // the parser leaves null statements behind after a syntax error
+  if (stmt != nullptr)
+    stmt->accept(*this);
+}
+
+void Resolver::resolve(std::shared_ptr<Expr> &expr) {
+  if (expr != nullptr)
+    expr->accept(*this);
+}
+
+int Resolver::declare(const Token &name, Stmt *owner) {
+  if (scopes.empty() || checkingOnly)
+    return -1;
+  int local = names.size();
+  names.push_back(name.lexeme.get());
+  owners.push_back(owner);
+  captured.push_back(false);
+  assigned.push_back(false);
+  scopes.back()[name.lexeme.get()] = local;
+  return local;
+}
+
+bool Resolver::lookup(const LoxString *name, size_t &scope, int &local) {
+  for (size_t i = scopes.size(); i-- > 0;) {
+    auto found = scopes[i].find(name);
+    if (found != scopes[i].end()) {
+      scope = i;
+      local = found->second;
+      return true;
+    }
+  }
+  return false;
+}
+
+int Resolver::reference(const StringRef &name, bool assignment) {
+  size_t scope;
+  int local;
+  if (checkingOnly || !lookup(name.get(), scope, local))
+    return -1;
+  if (assignment) {
+    assigned[local] = true;
+    updateCell(local);
+  }
+  if (scope >= functionScope())
+    return local;
+
+  captured[local] = true;
+  updateCell(local);
+  for (auto function = functions.rbegin(); function != functions.rend() && function->scope > scope; ++function) {
+    std::vector<StringRef> &captures = function->function->captures;
+    if (std::find(captures.begin(), captures.end(), name) == captures.end())
+      captures.push_back(name);
+  }
+  return -1;
+}
+
+void Resolver::updateCell(int local) {
+  Stmt *owner = owners[local];
+  if (!captured[local] || owner == nullptr)
+    return;
+  // a function or class name is captured by its own body before the
+  // declaration binds it, so the closure must share the variable
+  if (Function *function = dynamic_cast<Function*>(owner)) {
+    if (local == function->local)
+      function->cell = true;
+    else if (assigned[local])
+      function->cellParams[local - function->firstParam] = true;
+  } else if (Class *klass = dynamic_cast<Class*>(owner)) {
+    klass->cell = true;
+  } else if (assigned[local]) {
+    static_cast<Var*>(owner)->cell = true;
+  }
+}
+
+std::any Resolver::visitAssignExpr(Assign &expr) {
+  resolve(expr.value);
+  expr.local = reference(expr.name.lexeme, true);
+  if (expr.local < 0 && !functions.empty() && !checkingOnly)
+    assignedFromClosures.insert(expr.name.lexeme.get());
+  return nullptr;
+}
+
+std::any Resolver::visitGroupingExpr(Grouping &expr) {
+  resolve(expr.expr);
+  return nullptr;
+}
+
+std::any Resolver::visitBinaryExpr(Binary &expr) {
+  resolve(expr.left);
+  resolve(expr.right);
+  return nullptr;
+}
+
+std::any Resolver::visitCallExpr(Call &expr) {
+  resolve(expr.callee);
+  for (std::shared_ptr<Expr> &argument : expr.arguments)
+    resolve(argument);
+  return nullptr;
+}
+
+std::any Resolver::visitGetExpr(Get &expr) {
+  resolve(expr.object);
+  return nullptr;
+}
+
+std::any Resolver::visitSetExpr(Set &expr) {
+  resolve(expr.object);
+  resolve(expr.value);
+  return nullptr;
+}
+
+std::any Resolver::visitThisExpr(This &expr) {
+  if (currentClass == ClassType::NONE) {
+    diagnostics.error(expr.keyword, "Can't use 'this' outside of a class.");
+    return nullptr;
+  }
+  reference(StringTable::thisName(), false);
+  return nullptr;
+}
+
+std::any Resolver::visitSuperExpr(Super &expr) {
+  if (currentClass == ClassType::NONE) {
+    diagnostics.error(expr.keyword, "Can't use 'super' outside of a class.");
+    return nullptr;
+  }
+  if (currentClass == ClassType::CLASS) {
+    diagnostics.error(expr.keyword, "Can't use 'super' in a class with no superclass.");
+    return nullptr;
+  }
+  reference(StringTable::superName(), false);
+  reference(StringTable::thisName(), false);
+  return nullptr;
+}
+
+std::any Resolver::visitArrayLiteralExpr(ArrayLiteral &expr) {
+  for (std::shared_ptr<Expr> &element : expr.elements)
+    resolve(element);
+  return nullptr;
+}
+
+std::any Resolver::visitMapLiteralExpr(MapLiteral &expr) {
+  for (size_t i = 0; i < expr.keys.size(); ++i) {
+    resolve(expr.keys[i]);
+    resolve(expr.values[i]);
+  }
+  return nullptr;
+}
+
+std::any Resolver::visitIndexExpr(Index &expr) {
+  resolve(expr.object);
+  resolve(expr.index);
+  return nullptr;
+}
+
+std::any Resolver::visitIndexSetExpr(IndexSet &expr) {
+  resolve(expr.object);
+  resolve(expr.index);
+  resolve(expr.value);
+  return nullptr;
+}
+
+std::any Resolver::visitLiteralExpr(Literal &expr) {
+  return nullptr;
+}
+
+std::any Resolver::visitLogicalExpr(Logical &expr) {
+  resolve(expr.left);
+  resolve(expr.right);
+  return nullptr;
+}
+
+std::any Resolver::visitUnaryExpr(Unary &expr) {
+  resolve(expr.right);
+  return nullptr;
+}
+
+std::any Resolver::visitVariableExpr(Variable &expr) {
+  expr.local = reference(expr.name.lexeme, false);
+  return nullptr;
+}
+
+std::any Resolver::visitBlockStmt(Block &stmt) {
+  scopes.emplace_back();
+  resolve(stmt.statements);
+  scopes.pop_back();
+  return nullptr;
+}
+
+std::any Resolver::visitVarStmt(Var &stmt) {
+  // the initializer still sees any outer variable of the same name
+  resolve(stmt.initializer);
+  stmt.local = declare(stmt.name, &stmt);
+  return nullptr;
+}
+
+std::any Resolver::visitWhileStmt(While &stmt) {
+  resolve(stmt.condition);
+  resolve(stmt.body);
+  return nullptr;
+}
+
+std::any Resolver::visitForStmt(For &stmt) {
+  // the interpreter gives the initializer an environment of its own
+  if (stmt.initializer != nullptr)
+    scopes.emplace_back();
+  resolve(stmt.initializer);
+  resolve(stmt.condition);
+  resolve(stmt.body);
+  resolve(stmt.increment);
+  if (stmt.initializer != nullptr)
+    scopes.pop_back();
+  return nullptr;
+}
+
+std::any Resolver::visitExpressionStmt(Expression &stmt) {
+  resolve(stmt.expr);
+  return nullptr;
+}
+
+std::any Resolver::visitFunctionStmt(Function &stmt) {
+  stmt.local = declare(stmt.name, &stmt);
+  resolveFunction(stmt);
+  return nullptr;
+}
+
+std::any Resolver::visitClassStmt(Class &stmt) {
+  stmt.local = declare(stmt.name, &stmt);
+  if (stmt.superclass != nullptr) {
+    Token &superclass = static_cast<Variable&>(*stmt.superclass).name;
+    if (superclass.lexeme == stmt.name.lexeme)
+      diagnostics.error(superclass, "A class can't inherit from itself.");
+  }
+  resolve(stmt.superclass);
+  for (std::shared_ptr<Function> &method : stmt.methods)
+    resolveFunction(*method);
+  return nullptr;
+}
+
+void Resolver::resolveFunction(Function &stmt) {
+  FunctionType enclosingFunction = currentFunction;
+  ClassType enclosingClass = currentClass;
+  if (stmt.isMethod) {
+    currentClass = stmt.hasSuperclass ? ClassType::SUBCLASS : ClassType::CLASS;
+    currentFunction = stmt.name.lexeme == StringTable::initName() ? FunctionType::INITIALIZER : FunctionType::METHOD;
+  } else {
+    currentFunction = FunctionType::FUNCTION;
+  }
+  scopes.emplace_back();
+  functions.push_back({ &stmt, scopes.size() - 1 });
+  // `this` and `super` really live in environments just outside the
+  // method, but only closures inside it need to know where
+  if (stmt.isMethod) {
+    declare({ TokenType::THIS, StringTable::thisName(), nullptr, stmt.name.line }, nullptr);
+    if (stmt.hasSuperclass)
+      declare({ TokenType::SUPER, StringTable::superName(), nullptr, stmt.name.line }, nullptr);
+  }
+  stmt.firstParam = names.size();
+  for (const Token &param : stmt.params)
+    declare(param, &stmt);
+  // a deferred body is resolved on its own, by ensureResolved(); here it
+  // is only walked for its errors, so they are reported up front
+  bool enclosingChecking = checkingOnly;
+  checkingOnly = checkingOnly || stmt.deferred;
+  resolve(stmt.body);
+  checkingOnly = enclosingChecking;
+  functions.pop_back();
+  scopes.pop_back();
+  currentFunction = enclosingFunction;
+  currentClass = enclosingClass;
+}
+
+std::any Resolver::visitIfStmt(If &stmt) {
+  resolve(stmt.condition);
+  resolve(stmt.thenBranch);
+  resolve(stmt.elseBranch);
+  return nullptr;
+}
+
+std::any Resolver::visitPrintStmt(Print &stmt) {
+  resolve(stmt.expr);
+  return nullptr;
+}
+
+std::any Resolver::visitReturnStmt(Return &stmt) {
+  if (currentFunction == FunctionType::NONE)
+    diagnostics.error(stmt.keyword, "Can't return from top-level code.");
+  else if (currentFunction == FunctionType::INITIALIZER && stmt.value != nullptr)
+    diagnostics.error(stmt.keyword, "Can't return a value from an initializer.");
+  resolve(stmt.value);
+  return nullptr;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <any>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Diagnostics.hpp"
+#include "Expr.hpp"
+#include "Stmt.hpp"
+
+// Gives every local declaration (var, fun, class, parameter) an id and
+// links each variable reference to the declaration it names, mirroring the
+// environments the interpreter creates: one per block and one per call
+// holding the parameters and the function body. Methods also declare
+// `this` (and `super`) in that outermost scope.
+//
+// A reference is only linked when the declaration belongs to the same
+// function. One that crosses a function boundary is a capture instead:
+// every function between the reference and the declaration lists the name
+// in Function::captures, and a closure copies just those variables when it
+// is created rather than keeping the whole defining environment alive.
+// Captured variables that can change afterwards are marked to live in a
+// cell the closures share. The interpreter relies on these annotations, so
+// every tree must be resolved before it runs, and not at all if resolving
+// reported errors: a return outside any function or of a value from an
+// initializer, `this` or `super` outside a class, `super` in a class with
+// no superclass, or a class inheriting from itself.
+class Resolver : public ExprVisitor, public StmtVisitor {
+  enum class FunctionType { NONE, FUNCTION, INITIALIZER, METHOD };
+  enum class ClassType { NONE, CLASS, SUBCLASS };
+
+  struct FunctionScope {
+    Function *function;
+    // index into scopes holding the parameters
+    size_t scope;
+  };
+
+  std::vector<std::unordered_map<const LoxString*, int>> scopes;
+  // the functions being resolved, innermost last
+  std::vector<FunctionScope> functions;
+  std::vector<const LoxString*> names;
+  // per declaration id: the statement declaring it (null for `this` and
+  // `super`), and whether a closure captures it or anything assigns it
+  std::vector<Stmt*> owners;
+  std::vector<bool> captured;
+  std::vector<bool> assigned;
+  // names assigned from a function that does not declare them; any
+  // declaration with such a name may change behind its function's back
+  std::unordered_set<const LoxString*> assignedFromClosures;
+  // what the code being resolved is inside; a method takes its class from
+  // the flags the parser set, so one resolved on its own gets it right too
+  FunctionType currentFunction { FunctionType::NONE };
+  ClassType currentClass { ClassType::NONE };
+  // inside a deferred body, which is walked for its errors but neither
+  // declares nor links anything
+  bool checkingOnly { false };
+  Diagnostics &diagnostics;
+
+public:
+  explicit Resolver(Diagnostics &diagnostics) : diagnostics { diagnostics } {}
+
+  void resolve(std::vector<std::shared_ptr<Stmt>> &statements);
+
+  int localCount() const { return names.size(); }
+  // true if only the declaring function can assign the local
+  bool isStable(int local) const { return !assignedFromClosures.contains(names[local]); }
+
+  std::any visitAssignExpr(Assign &expr) override;
+  std::any visitGroupingExpr(Grouping &expr) override;
+  std::any visitBinaryExpr(Binary &expr) override;
+  std::any visitCallExpr(Call &expr) override;
+  std::any visitGetExpr(Get &expr) override;
+  std::any visitSetExpr(Set &expr) override;
+  std::any visitThisExpr(This &expr) override;
+  std::any visitSuperExpr(Super &expr) override;
+  std::any visitArrayLiteralExpr(ArrayLiteral &expr) override;
+  std::any visitMapLiteralExpr(MapLiteral &expr) override;
+  std::any visitIndexExpr(Index &expr) override;
+  std::any visitIndexSetExpr(IndexSet &expr) override;
+  std::any visitLiteralExpr(Literal &expr) override;
+  std::any visitLogicalExpr(Logical &expr) override;
+  std::any visitUnaryExpr(Unary &expr) override;
+  std::any visitVariableExpr(Variable &expr) override;
+
+  std::any visitBlockStmt(Block &stmt) override;
+  std::any visitVarStmt(Var &stmt) override;
+  std::any visitWhileStmt(While &stmt) override;
+  std::any visitForStmt(For &stmt) override;
+  std::any visitExpressionStmt(Expression &stmt) override;
+  std::any visitFunctionStmt(Function &stmt) override;
+  std::any visitClassStmt(Class &stmt) override;
+  std::any visitIfStmt(If &stmt) override;
+  std::any visitPrintStmt(Print &stmt) override;
+  std::any visitReturnStmt(Return &stmt) override;
+
+private:
+  void resolve(std::shared_ptr<Stmt> &stmt);
+  void resolve(std::shared_ptr<Expr> &expr);
+  void resolveFunction(Function &function);
+  // id for a new declaration in the innermost scope, or -1 at global scope
+  int declare(const Token &name, Stmt *owner);
+  // the id to link a reference to, or -1 for globals and captures
+  int reference(const StringRef &name, bool assignment);
+  // marks a captured declaration for a cell once it may change after capture
+  void updateCell(int local);
+  size_t functionScope() const { return functions.empty() ? 0 : functions.back().scope; }
+  // the scope index and id of the innermost visible declaration
+  bool lookup(const LoxString *name, size_t &scope, int &local);
+};
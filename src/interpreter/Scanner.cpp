@@ -1,11 +1,18 @@
 #include "Token.hpp"
-#include "error.hpp"
+#include "Diagnostics.hpp"
+#include <algorithm>
+#include <charconv>
+#include <exception>
 #include <string>
+#include <thread>
 #include <vector>
 #include <unordered_map>
+#include "MemoryStats.hpp"
+#include "Number.hpp"
 #include "Scanner.hpp"
+#include "StringTable.hpp"
 
-bool Scanner::isAtEnd() { return current >= source.length(); }
+bool Scanner::isAtEnd() { return static_cast<size_t>(current) >= source.length(); }
 void Scanner::scanToken() {
   char c = advance();
   switch (c) {
@@ -21,6 +28,12 @@ void Scanner::scanToken() {
   case '}':
     addToken(TokenType::RIGHT_BRACE);
     break;
+  case '[':
+    addToken(TokenType::LEFT_BRACKET);
+    break;
+  case ']':
+    addToken(TokenType::RIGHT_BRACKET);
+    break;
   case ',':
     addToken(TokenType::COMMA);
     break;
@@ -65,7 +78,7 @@ void Scanner::scanToken() {
       while (!(peek() == '*' && peekNext() == '/') && !isAtEnd())
         advance();
       if (isAtEnd()) {
-        error(line, std::string("Unterminated comment."));
+        diagnostics.error(line, "Unterminated comment.");
         return;
       }
       advance();
@@ -90,7 +103,7 @@ void Scanner::scanToken() {
     else if (isAlpha(c))
       identifier();
     else
-      error(line, std::string("Unexpected character"));
+      diagnostics.error(line, "Unexpected character");
     break;
   }
 }
@@ -98,12 +111,12 @@ void Scanner::scanToken() {
 void Scanner::identifier() {
   while (isAlphaNumeric(peek()))
     advance();
-  std::string text = source.substr(start, current - start);
+  std::string word { source.substr(start, current - start) };
   TokenType type;
-  if (!keywords.count(text))
+  if (!keywords.count(word))
     type = TokenType::IDENTIFIER;
   else
-    type = keywords[text];
+    type = keywords[word];
 
   addToken(type);
 }
@@ -136,7 +149,7 @@ char Scanner::peek() {
 }
 
 char Scanner::peekNext() {
-  if (current + 1 >= source.length())
+  if (static_cast<size_t>(current) + 1 >= source.length())
     return '\0';
   return source[current + 1];
 }
@@ -150,13 +163,12 @@ void Scanner::string() {
     advance();
   }
   if (isAtEnd()) {
-    error(line, std::string("Unterminated string."));
+    diagnostics.error(line, "Unterminated string.");
     return;
   }
   advance();
 
-  std::string value = source.substr(start + 1, current - start - 2);
-  addToken(TokenType::STRING, value);
+  addToken(TokenType::STRING, intern(source.substr(start + 1, current - start - 2)));
 }
 
 bool Scanner::isDigit(char c) {
@@ -173,22 +185,161 @@ void Scanner::number() {
       advance();
   }
   
-  std::string num = source.substr(start, current - start);
-  addToken(TokenType::NUMBER, std::stod(num));
+  std::string_view num = source.substr(start, current - start);
+  // integers are read exactly; those too long for 64 bits become doubles
+  int64_t integer;
+  auto [end, error] = std::from_chars(num.data(), num.data() + num.size(), integer);
+  if (error == std::errc {} && end == num.data() + num.size())
+    addToken(TokenType::NUMBER, integer);
+  else
+    addToken(TokenType::NUMBER, boxNumber(std::stod(std::string(num))));
 }
 
 void Scanner::addToken(TokenType type, std::any literal) {
-  std::string text = source.substr(start, current - start);
+  // a string literal's value is interned already; its quoted lexeme is
+  // only ever printed, so it stays out of the table
+  StringRef text = intern(source.substr(start, current - start), type != TokenType::STRING);
   tokens.push_back(Token(type, text, literal, line));
+  offsets.push_back(start);
 }
 
-std::vector<Token> Scanner::scanTokens() {
-  while (!isAtEnd() && !hadError) {
+StringRef Scanner::intern(std::string_view chars, bool shared) {
+  auto found = interned.find(chars);
+  if (found != interned.end())
+    return found->second;
+  StringRef string = shared ? StringTable::intern(chars) : LoxString::createSource(std::string(chars));
+  interned.emplace(chars, string);
+  return string;
+}
+
+void Scanner::scanUntil(int end) {
+  while (current < end && !isAtEnd() && !diagnostics.hasErrors()) {
     start = current;
     scanToken();
   }
-  tokens.push_back(Token(TokenType::END_OF_LINE, "", nullptr, line));
-  return tokens;
+}
+
+namespace {
+  // below this many bytes a chunk is not worth a thread
+  constexpr size_t minChunkSize = 1 << 20;
+
+  struct Chunk {
+    int begin;
+    int end;
+    std::vector<Token> tokens;
+    std::vector<int> offsets;
+    Diagnostics diagnostics;
+    // where the last token ended, at or past `end` unless lexing stopped
+    // at an error
+    int stop { 0 };
+    // lines counted, from 1
+    int lines { 1 };
+  };
+}
+
+void Scanner::scanChunks(size_t count) {
+  std::vector<Chunk> chunks;
+  int begin = 0;
+  for (size_t i = 1; i <= count && static_cast<size_t>(begin) < source.length(); ++i) {
+    size_t end = source.length();
+    if (i < count) {
+      end = source.find('\n', std::max<size_t>(begin, source.length() * i / count));
+      end = end == std::string_view::npos ? source.length() : end + 1;
+    }
+    chunks.push_back({ begin, static_cast<int>(end) });
+    begin = end;
+  }
+  // an empty source has no chunks; scanUntil() finishes it as usual
+  if (chunks.empty())
+    return;
+
+  // each thread counts what it allocates; the tokens it leaves behind are
+  // freed on this one, so it hands its tally over once it is done
+  std::vector<MemoryStats::Tally> tallies(chunks.size());
+  auto lex = [this](Chunk &chunk, int from) {
+    chunk.diagnostics = {};
+    Scanner scanner { source, chunk.diagnostics, from, 1 };
+    scanner.scanUntil(chunk.end);
+    chunk.tokens = std::move(scanner.tokens);
+    chunk.offsets = std::move(scanner.offsets);
+    chunk.stop = scanner.current;
+    chunk.lines = scanner.line;
+  };
+  std::vector<std::exception_ptr> errors(chunks.size());
+  std::vector<std::thread> pool;
+  for (size_t i = 1; i < chunks.size(); ++i) {
+    pool.emplace_back([&, i] {
+      try {
+        lex(chunks[i], chunks[i].begin);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+      tallies[i] = MemoryStats::tally();
+    });
+  }
+  try {
+    lex(chunks[0], 0);
+  } catch (...) {
+    errors[0] = std::current_exception();
+  }
+  for (std::thread &thread : pool)
+    thread.join();
+  for (size_t i = 1; i < chunks.size(); ++i)
+    MemoryStats::absorb(tallies[i]);
+  for (std::exception_ptr &error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  // the first chunk starts at a token; a later one only if the token
+  // before it ended on the newline in front of it
+  size_t total = 0;
+  for (Chunk &chunk : chunks)
+    total += chunk.tokens.size();
+  tokens = std::move(chunks[0].tokens);
+  tokens.reserve(total + 1);
+  offsets = std::move(chunks[0].offsets);
+  offsets.reserve(total + 1);
+  current = chunks[0].stop;
+  line = chunks[0].lines;
+  for (const Diagnostic &diagnostic : chunks[0].diagnostics.all())
+    diagnostics.error(diagnostic.line, diagnostic.message);
+  for (size_t i = 1; i < chunks.size() && !diagnostics.hasErrors(); ++i) {
+    Chunk &chunk = chunks[i];
+    if (current >= chunk.end)
+      continue;
+    if (current != chunk.begin)
+      lex(chunk, current);
+    int offset = line - 1;
+    for (const Token &token : chunk.tokens)
+      tokens.push_back(Token(token.type, token.lexeme, token.literal, token.line + offset));
+    offsets.insert(offsets.end(), chunk.offsets.begin(), chunk.offsets.end());
+    for (const Diagnostic &diagnostic : chunk.diagnostics.all())
+      diagnostics.error(diagnostic.line + offset, diagnostic.message);
+    current = chunk.stop;
+    line = chunk.lines + offset;
+  }
+}
+
+std::vector<Token> Scanner::scanTokens() {
+  return scanTokensWithThreads(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+std::vector<Token> Scanner::scanTokensWithThreads(unsigned threads) {
+  return scanTokensInChunks(std::min<size_t>(std::max(1u, threads), source.length() / minChunkSize));
+}
+
+std::vector<Token> Scanner::scanTokensInChunks(size_t chunks) {
+  if (chunks > 1 && !diagnostics.hasErrors())
+    scanChunks(chunks);
+  return scanTokens(source.length());
+}
+
+std::vector<Token> Scanner::scanTokens(int end) {
+  scanUntil(end);
+  tokens.push_back(Token(TokenType::END_OF_LINE, StringTable::intern(""), nullptr, line));
+  offsets.push_back(current);
+  return std::move(tokens);
 }
 
 int Scanner::getLine() { return line; }
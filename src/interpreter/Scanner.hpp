@@ -1,16 +1,32 @@
 #pragma once
 #include "Token.hpp"
-#include "error.hpp"
+#include "Diagnostics.hpp"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 
+// Sources of several megabytes are cut into chunks at line boundaries and
+// lexed on one thread each. Every chunk is lexed as if it started outside
+// any string or comment; the chunks are then joined in order, and a chunk
+// whose first characters turn out to belong to a string or block comment
+// still open at the end of the one before is lexed again from where that
+// token really ended. Tokens, line numbers and errors are the same as
+// lexing the whole source in one pass.
 class Scanner {
-  const std::string source;
+  // the input, owned unless this scanner lexes a chunk of another's
+  const std::string text;
+  const std::string_view source;
+  Diagnostics &diagnostics;
   std::vector<Token> tokens;
+  // where each token starts in the source
+  std::vector<int> offsets;
   int start { 0 };
   int current { 0 };
   int line { 1 };
+  // lexemes and string values made by this scanner, so a repeated one
+  // skips the shared table and its lock
+  std::unordered_map<std::string_view, StringRef> interned;
   std::unordered_map<std::string, TokenType> keywords = {
     {"and", TokenType::AND},
     {"class", TokenType::CLASS},
@@ -44,9 +60,34 @@ class Scanner {
   bool isDigit(char c);
   void number();
   void addToken(TokenType type, std::any literal = nullptr);
+  // the shared interned string, or with `shared` false one only this
+  // scanner reuses, for text nothing compares by identity
+  StringRef intern(std::string_view chars, bool shared = true);
+  // lexes from `current` every token that starts before `end`, stopping
+  // at the first error
+  void scanUntil(int end);
+  void scanChunks(size_t chunks);
 
 public:
-  Scanner(std::string source) : source(source) {}
+  Scanner(std::string source, Diagnostics &diagnostics) : text(std::move(source)), source(text), diagnostics(diagnostics) {}
+  // scans part of a source the caller keeps alive, starting at `begin`
+  // and counting lines from `line`
+  Scanner(std::string_view source, Diagnostics &diagnostics, int begin, int line)
+      : source(source), diagnostics(diagnostics), current(begin), line(line) {}
+  Scanner(const Scanner &) = delete;
   std::vector<Token> scanTokens();
+  // scanTokens() lexing a large source on at most `threads` threads, for
+  // a caller that already keeps the others busy
+  std::vector<Token> scanTokensWithThreads(unsigned threads);
+  // scans in `chunks` chunks whatever the size of the source, as
+  // scanTokens() does with large ones
+  std::vector<Token> scanTokensInChunks(size_t chunks);
+  // the tokens that start before `end`, then an END_OF_LINE where the
+  // last of them stopped
+  std::vector<Token> scanTokens(int end);
   int getLine();
+  // where scanning stopped, past `end` if a token or comment ran over it
+  int getPosition() const { return current; }
+  // where each token returned starts in the source
+  const std::vector<int> &getOffsets() const { return offsets; }
 };
@@ -0,0 +1,309 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Interpreter.hpp"
+#include "LazyParse.hpp"
+#include "Server.hpp"
+#include "StringTable.hpp"
+#include "error.hpp"
+
+namespace {
+  // requests larger than this are refused rather than buffered
+  constexpr uint64_t maxRequest = 64 << 20;
+  // the server reads requests itself, so a client that stalls halfway
+  // holds up the others for no longer than this many seconds
+  constexpr time_t ioTimeout = 5;
+
+  bool readAll(int fd, void *data, size_t size) {
+    char *bytes = static_cast<char*>(data);
+    while (size > 0) {
+      ssize_t count = read(fd, bytes, size);
+      if (count < 0 && errno == EINTR)
+        continue;
+      if (count <= 0)
+        return false;
+      bytes += count;
+      size -= count;
+    }
+    return true;
+  }
+
+  bool writeAll(int fd, const void *data, size_t size) {
+    const char *bytes = static_cast<const char*>(data);
+    while (size > 0) {
+      ssize_t count = write(fd, bytes, size);
+      if (count < 0 && errno == EINTR)
+        continue;
+      if (count <= 0)
+        return false;
+      bytes += count;
+      size -= count;
+    }
+    return true;
+  }
+
+  bool addressOf(const std::string &path, sockaddr_un &address) {
+    std::memset(&address, 0, sizeof address);
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof address.sun_path) {
+      std::cerr << "Socket path too long: " << path << std::endl;
+      return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+  }
+
+  void reply(int connection, int32_t status, const std::string &out) {
+    uint64_t outSize = out.size();
+    if (writeAll(connection, &status, sizeof status) && writeAll(connection, &outSize, sizeof outSize))
+      writeAll(connection, out.data(), out.size());
+  }
+
+  // reaps the children requests forked as they finish
+  void reapChildren(int) {
+    int saved = errno;
+    while (waitpid(-1, nullptr, WNOHANG) > 0) {}
+    errno = saved;
+  }
+
+  // resolves the bodies a preparsing parse left for later, so the children
+  // that run a cached script don't each resolve them again; a body that
+  // does not resolve stays deferred and fails when called, as it would have
+  void resolveBodies(std::vector<std::shared_ptr<Stmt>> &statements) {
+    for (std::shared_ptr<Stmt> &stmt : statements) {
+      Diagnostics ignored;
+      if (Function *function = dynamic_cast<Function*>(stmt.get()))
+        ensureResolved(*function, ignored);
+      else if (Class *klass = dynamic_cast<Class*>(stmt.get()))
+        for (std::shared_ptr<Function> &method : klass->methods)
+          ensureResolved(*method, ignored);
+    }
+  }
+
+  // the exit status of a script, run in the grandchild a request forks
+  int execute(Interpreter &interpreter, std::vector<std::shared_ptr<Stmt>> &statements) {
+    hadRuntimeError = false;
+    int status = 0;
+    try {
+      interpreter.interpret(statements);
+      status = hadRuntimeError ? 70 : 0;
+    } catch (const RuntimeError &error) {
+      runtimeError(error);
+      status = 70;
+    } catch (std::exception &e) {
+      // anything else interpret() lets through would have ended a
+      // standalone run
+      std::cout << "Internal error: " << e.what() << std::endl;
+      status = 70;
+    }
+    std::cout.flush();
+    std::fflush(stdout);
+    return status;
+  }
+}
+
+Server::~Server() {
+  if (listener >= 0) {
+    close(listener);
+    unlink(socketPath.c_str());
+  }
+}
+
+bool Server::listen() {
+  sockaddr_un address;
+  if (!addressOf(socketPath, address))
+    return false;
+  listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    std::cerr << "Could not create socket: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  unlink(socketPath.c_str());
+  if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof address) < 0 || ::listen(listener, SOMAXCONN) < 0) {
+    std::cerr << "Could not listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+    close(listener);
+    listener = -1;
+    return false;
+  }
+  return true;
+}
+
+void Server::serve() {
+  // a client that hangs up early must not take the server down
+  std::signal(SIGPIPE, SIG_IGN);
+  struct sigaction reaper {};
+  reaper.sa_handler = reapChildren;
+  sigemptyset(&reaper.sa_mask);
+  reaper.sa_flags = SA_RESTART;
+  sigaction(SIGCHLD, &reaper, nullptr);
+  while (true) {
+    int connection = accept(listener, nullptr, nullptr);
+    if (connection < 0) {
+      if (errno == EINTR)
+        continue;
+      std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+      return;
+    }
+    handle(connection);
+    close(connection);
+  }
+}
+
+void Server::handle(int connection) {
+  timeval timeout { ioTimeout, 0 };
+  setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+  setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+  uint64_t size;
+  if (!readAll(connection, &size, sizeof size) || size > maxRequest)
+    return;
+  std::string source(size, '\0');
+  if (!readAll(connection, source.data(), size))
+    return;
+
+  std::ostringstream captured;
+  std::streambuf *stdoutBuffer = std::cout.rdbuf(captured.rdbuf());
+  std::vector<std::shared_ptr<Stmt>> *statements = compile(source);
+  std::cout.rdbuf(stdoutBuffer);
+  std::string out = captured.str();
+  if (statements == nullptr) {
+    reply(connection, 65, out);
+    return;
+  }
+
+  std::cout.flush();
+  std::fflush(stdout);
+  pid_t child = fork();
+  if (child < 0) {
+    reply(connection, 70, out + "Internal error: " + std::strerror(errno) + "\n");
+    return;
+  }
+  if (child == 0) {
+    // this child waits for its own, which the server's reaper must not take
+    std::signal(SIGCHLD, SIG_DFL);
+    close(listener);
+    timeval none { 0, 0 };
+    setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &none, sizeof none);
+    int32_t status = run(*statements, out);
+    reply(connection, status, out);
+    _exit(0);
+  }
+}
+
+std::vector<std::shared_ptr<Stmt>> *Server::compile(const std::string &source) {
+  size_t hash = std::hash<std::string>()(source);
+  auto found = cache.find(hash);
+  if (found != cache.end() && found->second.source == source)
+    return &found->second.statements;
+
+  // the analyses only annotate the tree, so their results hold for every
+  // later run of the same source
+  Diagnostics diagnostics;
+  std::vector<std::shared_ptr<Stmt>> statements = parser.update(source, diagnostics);
+  if (diagnostics.hasErrors()) {
+    diagnostics.print(std::cout);
+    return nullptr;
+  }
+
+  resolveBodies(statements);
+
+  if (cache.size() >= cacheLimit && found == cache.end()) {
+    cache.clear();
+    StringTable::collect();
+  }
+  CachedScript &entry = cache[hash];
+  entry = { source, std::move(statements) };
+  return &entry.statements;
+}
+
+int Server::run(std::vector<std::shared_ptr<Stmt>> &statements, std::string &out) {
+  // the script runs in a child writing to a pipe, so one that crashes,
+  // say by recursing until the stack runs out, only fails its request
+  int channel[2];
+  if (pipe(channel) < 0) {
+    out += "Internal error: " + std::string(std::strerror(errno)) + "\n";
+    return 70;
+  }
+  std::cout.flush();
+  std::fflush(stdout);
+  pid_t child = fork();
+  if (child < 0) {
+    close(channel[0]);
+    close(channel[1]);
+    out += "Internal error: " + std::string(std::strerror(errno)) + "\n";
+    return 70;
+  }
+  if (child == 0) {
+    close(channel[0]);
+    dup2(channel[1], STDOUT_FILENO);
+    close(channel[1]);
+    alarm(timeLimit);
+    _exit(execute(interpreter, statements));
+  }
+
+  close(channel[1]);
+  char buffer[4096];
+  ssize_t count;
+  while ((count = read(channel[0], buffer, sizeof buffer)) != 0) {
+    if (count > 0)
+      out.append(buffer, count);
+    else if (errno != EINTR)
+      break;
+  }
+  close(channel[0]);
+  int status;
+  while (waitpid(child, &status, 0) < 0) {
+    if (errno != EINTR) {
+      out += "Internal error: " + std::string(std::strerror(errno)) + "\n";
+      return 70;
+    }
+  }
+  if (WIFEXITED(status))
+    return WEXITSTATUS(status);
+  if (WTERMSIG(status) == SIGALRM) {
+    out += "Script exceeded the time limit of " + std::to_string(timeLimit) + " seconds.\n";
+    return 70;
+  }
+  out += "Internal error: script terminated by signal " + std::to_string(WTERMSIG(status)) + ".\n";
+  return 70;
+}
+
+int runClient(const std::string &socketPath, const std::string &source) {
+  sockaddr_un address;
+  if (!addressOf(socketPath, address))
+    return 69;
+  int connection = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (connection < 0 || connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof address) < 0) {
+    std::cerr << "Could not connect to " << socketPath << ": " << std::strerror(errno) << std::endl;
+    if (connection >= 0)
+      close(connection);
+    return 69;
+  }
+
+  uint64_t size = source.size();
+  int32_t status;
+  uint64_t outSize;
+  std::string out;
+  bool ok = writeAll(connection, &size, sizeof size) && writeAll(connection, source.data(), source.size())
+    && readAll(connection, &status, sizeof status) && readAll(connection, &outSize, sizeof outSize);
+  if (ok) {
+    out.resize(outSize);
+    ok = readAll(connection, out.data(), outSize);
+  }
+  close(connection);
+  if (!ok) {
+    std::cerr << "Lost connection to " << socketPath << std::endl;
+    return 69;
+  }
+  std::cout << out << std::flush;
+  return status;
+}
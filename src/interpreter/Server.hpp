@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "IncrementalParser.hpp"
+#include "Stmt.hpp"
+
+class Interpreter;
+
+// Keeps a process warm and runs scripts sent over a Unix domain socket.
+//
+// A request is the script source, prefixed with its length as a uint64;
+// the reply is the exit status as an int32 followed by the length-prefixed
+// output (prints and error messages, as a script run from a file would
+// write them).
+//
+// The server parses each request itself, then forks a child that runs it
+// and replies, and goes back to accepting while the child works; children
+// are reaped as they exit. The script runs in a child of that child, so
+// one that crashes only fails its own request, and one that runs past the
+// time limit is killed. Output it printed before it died may be lost; the
+// reply says how it ended. Every script starts from the interpreter the
+// server set up once, natives and all, as the fork left it.
+//
+// Scripts that parse are cached by content, with every function body
+// resolved and the whole tree analyzed, so running the same script again
+// skips straight to execution. A script that is not cached is parsed
+// against the last one that was, so sending a file again after an edit
+// only reparses the declarations around it. When the cache is dropped the
+// names only its scripts used are dropped from the StringTable too.
+class Server {
+public:
+  // `interpreter` is the one every script starts from; a script that runs
+  // longer than `timeLimit` seconds is killed
+  Server(std::string socketPath, Interpreter &interpreter, unsigned timeLimit)
+    : socketPath { std::move(socketPath) }, interpreter { interpreter }, timeLimit { timeLimit } {}
+  ~Server();
+
+  // binds the socket, replacing a stale socket file; false on failure
+  bool listen();
+  // serves requests until the process is killed
+  void serve();
+
+private:
+  struct CachedScript {
+    std::string source;
+    std::vector<std::shared_ptr<Stmt>> statements;
+  };
+
+  // the cache is simply dropped when it reaches this many scripts
+  static constexpr size_t cacheLimit = 256;
+
+  std::string socketPath;
+  Interpreter &interpreter;
+  unsigned timeLimit;
+  int listener { -1 };
+  std::unordered_map<size_t, CachedScript> cache;
+  IncrementalParser parser;
+
+  // reads a request and answers it, forking a child to run it if it parses
+  void handle(int connection);
+  // runs a script in a child, writing its output to `out`; returns the
+  // exit status
+  int run(std::vector<std::shared_ptr<Stmt>> &statements, std::string &out);
+  // the cached statements for a script, or null if it does not parse;
+  // parse errors are written to std::cout
+  std::vector<std::shared_ptr<Stmt>> *compile(const std::string &source);
+};
+
+// Sends a script to a server and relays the reply; returns the script's
+// exit status, or 69 if the server could not be reached.
+int runClient(const std::string &socketPath, const std::string &source);
@@ -0,0 +1,27 @@
+#include <atomic>
+#include "Shape.hpp"
+
+namespace {
+  std::atomic<uint64_t> nextId { 1 };
+}
+
+Shape::Shape() : id { nextId++ }, slotCount { 0 } {}
+
+Shape::Shape(const Shape &parent, const LoxString *name)
+    : id { nextId++ }, slotCount { parent.slotCount + 1 }, slots { parent.slots } {
+  slots[name] = parent.slotCount;
+}
+
+std::vector<const LoxString*> Shape::fieldNames() const {
+  std::vector<const LoxString*> names(slotCount);
+  for (auto &[name, slot] : slots)
+    names[slot] = name;
+  return names;
+}
+
+Shape *Shape::withField(const LoxString *name) {
+  std::unique_ptr<Shape> &child = transitions[name];
+  if (child == nullptr)
+    child.reset(new Shape(*this, name));
+  return child.get();
+}
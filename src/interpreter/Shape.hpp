@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "LoxString.hpp"
+#include "StringTable.hpp"
+
+class LoxFunction;
+
+// Hidden class describing the field layout of instances. Every class owns
+// a root shape with no fields; adding a field moves an instance along a
+// transition to a child shape, which is created once and shared by every
+// instance that gains the same fields in the same order. A shape therefore
+// also identifies the class of the instances that have it.
+class Shape {
+public:
+  // never reused, unlike addresses, so caches can hold it past the
+  // lifetime of the shape
+  const uint64_t id;
+  const int slotCount;
+
+  Shape();
+
+  // slot index of a field, or -1
+  int find(const LoxString *name) const {
+    auto found = slots.find(name);
+    return found != slots.end() ? found->second : -1;
+  }
+  // the shape after adding a field this shape does not have
+  Shape *withField(const LoxString *name);
+  // the field held in each slot
+  std::vector<const LoxString*> fieldNames() const;
+
+private:
+  Shape(const Shape &parent, const LoxString *name);
+
+  std::unordered_map<const LoxString*, int, SymbolHash> slots;
+  std::unordered_map<const LoxString*, std::unique_ptr<Shape>, SymbolHash> transitions;
+};
+
+// Inline cache at one property access site, keyed on shape id. Holds up to
+// `ways` shapes (monomorphic with one, polymorphic beyond that) and gives
+// up once a site has seen more.
+struct PropertyCache {
+  static constexpr int ways = 4;
+
+  struct Entry {
+    uint64_t shape { 0 };
+    // field slot, or -1 when the property is a method
+    int slot { -1 };
+    // gets: the method found on the class when slot is -1
+    LoxFunction *method { nullptr };
+    // sets: the shape after adding the field, when it was missing
+    Shape *transition { nullptr };
+  };
+
+  Entry entries[ways];
+  int count { 0 };
+  bool megamorphic { false };
+
+  const Entry *find(uint64_t shape) const {
+    for (int i = 0; i < count; ++i)
+      if (entries[i].shape == shape)
+        return &entries[i];
+    return nullptr;
+  }
+  void add(const Entry &entry) {
+    if (count == ways) {
+      megamorphic = true;
+      return;
+    }
+    entries[count++] = entry;
+  }
+};
@@ -0,0 +1,693 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include "Diagnostics.hpp"
+#include "Foreign.hpp"
+#include "LazyParse.hpp"
+#include "LoxArray.hpp"
+#include "LoxClass.hpp"
+#include "LoxFile.hpp"
+#include "LoxFunction.hpp"
+#include "LoxInstance.hpp"
+#include "LoxMap.hpp"
+#include "LoxNative.hpp"
+#include "Parser.hpp"
+#include "Resolver.hpp"
+#include "Scanner.hpp"
+#include "Snapshot.hpp"
+#include "StringTable.hpp"
+#include "TypeInference.hpp"
+
+namespace {
+  constexpr char magic[8] = { 'L', 'O', 'X', 'S', 'N', 'A', 'P', '\0' };
+  constexpr uint32_t version = 4;
+  // the reference for a missing enclosing environment or superclass
+  constexpr uint32_t none = UINT32_MAX;
+
+  // Image layout, all integers in host byte order:
+  //   magic, version, checksum of everything after it
+  //   object count, prelude source
+  //   one record per object: kind, payload size, payload
+  // Object 0 is the global environment. The checksum catches damaged
+  // images, which could otherwise load into state the resolved prelude
+  // does not expect.
+  enum class Kind : uint8_t { String, Native, Array, Map, Environment, Cell, Function, Class, Instance };
+  enum class Tag : uint8_t { Nil, False, True, Number, Object, Integer };
+
+  // 64-bit FNV-1a
+  uint64_t checksum(std::string_view bytes) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : bytes)
+      hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+    return hash;
+  }
+
+  void collectFunctions(const std::vector<std::shared_ptr<Stmt>> &statements, std::vector<std::shared_ptr<Function>> &functions, bool bodies);
+
+  // function declarations in an order that parsing the same source always
+  // reproduces: with `bodies`, every one in the tree; without, only those
+  // outside any function (the roots), whose bodies may not be parsed yet
+  void collectFunctions(const std::shared_ptr<Stmt> &stmt, std::vector<std::shared_ptr<Function>> &functions, bool bodies) {
+    if (stmt == nullptr)
+      return;
+    if (std::shared_ptr<Function> function = std::dynamic_pointer_cast<Function>(stmt)) {
+      functions.push_back(function);
+      if (bodies)
+        collectFunctions(function->body, functions, bodies);
+    } else if (Class *klass = dynamic_cast<Class*>(stmt.get())) {
+      for (const std::shared_ptr<Function> &method : klass->methods) {
+        functions.push_back(method);
+        if (bodies)
+          collectFunctions(method->body, functions, bodies);
+      }
+    } else if (Block *block = dynamic_cast<Block*>(stmt.get())) {
+      collectFunctions(block->statements, functions, bodies);
+    } else if (If *branch = dynamic_cast<If*>(stmt.get())) {
+      collectFunctions(branch->thenBranch, functions, bodies);
+      collectFunctions(branch->elseBranch, functions, bodies);
+    } else if (While *loop = dynamic_cast<While*>(stmt.get())) {
+      collectFunctions(loop->body, functions, bodies);
+    } else if (For *loop = dynamic_cast<For*>(stmt.get())) {
+      collectFunctions(loop->body, functions, bodies);
+    }
+  }
+
+  void collectFunctions(const std::vector<std::shared_ptr<Stmt>> &statements, std::vector<std::shared_ptr<Function>> &functions, bool bodies) {
+    for (const std::shared_ptr<Stmt> &stmt : statements)
+      collectFunctions(stmt, functions, bodies);
+  }
+
+  // the object behind a reference value, or null for anything else
+  const void *identity(const std::any &object) {
+    const std::type_info &type = object.type();
+    if (type == typeid(StringRef))
+      return std::any_cast<const StringRef&>(object).get();
+    if (type == typeid(ArrayRef))
+      return std::any_cast<const ArrayRef&>(object).get();
+    if (type == typeid(MapRef))
+      return std::any_cast<const MapRef&>(object).get();
+    if (type == typeid(std::shared_ptr<LoxCallable>))
+      return std::any_cast<const std::shared_ptr<LoxCallable>&>(object).get();
+    if (type == typeid(std::shared_ptr<LoxInstance>))
+      return std::any_cast<const std::shared_ptr<LoxInstance>&>(object).get();
+    if (type == typeid(std::shared_ptr<Environment>))
+      return std::any_cast<const std::shared_ptr<Environment>&>(object).get();
+    if (type == typeid(UpvalueRef))
+      return std::any_cast<const UpvalueRef&>(object).get();
+    return nullptr;
+  }
+
+  class Writer {
+  public:
+    explicit Writer(const std::vector<std::shared_ptr<Stmt>> &statements) {
+      std::vector<std::shared_ptr<Function>> roots;
+      collectFunctions(statements, roots, false);
+      for (uint32_t i = 0; i < roots.size(); ++i) {
+        declarations[roots[i].get()] = { i, 0 };
+        // a deferred body has created no closures yet, but its functions
+        // are numbered all the same
+        std::vector<std::shared_ptr<Function>> nested;
+        collectFunctions(roots[i]->body, nested, true);
+        for (uint32_t j = 0; j < nested.size(); ++j)
+          declarations[nested[j].get()] = { i, j + 1 };
+      }
+    }
+
+    // the whole image, or false with the reason in `error`
+    bool write(const std::string &source, Interpreter &interpreter, std::string &image) {
+      out.append(magic, sizeof magic);
+      u32(version);
+      size_t checksumAt = out.size();
+      out.append(sizeof(uint64_t), '\0');
+      size_t countAt = out.size();
+      u32(0);
+      bytes(source);
+
+      idOf(interpreter.globals);
+      // records may add objects as they go; each is written in id order
+      for (size_t i = 0; i < objects.size() && error.empty(); ++i)
+        record(objects[i]);
+      if (!error.empty())
+        return false;
+      uint32_t count = objects.size();
+      std::memcpy(out.data() + countAt, &count, sizeof count);
+      uint64_t sum = checksum(std::string_view(out).substr(countAt));
+      std::memcpy(out.data() + checksumAt, &sum, sizeof sum);
+      image = std::move(out);
+      return true;
+    }
+
+    std::string error;
+
+  private:
+    // a root, and 0 for the root itself or 1 + the index among its nested functions
+    std::unordered_map<const Function*, std::pair<uint32_t, uint32_t>> declarations;
+    std::unordered_map<const void*, uint32_t> ids;
+    std::vector<std::any> objects;
+    std::string out;
+
+    void u8(uint8_t value) { out.push_back(static_cast<char>(value)); }
+    void u32(uint32_t value) { out.append(reinterpret_cast<const char*>(&value), sizeof value); }
+    void f64(double value) { out.append(reinterpret_cast<const char*>(&value), sizeof value); }
+    void i64(int64_t value) { out.append(reinterpret_cast<const char*>(&value), sizeof value); }
+    void bytes(std::string_view chars) {
+      u32(chars.size());
+      out.append(chars);
+    }
+
+    uint32_t idOf(const std::any &object) {
+      const void *key = identity(object);
+      auto found = ids.find(key);
+      if (found != ids.end())
+        return found->second;
+      // a class is built from its superclass, so the superclass must load first
+      if (object.type() == typeid(std::shared_ptr<LoxCallable>)) {
+        LoxClass *klass = dynamic_cast<LoxClass*>(std::any_cast<const std::shared_ptr<LoxCallable>&>(object).get());
+        if (klass != nullptr && klass->superclass != nullptr)
+          idOf(std::shared_ptr<LoxCallable>(klass->superclass));
+      }
+      uint32_t id = objects.size();
+      ids[key] = id;
+      objects.push_back(object);
+      return id;
+    }
+
+    void value(const std::any &value) {
+      const std::type_info &type = value.type();
+      if (type == typeid(double)) {
+        u8(static_cast<uint8_t>(Tag::Number));
+        f64(std::any_cast<double>(value));
+      } else if (type == typeid(int64_t)) {
+        u8(static_cast<uint8_t>(Tag::Integer));
+        i64(std::any_cast<int64_t>(value));
+      } else if (type == typeid(bool)) {
+        u8(static_cast<uint8_t>(std::any_cast<bool>(value) ? Tag::True : Tag::False));
+      } else if (type == typeid(void*) || type == typeid(std::nullptr_t)) {
+        u8(static_cast<uint8_t>(Tag::Nil));
+      } else if (identity(value) != nullptr) {
+        u8(static_cast<uint8_t>(Tag::Object));
+        u32(idOf(value));
+      } else {
+        error = "Cannot save a value of type " + std::string(type.name()) + ".";
+        u8(static_cast<uint8_t>(Tag::Nil));
+      }
+    }
+
+    void record(const std::any &object) {
+      const std::type_info &type = object.type();
+      size_t start = out.size();
+      u8(0);
+      u32(0);
+      Kind kind;
+
+      if (type == typeid(StringRef)) {
+        kind = Kind::String;
+        bytes(std::any_cast<const StringRef&>(object)->view());
+      } else if (type == typeid(ArrayRef)) {
+        kind = Kind::Array;
+        const LoxArray &array = *std::any_cast<const ArrayRef&>(object);
+        u32(array.size());
+        for (size_t i = 0; i < array.size(); ++i)
+          value(array.get(i));
+      } else if (type == typeid(MapRef)) {
+        kind = Kind::Map;
+        const LoxMap &map = *std::any_cast<const MapRef&>(object);
+        u32(map.size());
+        for (const LoxMap::Entry &entry : map.entries()) {
+          if (!entry.live)
+            continue;
+          value(entry.key);
+          value(entry.value);
+        }
+      } else if (type == typeid(std::shared_ptr<LoxInstance>)) {
+        kind = Kind::Instance;
+        const LoxInstance &instance = *std::any_cast<const std::shared_ptr<LoxInstance>&>(object);
+        u32(idOf(std::shared_ptr<LoxCallable>(instance.klass)));
+        std::vector<std::pair<const LoxString*, std::any>> fields = instance.fieldList();
+        u32(fields.size());
+        for (auto &[name, field] : fields) {
+          bytes(name->view());
+          value(field);
+        }
+      } else if (type == typeid(std::shared_ptr<Environment>)) {
+        kind = Kind::Environment;
+        const Environment &environment = *std::any_cast<const std::shared_ptr<Environment>&>(object);
+        u32(environment.enclosing != nullptr ? idOf(environment.enclosing) : none);
+        u32(environment.entries().size());
+        for (auto &[name, entry] : environment.entries()) {
+          bytes(name->view());
+          if (entry.type() == typeid(UpvalueRef)) {
+            u8(static_cast<uint8_t>(Tag::Object));
+            u32(idOf(entry));
+          } else {
+            value(entry);
+          }
+        }
+      } else if (type == typeid(UpvalueRef)) {
+        kind = Kind::Cell;
+        value(std::any_cast<const UpvalueRef&>(object)->value);
+      } else {
+        LoxCallable *callable = std::any_cast<const std::shared_ptr<LoxCallable>&>(object).get();
+        if (LoxFunction *function = dynamic_cast<LoxFunction*>(callable)) {
+          kind = Kind::Function;
+          auto declaration = declarations.find(function->getDeclaration().get());
+          if (declaration == declarations.end()) {
+            error = "Cannot save function '" + function->getDeclaration()->name.lexeme->str() + "' declared outside the prelude.";
+            return;
+          }
+          u32(declaration->second.first);
+          u32(declaration->second.second);
+          u32(idOf(function->getClosure()));
+          u8(function->initializer());
+        } else if (LoxClass *klass = dynamic_cast<LoxClass*>(callable)) {
+          kind = Kind::Class;
+          bytes(klass->name->view());
+          u32(klass->superclass != nullptr ? idOf(std::shared_ptr<LoxCallable>(klass->superclass)) : none);
+          u32(klass->methodTable().size());
+          for (auto &[name, method] : klass->methodTable()) {
+            bytes(name->view());
+            u32(idOf(std::shared_ptr<LoxCallable>(method)));
+          }
+        } else if (dynamic_cast<LoxForeign*>(callable) != nullptr) {
+          error = "Cannot save foreign function '" + static_cast<LoxForeign*>(callable)->name + "'.";
+          return;
+        } else if (dynamic_cast<LoxFile*>(callable) != nullptr) {
+          error = "Cannot save open file '" + static_cast<LoxFile*>(callable)->name + "'.";
+          return;
+        } else {
+          kind = Kind::Native;
+          bytes(static_cast<LoxNative*>(callable)->name);
+        }
+      }
+
+      out[start] = static_cast<char>(kind);
+      uint32_t size = out.size() - start - 1 - sizeof(uint32_t);
+      std::memcpy(out.data() + start + 1, &size, sizeof size);
+    }
+  };
+
+  // Reads from a bounds-checked range; running off the end yields zeros
+  // and sets `failed`, which callers check once they are done.
+  class Reader {
+  public:
+    Reader(std::string_view data) : data { data } {}
+
+    bool failed { false };
+
+    bool atEnd() const { return position == data.size(); }
+    uint8_t u8() {
+      uint8_t value = 0;
+      copy(&value, sizeof value);
+      return value;
+    }
+    uint32_t u32() {
+      uint32_t value = 0;
+      copy(&value, sizeof value);
+      return value;
+    }
+    double f64() {
+      double value = 0;
+      copy(&value, sizeof value);
+      return value;
+    }
+    int64_t i64() {
+      int64_t value = 0;
+      copy(&value, sizeof value);
+      return value;
+    }
+    uint64_t u64() {
+      uint64_t value = 0;
+      copy(&value, sizeof value);
+      return value;
+    }
+    // everything not read yet
+    std::string_view rest() const {
+      return data.substr(position);
+    }
+    std::string_view bytes() {
+      return take(u32());
+    }
+    std::string_view take(size_t size) {
+      if (failed || size > data.size() - position) {
+        failed = true;
+        return {};
+      }
+      std::string_view chars = data.substr(position, size);
+      position += size;
+      return chars;
+    }
+
+  private:
+    std::string_view data;
+    size_t position { 0 };
+
+    void copy(void *value, size_t size) {
+      if (failed || size > data.size() - position) {
+        failed = true;
+        return;
+      }
+      std::memcpy(value, data.data() + position, size);
+      position += size;
+    }
+  };
+
+  // a read-only mapping of a whole file
+  class Mapping {
+  public:
+    explicit Mapping(const std::string &path) {
+      int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+        return;
+      struct stat info;
+      if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+          data = static_cast<const char*>(mapped);
+          size = info.st_size;
+        }
+      }
+      close(fd);
+    }
+    ~Mapping() {
+      if (data != nullptr)
+        munmap(const_cast<char*>(data), size);
+    }
+
+    const char *data { nullptr };
+    size_t size { 0 };
+  };
+
+  class Loader {
+  public:
+    explicit Loader(Interpreter &interpreter) : interpreter { interpreter } {}
+
+    bool load(std::string_view image) {
+      Reader reader { image };
+      char header[sizeof magic];
+      for (char &c : header)
+        c = reader.u8();
+      if (reader.failed || std::memcmp(header, magic, sizeof magic) != 0)
+        return fail("Not a snapshot.");
+      if (reader.u32() != version)
+        return fail("Snapshot was written by a different version.");
+      uint64_t sum = reader.u64();
+      if (reader.failed || checksum(reader.rest()) != sum)
+        return fail("Snapshot is corrupt.");
+      uint32_t count = reader.u32();
+      if (!parse(reader.bytes()))
+        return false;
+
+      for (uint32_t i = 0; i < count && !reader.failed; ++i) {
+        Kind kind = static_cast<Kind>(reader.u8());
+        uint32_t size = reader.u32();
+        records.push_back({ kind, reader.take(size) });
+      }
+      if (reader.failed || !reader.atEnd() || count == 0 || records[0].first != Kind::Environment)
+        return fail("Snapshot is corrupt.");
+
+      objects.resize(count);
+      objects[0] = interpreter.globals;
+      // references are only patched in once every object exists, so only
+      // what an object needs to be constructed has to come before it
+      return (allocate({ Kind::String, Kind::Native, Kind::Array, Kind::Map, Kind::Environment, Kind::Cell })
+        && allocate({ Kind::Function }) && allocate({ Kind::Class }) && allocate({ Kind::Instance })
+        && fill()) || fail("Snapshot is corrupt.");
+    }
+
+    std::string error;
+
+  private:
+    Interpreter &interpreter;
+    std::vector<std::shared_ptr<Function>> roots;
+    // functions nested in each root, filled in once the root is parsed
+    std::unordered_map<uint32_t, std::vector<std::shared_ptr<Function>>> nested;
+    std::vector<std::pair<Kind, std::string_view>> records;
+    std::vector<std::any> objects;
+
+    bool fail(std::string message) {
+      if (error.empty())
+        error = std::move(message);
+      return false;
+    }
+
+    bool parse(std::string_view source) {
+      Diagnostics diagnostics;
+      Scanner scanner(std::string(source), diagnostics);
+      std::vector<Token> tokens = scanner.scanTokens();
+      Parser parser { tokens, diagnostics, true };
+      std::vector<std::shared_ptr<Stmt>> statements = parser.parse();
+      Resolver resolver { diagnostics };
+      if (!diagnostics.hasErrors())
+        resolver.resolve(statements);
+      if (diagnostics.hasErrors())
+        return fail("Snapshot prelude does not parse.");
+      TypeInference { resolver }.analyze(statements);
+      collectFunctions(statements, roots, false);
+      return true;
+    }
+
+    // see Writer::declarations; a closure nested in a root means the root
+    // ran while the snapshot was made, so its body is parsed here too
+    std::shared_ptr<Function> declaration(uint32_t root, uint32_t index) {
+      if (root >= roots.size())
+        return nullptr;
+      if (index == 0)
+        return roots[root];
+      auto found = nested.find(root);
+      if (found == nested.end()) {
+        Diagnostics diagnostics;
+        if (!ensureResolved(*roots[root], diagnostics))
+          return nullptr;
+        found = nested.emplace(root, std::vector<std::shared_ptr<Function>> {}).first;
+        collectFunctions(roots[root]->body, found->second, true);
+      }
+      return index <= found->second.size() ? found->second[index - 1] : nullptr;
+    }
+
+    template<typename T>
+    T *object(uint32_t id) {
+      if (id >= objects.size())
+        return nullptr;
+      return std::any_cast<T>(&objects[id]);
+    }
+
+    template<typename T>
+    std::shared_ptr<T> callable(uint32_t id) {
+      std::shared_ptr<LoxCallable> *found = object<std::shared_ptr<LoxCallable>>(id);
+      return found != nullptr ? std::dynamic_pointer_cast<T>(*found) : nullptr;
+    }
+
+    // environments and cells are never values, except that a variable
+    // holds its cell
+    bool value(Reader &reader, std::any &result, bool cells = false) {
+      switch (static_cast<Tag>(reader.u8())) {
+        case Tag::Nil: result = (void*) nullptr; return true;
+        case Tag::False: result = false; return true;
+        case Tag::True: result = true; return true;
+        case Tag::Number: result = reader.f64(); return true;
+        case Tag::Integer: result = reader.i64(); return true;
+        case Tag::Object: {
+          uint32_t id = reader.u32();
+          if (id >= objects.size() || !objects[id].has_value())
+            return false;
+          const std::type_info &type = objects[id].type();
+          if (type == typeid(std::shared_ptr<Environment>) || (type == typeid(UpvalueRef) && !cells))
+            return false;
+          result = objects[id];
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool allocate(std::initializer_list<Kind> kinds) {
+      for (size_t id = 1; id < records.size(); ++id) {
+        auto [kind, payload] = records[id];
+        if (std::find(kinds.begin(), kinds.end(), kind) == kinds.end())
+          continue;
+        Reader reader { payload };
+        if (!create(id, kind, reader) || reader.failed)
+          return false;
+      }
+      return true;
+    }
+
+    bool create(size_t id, Kind kind, Reader &reader) {
+      switch (kind) {
+        case Kind::String:
+          objects[id] = LoxString::create(std::string(reader.bytes()));
+          return true;
+        case Kind::Native: {
+          auto found = interpreter.globals->entries().find(StringTable::intern(reader.bytes()).get());
+          if (found == interpreter.globals->entries().end() || found->second.type() != typeid(std::shared_ptr<LoxCallable>))
+            return fail("Snapshot refers to an unknown native.");
+          objects[id] = found->second;
+          return true;
+        }
+        case Kind::Array:
+          objects[id] = LoxArray::create();
+          return true;
+        case Kind::Map:
+          objects[id] = LoxMap::create();
+          return true;
+        case Kind::Environment:
+          objects[id] = Environment::create();
+          return true;
+        case Kind::Cell:
+          objects[id] = Environment::cell((void*) nullptr);
+          return true;
+        case Kind::Function: {
+          uint32_t root = reader.u32();
+          std::shared_ptr<Function> declaration = this->declaration(root, reader.u32());
+          std::shared_ptr<Environment> *closure = object<std::shared_ptr<Environment>>(reader.u32());
+          bool isInitializer = reader.u8() != 0;
+          if (declaration == nullptr || closure == nullptr)
+            return false;
+          std::shared_ptr<LoxCallable> function = std::allocate_shared<LoxFunction>(
+            CountingAllocator<LoxFunction, MemoryCategory::Closure> {}, declaration, *closure, isInitializer);
+          objects[id] = function;
+          return true;
+        }
+        case Kind::Class: {
+          StringRef name = StringTable::intern(reader.bytes());
+          uint32_t superId = reader.u32();
+          std::shared_ptr<LoxClass> superclass = superId != none ? callable<LoxClass>(superId) : nullptr;
+          if (superId != none && superclass == nullptr)
+            return false;
+          LoxClass::Methods methods;
+          for (uint32_t count = reader.u32(); count > 0 && !reader.failed; --count) {
+            const LoxString *methodName = StringTable::intern(reader.bytes()).get();
+            std::shared_ptr<LoxFunction> method = callable<LoxFunction>(reader.u32());
+            if (method == nullptr)
+              return false;
+            methods[methodName] = method;
+          }
+          std::shared_ptr<LoxCallable> klass = std::make_shared<LoxClass>(name, superclass, std::move(methods));
+          objects[id] = klass;
+          return true;
+        }
+        case Kind::Instance: {
+          std::shared_ptr<LoxClass> klass = callable<LoxClass>(reader.u32());
+          if (klass == nullptr)
+            return false;
+          objects[id] = LoxInstance::create(klass);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool fill() {
+      for (size_t id = 0; id < records.size(); ++id) {
+        auto [kind, payload] = records[id];
+        Reader reader { payload };
+        if (!fill(id, kind, reader) || reader.failed)
+          return false;
+      }
+      return true;
+    }
+
+    bool fill(size_t id, Kind kind, Reader &reader) {
+      std::any first, second;
+      switch (kind) {
+        case Kind::Array: {
+          LoxArray &array = *std::any_cast<ArrayRef&>(objects[id]);
+          for (uint32_t count = reader.u32(); count > 0 && !reader.failed; --count) {
+            if (!value(reader, first))
+              return false;
+            array.push(first);
+          }
+          return true;
+        }
+        case Kind::Map: {
+          LoxMap &map = *std::any_cast<MapRef&>(objects[id]);
+          for (uint32_t count = reader.u32(); count > 0 && !reader.failed; --count) {
+            if (!value(reader, first) || !value(reader, second))
+              return false;
+            map.set(first, second);
+          }
+          return true;
+        }
+        case Kind::Environment: {
+          Environment &environment = **object<std::shared_ptr<Environment>>(id);
+          uint32_t enclosing = reader.u32();
+          if (id != 0 && enclosing != none) {
+            std::shared_ptr<Environment> *found = object<std::shared_ptr<Environment>>(enclosing);
+            if (found == nullptr)
+              return false;
+            environment.enclosing = *found;
+          }
+          for (uint32_t count = reader.u32(); count > 0 && !reader.failed; --count) {
+            StringRef name = StringTable::intern(reader.bytes());
+            if (!value(reader, first, true))
+              return false;
+            environment.define(name, first);
+          }
+          return true;
+        }
+        case Kind::Cell: {
+          Upvalue &cell = *std::any_cast<UpvalueRef&>(objects[id]);
+          if (!value(reader, first))
+            return false;
+          MemoryStats::trackValue(first);
+          MemoryStats::untrackValue(cell.value);
+          cell.value = first;
+          return true;
+        }
+        case Kind::Instance: {
+          LoxInstance &instance = *std::any_cast<std::shared_ptr<LoxInstance>&>(objects[id]);
+          reader.u32();
+          for (uint32_t count = reader.u32(); count > 0 && !reader.failed; --count) {
+            Token name { TokenType::IDENTIFIER, StringTable::intern(reader.bytes()), nullptr, 0 };
+            if (!value(reader, first))
+              return false;
+            PropertyCache cache;
+            instance.set(name, first, cache);
+          }
+          return true;
+        }
+        default:
+          return true;
+      }
+    }
+  };
+}
+
+bool saveSnapshot(const std::string &path, const std::string &source,
+    const std::vector<std::shared_ptr<Stmt>> &statements, Interpreter &interpreter) {
+  Writer writer { statements };
+  std::string image;
+  if (!writer.write(source, interpreter, image)) {
+    std::cerr << writer.error << std::endl;
+    return false;
+  }
+  std::ofstream out(path, std::ios::binary);
+  if (!out.write(image.data(), image.size()) || !out.flush()) {
+    std::cerr << "Could not write snapshot to " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool loadSnapshot(const std::string &path, Interpreter &interpreter) {
+  Mapping mapping { path };
+  if (mapping.data == nullptr) {
+    std::cerr << "Could not read snapshot " << path << std::endl;
+    return false;
+  }
+  Loader loader { interpreter };
+  if (!loader.load({ mapping.data, mapping.size })) {
+    std::cerr << path << ": " << loader.error << std::endl;
+    return false;
+  }
+  return true;
+}
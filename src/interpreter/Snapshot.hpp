@@ -0,0 +1,27 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "Interpreter.hpp"
+#include "Stmt.hpp"
+
+// Heap snapshots: the globals an interpreter holds after running a prelude,
+// saved so later runs can start from them instead of running it again.
+//
+// The image keeps the prelude's source rather than its tree. Loading
+// preparses and resolves it again, which gives back the same top-level
+// Function nodes in the same order, but executes none of it; only the
+// bodies of functions that made the saved closures are parsed in full.
+// Everything reachable from the globals follows as a table of object
+// records (strings, arrays, maps, instances, classes, functions,
+// environments and captured cells) whose references to each other are
+// indices into the table. The loader maps the file, allocates every
+// object, and then patches the references, which is what lets cycles
+// through closures and instances survive the trip. Natives are saved by
+// name and bound to the loading interpreter's own.
+//
+// Both return false after writing the reason to std::cerr.
+bool saveSnapshot(const std::string &path, const std::string &source,
+  const std::vector<std::shared_ptr<Stmt>> &statements, Interpreter &interpreter);
+// `interpreter` should be fresh: the snapshot's globals replace its own
+bool loadSnapshot(const std::string &path, Interpreter &interpreter);
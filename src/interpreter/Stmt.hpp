@@ -2,12 +2,13 @@
 
 #include <vector>
 #include <any>
+#include <memory>
 #include "Token.hpp"
 #include "Expr.hpp"
 
 class StmtVisitor;
 
-class Stmt {
+class Stmt : public std::enable_shared_from_this<Stmt> {
 public:
   virtual std::any accept(StmtVisitor &visitor) = 0;
   virtual ~Stmt() = default;
@@ -16,8 +17,10 @@ public:
 class Block;
 class Var;
 class While;
+class For;
 class Expression;
 class Function;
+class Class;
 class If;
 class Print;
 class Return;
@@ -27,8 +30,10 @@ public:
   virtual std::any visitBlockStmt(Block &stmt) = 0;
   virtual std::any visitVarStmt(Var &stmt) = 0;
   virtual std::any visitWhileStmt(While &stmt) = 0;
+  virtual std::any visitForStmt(For &stmt) = 0;
   virtual std::any visitExpressionStmt(Expression &stmt) = 0;
   virtual std::any visitFunctionStmt(Function &stmt) = 0;
+  virtual std::any visitClassStmt(Class &stmt) = 0;
   virtual std::any visitIfStmt(If &stmt) = 0;
   virtual std::any visitPrintStmt(Print &stmt) = 0;
   virtual std::any visitReturnStmt(Return &stmt) = 0;
@@ -48,6 +53,10 @@ class Var : public Stmt {
 public:
   Token name;
   std::shared_ptr<Expr> initializer;
+  // Resolver: declaration id, or -1 for globals, and whether the variable
+  // needs a cell because a closure captures it and it is assigned
+  int local { -1 };
+  bool cell { false };
   Var(Token &name, std::shared_ptr<Expr> &initializer) : name { name }, initializer { std::move(initializer) } {};
 
   std::any accept(StmtVisitor &visitor) override {
@@ -66,6 +75,27 @@ public:
   }
 };
 
+// The initializer runs once in an environment of its own, the increment
+// after every run of the body. A missing condition is parsed as `true`.
+class For : public Stmt {
+public:
+  std::shared_ptr<Stmt> initializer;
+  std::shared_ptr<Expr> condition;
+  std::shared_ptr<Expr> increment;
+  std::shared_ptr<Stmt> body;
+  // TypeInference: set when the initializer declares a variable that stays
+  // a number, the condition compares it with a bound, and the increment
+  // adds the constant `step` to it
+  bool counted { false };
+  double step { 0 };
+  For(std::shared_ptr<Stmt> &initializer, std::shared_ptr<Expr> &condition, std::shared_ptr<Expr> &increment, std::shared_ptr<Stmt> &body)
+    : initializer { std::move(initializer) }, condition { std::move(condition) }, increment { std::move(increment) }, body { std::move(body) } {};
+
+  std::any accept(StmtVisitor &visitor) override {
+    return visitor.visitForStmt(*this);
+  }
+};
+
 class Expression : public Stmt {
 public:
   std::shared_ptr<Expr> expr;
@@ -81,13 +111,45 @@ public:
   Token name;
   std::vector<Token> params;
   std::vector<std::shared_ptr<Stmt>> body;
-  Function(Token name, std::vector<Token> &params, std::vector<std::shared_ptr<Stmt>> &body) : name { name }, params { params }, body { std::move(body) } {};
+  // Resolver: declaration id of the name (-1 for globals) and of the first
+  // parameter; the others follow consecutively
+  int local { -1 };
+  int firstParam { -1 };
+  // Resolver: whether the name and each parameter need a cell (see Var),
+  // and the variables of enclosing functions the body refers to, which a
+  // closure copies when it is created
+  bool cell { false };
+  std::vector<bool> cellParams;
+  std::vector<StringRef> captures;
+  // Parser: methods see `this`, and `super` when the class has a superclass
+  bool isMethod { false };
+  bool hasSuperclass { false };
+  // Parser: a body left for ensureResolved() (LazyParse.hpp) to resolve
+  // and analyze on first use; cleared once it has
+  bool deferred { false };
+  Function(Token name, std::vector<Token> &params, std::vector<std::shared_ptr<Stmt>> &body) : name { name }, params { params }, body { std::move(body) }, cellParams(this->params.size()) {};
 
   std::any accept(StmtVisitor &visitor) override {
     return visitor.visitFunctionStmt(*this);
   }
 };
 
+class Class : public Stmt {
+public:
+  Token name;
+  std::shared_ptr<Expr> superclass;
+  std::vector<std::shared_ptr<Function>> methods;
+  // Resolver: declaration id, or -1 for globals, and whether the name
+  // needs a cell (see Var)
+  int local { -1 };
+  bool cell { false };
+  Class(Token name, std::shared_ptr<Expr> &superclass, std::vector<std::shared_ptr<Function>> &methods) : name { name }, superclass { std::move(superclass) }, methods { std::move(methods) } {};
+
+  std::any accept(StmtVisitor &visitor) override {
+    return visitor.visitClassStmt(*this);
+  }
+};
+
 class If : public Stmt {
 public:
   std::shared_ptr<Expr> condition;
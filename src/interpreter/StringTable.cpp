@@ -0,0 +1,68 @@
+#include <array>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include "StringTable.hpp"
+
+namespace {
+  struct Shard {
+    std::mutex mutex;
+    // keys view the characters of the interned string they map to
+    std::unordered_map<std::string_view, StringRef> strings;
+  };
+
+  // split by hash, so threads scanning chunks of one source at once
+  // seldom wait on the same lock
+  using Table = std::array<Shard, 16>;
+
+  Table &table() {
+    static Table instance;
+    return instance;
+  }
+}
+
+StringRef StringTable::intern(std::string_view chars) {
+  Shard &shard = table()[std::hash<std::string_view> {}(chars) % std::tuple_size_v<Table>];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto found = shard.strings.find(chars);
+  if (found != shard.strings.end())
+    return found->second;
+  StringRef string = LoxString::createInterned(std::string(chars));
+  shard.strings.emplace(string->view(), string);
+  return string;
+}
+
+size_t StringTable::collect() {
+  size_t dropped = 0;
+  for (Shard &shard : table()) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // a string only the table holds can't be copied by anyone else while
+    // the lock keeps intern() from handing it out
+    dropped += std::erase_if(shard.strings, [](const auto &entry) { return entry.second.use_count() == 1; });
+  }
+  return dropped;
+}
+
+const StringRef &StringTable::thisName() {
+  static const StringRef name = intern("this");
+  return name;
+}
+
+const StringRef &StringTable::superName() {
+  static const StringRef name = intern("super");
+  return name;
+}
+
+const StringRef &StringTable::initName() {
+  static const StringRef name = intern("init");
+  return name;
+}
+
+size_t StringTable::size() {
+  size_t total = 0;
+  for (Shard &shard : table()) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    total += shard.strings.size();
+  }
+  return total;
+}
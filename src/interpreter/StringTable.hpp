@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include "LoxString.hpp"
+
+// Process-wide intern table. The scanner interns every lexeme but a string
+// literal's, and the literal's value in its place, so a name or constant string is represented by one LoxString
+// that compares by pointer and carries its hash precomputed. Interned
+// strings live until exit unless collect() is called; the table only ever
+// holds source text.
+class StringTable {
+public:
+  static StringRef intern(std::string_view chars);
+  static size_t size();
+  // Drops the strings nothing but the table refers to and returns how many,
+  // for a long-lived process that keeps discarding the trees it parsed.
+  // Tables keyed by a bare `const LoxString*` must hold a StringRef to each
+  // key while they use it, as the tokens of a live tree do for its names.
+  static size_t collect();
+
+  // the names the runtime itself looks up; held here, so never collected
+  static const StringRef &thisName();
+  static const StringRef &superName();
+  static const StringRef &initName();
+};
+
+// Hashes and compares interned names by identity, for tables keyed by
+// Token::lexeme.
+struct SymbolHash {
+  size_t operator()(const LoxString *name) const { return name->hash(); }
+};
@@ -1,16 +1,15 @@
-#pragma once
-
 #include <any>
+#include <cstdint>
 #include <string>
 #include "Token.hpp"
 
 std::string Token::literalAsString() const {
-  if (literal.type() == typeid(int)) {
-    return std::to_string(std::any_cast<int>(literal));
+  if (literal.type() == typeid(int64_t)) {
+    return std::to_string(std::any_cast<int64_t>(literal));
   } else if (literal.type() == typeid(double)) {
     return std::to_string(std::any_cast<double>(literal));
-  } else if (literal.type() == typeid(std::string)) {
-    return std::any_cast<std::string>(literal);
+  } else if (literal.type() == typeid(StringRef)) {
+    return std::any_cast<StringRef>(literal)->str();
   }
-  return lexeme;
+  return lexeme->str();
 }
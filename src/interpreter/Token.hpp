@@ -4,20 +4,23 @@
 #include <iostream>
 #include <string>
 #include "TokenType.hpp"
+#include "LoxString.hpp"
 #include <utility>
 
 class Token {
 public:
   const TokenType type;
-  const std::string lexeme;
+  // interned by the scanner, so names compare and hash by pointer
+  const StringRef lexeme;
   const std::any literal;
-  const int line;
+  // only ever changed on a copy of a tree moved by an edit above it
+  int line;
 
-  Token(TokenType type, std::string lexeme, std::any literal, int line)
-      : type(type), lexeme(lexeme), literal(literal), line(line){};
+  Token(TokenType type, StringRef lexeme, std::any literal, int line)
+      : type(type), lexeme(std::move(lexeme)), literal(std::move(literal)), line(line) {};
 
   std::string literalAsString() const;
   friend std::ostream &operator<<(std::ostream &os, const Token &t) {
-    return std::cout << std::to_underlying(t.type) << " " << t.lexeme << " " << t.literalAsString();
+    return std::cout << std::to_underlying(t.type) << " " << t.lexeme->str() << " " << t.literalAsString();
   }
 };
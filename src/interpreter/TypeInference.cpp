@@ -0,0 +1,378 @@
+#include "Number.hpp"
+#include "TokenType.hpp"
+#include "TypeInference.hpp"
+
+namespace {
+  StaticType join(StaticType a, StaticType b) {
+    if (a == StaticType::None)
+      return b;
+    if (b == StaticType::None || a == b)
+      return a;
+    return StaticType::Other;
+  }
+
+  StaticType literalType(const std::any &value) {
+    return isNumber(value) ? StaticType::Number : StaticType::Other;
+  }
+
+  bool isLocal(const std::shared_ptr<Expr> &expr, int local) {
+    Variable *variable = dynamic_cast<Variable*>(expr.get());
+    return variable != nullptr && variable->local == local;
+  }
+
+  bool isConstant(const std::shared_ptr<Expr> &expr, double &value) {
+    Literal *literal = dynamic_cast<Literal*>(expr.get());
+    if (literal == nullptr || !isNumber(literal->value))
+      return false;
+    value = unboxNumber(literal->value);
+    return !std::isnan(value);
+  }
+
+  // The local a loop counts with and its step, for loops shaped like
+  // `for (var i = ...; i < bound; i = i + step)`, or -1. `<=`, `>`, `>=`,
+  // `step + i` and `i - step` work too.
+  int counter(For &loop, double &step) {
+    Var *var = dynamic_cast<Var*>(loop.initializer.get());
+    Binary *test = dynamic_cast<Binary*>(loop.condition.get());
+    Assign *update = dynamic_cast<Assign*>(loop.increment.get());
+    if (var == nullptr || var->local < 0 || var->cell || test == nullptr || update == nullptr || update->local != var->local)
+      return -1;
+    switch (test->op.type) {
+      case TokenType::GREATER:
+      case TokenType::GREATER_EQUAL:
+      case TokenType::LESS:
+      case TokenType::LESS_EQUAL:
+        break;
+      default:
+        return -1;
+    }
+    if (!isLocal(test->left, var->local))
+      return -1;
+
+    Binary *next = dynamic_cast<Binary*>(update->value.get());
+    if (next == nullptr)
+      return -1;
+    if (next->op.type == TokenType::PLUS) {
+      if ((isLocal(next->left, var->local) && isConstant(next->right, step))
+          || (isConstant(next->left, step) && isLocal(next->right, var->local)))
+        return var->local;
+    } else if (next->op.type == TokenType::MINUS) {
+      if (isLocal(next->left, var->local) && isConstant(next->right, step)) {
+        step = -step;
+        return var->local;
+      }
+    }
+    return -1;
+  }
+}
+
+TypeInference::TypeInference(const Resolver &resolver) : resolver { resolver } {
+  slots.resize(resolver.localCount(), -1);
+}
+
+void TypeInference::analyze(std::vector<std::shared_ptr<Stmt>> &statements) {
+  for (std::shared_ptr<Stmt> &stmt : statements)
+    analyze(stmt);
+}
+
+void TypeInference::analyze(std::shared_ptr<Stmt> &stmt) {
+  if (stmt != nullptr)
+    stmt->accept(*this);
+}
+
+StaticType TypeInference::infer(std::shared_ptr<Expr> &expr) {
+  if (expr == nullptr)
+    return StaticType::Other;
+  return std::any_cast<StaticType>(expr->accept(*this));
+}
+
+void TypeInference::set(int local, StaticType type) {
+  if (local < 0)
+    return;
+  if (slots[local] < 0)
+    slots[local] = slotCount++;
+  size_t slot = slots[local];
+  if (state.locals.size() <= slot)
+    state.locals.resize(slot + 1, StaticType::None);
+  state.locals[slot] = resolver.isStable(local) ? type : StaticType::Other;
+}
+
+StaticType TypeInference::get(const State &state, int local) const {
+  if (local < 0)
+    return StaticType::Other;
+  if (slots[local] < 0 || static_cast<size_t>(slots[local]) >= state.locals.size())
+    return StaticType::None;
+  return state.locals[slots[local]];
+}
+
+void TypeInference::refine(std::shared_ptr<Expr> &operand) {
+  if (Variable *variable = dynamic_cast<Variable*>(operand.get()))
+    set(variable->local, StaticType::Number);
+}
+
+void TypeInference::merge(const State &other) {
+  if (!other.reachable)
+    return;
+  if (!state.reachable) {
+    state = other;
+    return;
+  }
+  if (state.locals.size() < other.locals.size())
+    state.locals.resize(other.locals.size(), StaticType::None);
+  for (size_t i = 0; i < other.locals.size(); ++i)
+    state.locals[i] = join(state.locals[i], other.locals[i]);
+}
+
+std::any TypeInference::visitAssignExpr(Assign &expr) {
+  StaticType type = infer(expr.value);
+  set(expr.local, type);
+  assignments++;
+  expr.numeric = NumericForm::None;
+  return type;
+}
+
+std::any TypeInference::visitGroupingExpr(Grouping &expr) {
+  StaticType type = infer(expr.expr);
+  expr.numeric = expr.expr->numeric != NumericForm::None ? NumericForm::Grouping : NumericForm::None;
+  return type;
+}
+
+std::any TypeInference::visitBinaryExpr(Binary &expr) {
+  StaticType left = infer(expr.left);
+  int before = assignments;
+  StaticType right = infer(expr.right);
+  bool unboxed = expr.left->numeric != NumericForm::None && expr.right->numeric != NumericForm::None;
+  expr.numeric = NumericForm::None;
+
+  switch (expr.op.type) {
+    case TokenType::PLUS:
+      if (unboxed)
+        expr.numeric = NumericForm::Arithmetic;
+      return left == StaticType::Number && right == StaticType::Number ? StaticType::Number : StaticType::Other;
+    case TokenType::MINUS:
+    case TokenType::SLASH:
+    case TokenType::STAR:
+    case TokenType::GREATER:
+    case TokenType::GREATER_EQUAL:
+    case TokenType::LESS:
+    case TokenType::LESS_EQUAL: {
+      // evaluation only gets past these with two numbers; the left operand
+      // was read before the right one ran, which may have reassigned it
+      if (assignments == before)
+        refine(expr.left);
+      refine(expr.right);
+      bool arithmetic = expr.op.type == TokenType::MINUS || expr.op.type == TokenType::SLASH || expr.op.type == TokenType::STAR;
+      if (!arithmetic)
+        return StaticType::Other;
+      if (unboxed)
+        expr.numeric = NumericForm::Arithmetic;
+      return StaticType::Number;
+    }
+    default:
+      return StaticType::Other;
+  }
+}
+
+std::any TypeInference::visitCallExpr(Call &expr) {
+  infer(expr.callee);
+  for (std::shared_ptr<Expr> &argument : expr.arguments)
+    infer(argument);
+  return StaticType::Other;
+}
+
+std::any TypeInference::visitGetExpr(Get &expr) {
+  infer(expr.object);
+  return StaticType::Other;
+}
+
+std::any TypeInference::visitSetExpr(Set &expr) {
+  infer(expr.object);
+  return infer(expr.value);
+}
+
+std::any TypeInference::visitThisExpr(This &expr) {
+  return StaticType::Other;
+}
+
+std::any TypeInference::visitSuperExpr(Super &expr) {
+  return StaticType::Other;
+}
+
+std::any TypeInference::visitArrayLiteralExpr(ArrayLiteral &expr) {
+  for (std::shared_ptr<Expr> &element : expr.elements)
+    infer(element);
+  return StaticType::Other;
+}
+
+std::any TypeInference::visitMapLiteralExpr(MapLiteral &expr) {
+  for (size_t i = 0; i < expr.keys.size(); ++i) {
+    infer(expr.keys[i]);
+    infer(expr.values[i]);
+  }
+  return StaticType::Other;
+}
+
+std::any TypeInference::visitIndexExpr(Index &expr) {
+  infer(expr.object);
+  infer(expr.index);
+  return StaticType::Other;
+}
+
+std::any TypeInference::visitIndexSetExpr(IndexSet &expr) {
+  infer(expr.object);
+  infer(expr.index);
+  return infer(expr.value);
+}
+
+std::any TypeInference::visitLiteralExpr(Literal &expr) {
+  StaticType type = literalType(expr.value);
+  // an integer too big to unbox would only send every use the slow way
+  bool unboxed = type == StaticType::Number && !std::isnan(unboxNumber(expr.value));
+  expr.numeric = unboxed ? NumericForm::Literal : NumericForm::None;
+  return type;
+}
+
+std::any TypeInference::visitLogicalExpr(Logical &expr) {
+  StaticType left = infer(expr.left);
+  // the right operand only runs sometimes
+  State skipped = state;
+  StaticType right = infer(expr.right);
+  merge(skipped);
+  return join(left, right);
+}
+
+std::any TypeInference::visitUnaryExpr(Unary &expr) {
+  infer(expr.right);
+  expr.numeric = NumericForm::None;
+  if (expr.op.type != TokenType::MINUS)
+    return StaticType::Other;
+  refine(expr.right);
+  if (expr.right->numeric != NumericForm::None)
+    expr.numeric = NumericForm::Negate;
+  return StaticType::Number;
+}
+
+std::any TypeInference::visitVariableExpr(Variable &expr) {
+  StaticType type = get(state, expr.local);
+  expr.numeric = type == StaticType::Number ? NumericForm::Variable : NumericForm::None;
+  return type;
+}
+
+std::any TypeInference::visitBlockStmt(Block &stmt) {
+  analyze(stmt.statements);
+  return nullptr;
+}
+
+std::any TypeInference::visitVarStmt(Var &stmt) {
+  StaticType type = stmt.initializer != nullptr ? infer(stmt.initializer) : StaticType::Other;
+  set(stmt.local, type);
+  return nullptr;
+}
+
+std::any TypeInference::visitWhileStmt(While &stmt) {
+  if (!state.reachable) {
+    infer(stmt.condition);
+    analyze(stmt.body);
+    return nullptr;
+  }
+  // every pass overwrites the annotations of the previous one, so the
+  // final pass, run from the fixpoint, is the one that sticks
+  while (true) {
+    State head = state;
+    infer(stmt.condition);
+    State exit = state;
+    analyze(stmt.body);
+    merge(head);
+    if (state == head) {
+      state = exit;
+      return nullptr;
+    }
+  }
+}
+
+std::any TypeInference::visitForStmt(For &stmt) {
+  analyze(stmt.initializer);
+  stmt.counted = false;
+  if (!state.reachable) {
+    infer(stmt.condition);
+    analyze(stmt.body);
+    infer(stmt.increment);
+    return nullptr;
+  }
+  // as for while loops, the final pass is the one whose annotations stick
+  while (true) {
+    State head = state;
+    infer(stmt.condition);
+    State exit = state;
+    analyze(stmt.body);
+    if (stmt.increment != nullptr)
+      infer(stmt.increment);
+    State next = state;
+    merge(head);
+    if (state == head) {
+      // the counter is checked to be a number on entry; after that the
+      // increment must leave a number behind every time it runs
+      int local = counter(stmt, stmt.step);
+      stmt.counted = local >= 0 && next.reachable && get(next, local) == StaticType::Number;
+      state = exit;
+      return nullptr;
+    }
+  }
+}
+
+std::any TypeInference::visitExpressionStmt(Expression &stmt) {
+  infer(stmt.expr);
+  return nullptr;
+}
+
+std::any TypeInference::visitFunctionStmt(Function &stmt) {
+  set(stmt.local, StaticType::Other);
+  analyzeFunction(stmt);
+  return nullptr;
+}
+
+std::any TypeInference::visitClassStmt(Class &stmt) {
+  infer(stmt.superclass);
+  set(stmt.local, StaticType::Other);
+  for (std::shared_ptr<Function> &method : stmt.methods)
+    analyzeFunction(*method);
+  return nullptr;
+}
+
+void TypeInference::analyzeFunction(Function &stmt) {
+  // a deferred body is analyzed once it is resolved
+  if (stmt.deferred)
+    return;
+  // the body runs later, once per call, with arguments of any type; it
+  // cannot see our locals, so it starts from a state of its own
+  State outer = std::move(state);
+  int outerSlots = slotCount;
+  state = State {};
+  slotCount = 0;
+  for (size_t i = 0; i < stmt.params.size(); ++i)
+    set(stmt.firstParam + i, StaticType::Other);
+  analyze(stmt.body);
+  state = std::move(outer);
+  slotCount = outerSlots;
+}
+
+std::any TypeInference::visitIfStmt(If &stmt) {
+  infer(stmt.condition);
+  State otherwise = state;
+  analyze(stmt.thenBranch);
+  std::swap(state, otherwise);
+  analyze(stmt.elseBranch);
+  merge(otherwise);
+  return nullptr;
+}
+
+std::any TypeInference::visitPrintStmt(Print &stmt) {
+  infer(stmt.expr);
+  return nullptr;
+}
+
+std::any TypeInference::visitReturnStmt(Return &stmt) {
+  infer(stmt.value);
+  state.reachable = false;
+  return nullptr;
+}
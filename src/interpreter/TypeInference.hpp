@@ -0,0 +1,89 @@
+#pragma once
+#include <any>
+#include <memory>
+#include <vector>
+#include "Expr.hpp"
+#include "Resolver.hpp"
+#include "Stmt.hpp"
+
+enum class StaticType : uint8_t {
+  // no value reaches this point yet
+  None,
+  Number,
+  Other,
+};
+
+// Flow-sensitive inference of which locals and expressions always hold
+// numbers, run over a resolved AST. Results are recorded in Expr::numeric.
+//
+// Types come from literals, from arithmetic (which always yields a number
+// or throws) and from checked operations: once `n < 2` has evaluated, a
+// local `n` must have been a number. Branches are joined and loops iterate
+// to a fixpoint. Parameters, globals, call results and locals a closure
+// may assign are unknown.
+class TypeInference : public ExprVisitor, public StmtVisitor {
+  // Indexed by slot, not by local id: every function numbers the locals it
+  // declares from 0, so copying the state at a branch only costs the
+  // locals of the function being analyzed. Slots past the end are None.
+  struct State {
+    std::vector<StaticType> locals;
+    bool reachable { true };
+
+    bool operator==(const State &other) const = default;
+  };
+
+  const Resolver &resolver;
+  State state;
+  // per local id, its slot in the declaring function, or -1 before the
+  // declaration is reached
+  std::vector<int> slots;
+  // slots handed out in the function being analyzed
+  int slotCount { 0 };
+  // bumped on every assignment, to tell whether an operand was reassigned
+  // while the other one was being evaluated
+  int assignments { 0 };
+
+public:
+  explicit TypeInference(const Resolver &resolver);
+
+  void analyze(std::vector<std::shared_ptr<Stmt>> &statements);
+
+  std::any visitAssignExpr(Assign &expr) override;
+  std::any visitGroupingExpr(Grouping &expr) override;
+  std::any visitBinaryExpr(Binary &expr) override;
+  std::any visitCallExpr(Call &expr) override;
+  std::any visitGetExpr(Get &expr) override;
+  std::any visitSetExpr(Set &expr) override;
+  std::any visitThisExpr(This &expr) override;
+  std::any visitSuperExpr(Super &expr) override;
+  std::any visitArrayLiteralExpr(ArrayLiteral &expr) override;
+  std::any visitMapLiteralExpr(MapLiteral &expr) override;
+  std::any visitIndexExpr(Index &expr) override;
+  std::any visitIndexSetExpr(IndexSet &expr) override;
+  std::any visitLiteralExpr(Literal &expr) override;
+  std::any visitLogicalExpr(Logical &expr) override;
+  std::any visitUnaryExpr(Unary &expr) override;
+  std::any visitVariableExpr(Variable &expr) override;
+
+  std::any visitBlockStmt(Block &stmt) override;
+  std::any visitVarStmt(Var &stmt) override;
+  std::any visitWhileStmt(While &stmt) override;
+  std::any visitForStmt(For &stmt) override;
+  std::any visitExpressionStmt(Expression &stmt) override;
+  std::any visitFunctionStmt(Function &stmt) override;
+  std::any visitClassStmt(Class &stmt) override;
+  std::any visitIfStmt(If &stmt) override;
+  std::any visitPrintStmt(Print &stmt) override;
+  std::any visitReturnStmt(Return &stmt) override;
+
+private:
+  void analyze(std::shared_ptr<Stmt> &stmt);
+  StaticType infer(std::shared_ptr<Expr> &expr);
+  void analyzeFunction(Function &function);
+  void set(int local, StaticType type);
+  StaticType get(const State &state, int local) const;
+  // the operand was checked to be a number
+  void refine(std::shared_ptr<Expr> &operand);
+  // joins the state of another path into the current one
+  void merge(const State &other);
+};
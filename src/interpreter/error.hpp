@@ -4,12 +4,9 @@
 #include "Token.hpp"
 #include "RuntimeError.hpp"
 
-extern bool hadError;
 extern bool hadRuntimeError;
 
-void report(int line, std::string where, std::string message);
-void error(int line, std::string message);
-void error(Token token, std::string message);
-void runtimeError(RuntimeError error);
+// scan and parse errors are collected in Diagnostics instead
+void runtimeError(const RuntimeError &error);
 
 #endif
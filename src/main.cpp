@@ -1,3 +1,4 @@
+#include <charconv>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
@@ -10,20 +11,39 @@
 #include "interpreter/error.hpp"
 #include "interpreter/Parser.hpp"
 #include "interpreter/Interpreter.hpp"
+#include "interpreter/Resolver.hpp"
+#include "interpreter/TypeInference.hpp"
+#include "interpreter/Profiler.hpp"
+#include "interpreter/ExecutionStats.hpp"
+#include "interpreter/MemoryStats.hpp"
+#include "interpreter/Jit.hpp"
+#include "interpreter/Server.hpp"
+#include "interpreter/Checker.hpp"
+#include "interpreter/Snapshot.hpp"
+#include "interpreter/ClosureEngine.hpp"
 
-bool hadError = false;
-bool hadRuntimeError = false;
 Interpreter interpreter { };
+bool hadError = false;
 
-void run(std::string source) {
-  Scanner scanner(source);
+// returns the statements run, which a snapshot needs to find functions in
+std::vector<std::shared_ptr<Stmt>> run(std::string source) {
+  Diagnostics diagnostics;
+  Scanner scanner(source, diagnostics);
   std::vector<Token> tokens = scanner.scanTokens();
-  Parser parser { tokens };
+  Parser parser { tokens, diagnostics, true };
   std::vector<std::shared_ptr<Stmt>> statements = parser.parse();
 
-  if (hadError)
-    return;
+  Resolver resolver { diagnostics };
+  if (!diagnostics.hasErrors())
+    resolver.resolve(statements);
+  if (diagnostics.hasErrors()) {
+    diagnostics.print(std::cout);
+    hadError = true;
+    return {};
+  }
+  TypeInference { resolver }.analyze(statements);
   interpreter.interpret(statements);
+  return statements;
 }
 
 void runPrompt() {
@@ -38,24 +58,201 @@ void runPrompt() {
   }
 }
 
-void runFile(std::string path) {
+std::string readFile(const std::string &path) {
   std::ifstream f(path);
   std::stringstream buff;
   buff << f.rdbuf();
-  run(buff.str());
+  return buff.str();
+}
+
+int runFile(std::string path) {
+  std::string source = readFile(path);
+  if (interpreter.stats != nullptr)
+    interpreter.stats->setSource(source);
+  run(source);
   if (hadError)
-    exit(65);
+    return 65;
   if (hadRuntimeError)
-    exit(70);
+    return 70;
+  return 0;
+}
+
+// runs a prelude and saves the state it leaves behind
+int snapshotFile(const std::string &path, const std::string &imagePath) {
+  std::string source = readFile(path);
+  std::vector<std::shared_ptr<Stmt>> statements = run(source);
+  if (hadError)
+    return 65;
+  if (hadRuntimeError)
+    return 70;
+  return saveSnapshot(imagePath, source, statements, interpreter) ? 0 : 74;
+}
+
+// a whole number of calls, iterations or seconds, at least 1
+bool parseThreshold(const std::string &text, int &threshold) {
+  const char *end = text.data() + text.size();
+  auto [stop, error] = std::from_chars(text.data(), end, threshold);
+  return error == std::errc {} && stop == end && threshold > 0;
+}
+
+int usage() {
+  std::cout << "Usage: lox [--profile=out.folded] [--stats[=report.txt]] [--stats-source=annotated.txt]\n"
+            << "           [--mem-stats[=report.txt]] [--jit[=threshold]] [--engine=tree|closure]\n"
+            << "           [--from-snapshot image] [script]\n"
+            << "       lox --snapshot image prelude\n"
+            << "       lox --check script...\n"
+            << "       lox --serve path.sock [--time-limit=seconds]\n"
+            << "       lox --client path.sock script" << std::endl;
+  return -1;
 }
 
 int main(int argc, char *argv[]) {
-  if (argc > 2) {
-    std::cout << "Usage: lox [script]" << std::endl;
-    return -1;
-  } else if (argc == 2) {
-    runFile(argv[1]);
-  } else {
+  std::vector<std::string> scripts;
+  std::string profilePath;
+  std::string statsPath;
+  std::string statsSourcePath;
+  std::string memStatsPath;
+  bool collectStats = false;
+  bool memStats = false;
+  bool useJit = false;
+  int jitThreshold = 0;
+  std::string engineName = "tree";
+  bool checkOnly = false;
+  std::string servePath;
+  int timeLimit = 30;
+  bool timeLimitSet = false;
+  std::string clientPath;
+  std::string snapshotPath;
+  std::string fromSnapshotPath;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.starts_with("--profile="))
+      profilePath = arg.substr(std::string("--profile=").size());
+    else if (arg == "--stats")
+      collectStats = true;
+    else if (arg.starts_with("--stats="))
+      collectStats = true, statsPath = arg.substr(std::string("--stats=").size());
+    else if (arg.starts_with("--stats-source="))
+      collectStats = true, statsSourcePath = arg.substr(std::string("--stats-source=").size());
+    else if (arg == "--mem-stats")
+      memStats = true;
+    else if (arg.starts_with("--mem-stats="))
+      memStats = true, memStatsPath = arg.substr(std::string("--mem-stats=").size());
+    else if (arg == "--jit")
+      useJit = true;
+    else if (arg.starts_with("--jit=") && parseThreshold(arg.substr(std::string("--jit=").size()), jitThreshold))
+      useJit = true;
+    else if (arg.starts_with("--engine="))
+      engineName = arg.substr(std::string("--engine=").size());
+    else if (arg == "--check")
+      checkOnly = true;
+    else if (arg == "--serve" && i + 1 < argc)
+      servePath = argv[++i];
+    else if (arg.starts_with("--time-limit=") && parseThreshold(arg.substr(std::string("--time-limit=").size()), timeLimit))
+      timeLimitSet = true;
+    else if (arg == "--client" && i + 1 < argc)
+      clientPath = argv[++i];
+    else if (arg == "--snapshot" && i + 1 < argc)
+      snapshotPath = argv[++i];
+    else if (arg == "--from-snapshot" && i + 1 < argc)
+      fromSnapshotPath = argv[++i];
+    else if (arg.starts_with("--"))
+      return usage();
+    else
+      scripts.push_back(arg);
+  }
+  // the profiler, statistics and the JIT hook into the tree walker only
+  if (engineName != "tree" && (engineName != "closure" || useJit || collectStats || !profilePath.empty()))
+    return usage();
+  if (timeLimitSet && servePath.empty())
+    return usage();
+  if (checkOnly)
+    return scripts.empty() ? usage() : checkFiles(scripts, std::cout);
+  if (scripts.size() > 1)
+    return usage();
+
+  if (!servePath.empty()) {
+    if (!scripts.empty() || !clientPath.empty())
+      return usage();
+    Server server { servePath, interpreter, static_cast<unsigned>(timeLimit) };
+    if (!server.listen())
+      return 69;
+    server.serve();
+    return 0;
+  }
+  if (!clientPath.empty()) {
+    if (scripts.size() != 1)
+      return usage();
+    return runClient(clientPath, readFile(scripts[0]));
+  }
+
+  if (!snapshotPath.empty()) {
+    if (scripts.size() != 1 || !fromSnapshotPath.empty())
+      return usage();
+    return snapshotFile(scripts[0], snapshotPath);
+  }
+  if (!fromSnapshotPath.empty() && !loadSnapshot(fromSnapshotPath, interpreter))
+    return 66;
+
+  std::unique_ptr<ClosureEngine> engine;
+  if (engineName == "closure") {
+    engine = std::make_unique<ClosureEngine>(interpreter);
+    interpreter.engine = engine.get();
+  }
+
+  std::unique_ptr<Profiler> profiler;
+  if (!profilePath.empty()) {
+    profiler = std::make_unique<Profiler>();
+    interpreter.profiler = profiler.get();
+    profiler->start();
+  }
+
+  std::unique_ptr<ExecutionStats> stats;
+  if (collectStats) {
+    stats = std::make_unique<ExecutionStats>();
+    interpreter.stats = stats.get();
+  }
+
+  std::unique_ptr<Jit> jit;
+  if (useJit && Jit::supported()) {
+    jit = jitThreshold > 0 ? std::make_unique<Jit>(interpreter, jitThreshold, jitThreshold) : std::make_unique<Jit>(interpreter);
+    interpreter.jit = jit.get();
+  } else if (useJit) {
+    std::cerr << "--jit is only available on x86-64; running interpreted." << std::endl;
+  }
+
+  int status = 0;
+  if (scripts.size() == 1)
+    status = runFile(scripts[0]);
+  else
     runPrompt();
+
+  if (profiler != nullptr) {
+    profiler->stop();
+    if (!profiler->write(profilePath))
+      std::cerr << "Could not write profile to " << profilePath << std::endl;
+  }
+
+  if (stats != nullptr) {
+    if (statsPath.empty()) {
+      stats->report(std::cerr);
+    } else {
+      std::ofstream out(statsPath);
+      stats->report(out);
+    }
+    if (!statsSourcePath.empty()) {
+      std::ofstream out(statsSourcePath);
+      stats->annotate(out);
+    }
+  }
+
+  if (memStats) {
+    if (memStatsPath.empty()) {
+      MemoryStats::report(std::cerr);
+    } else {
+      std::ofstream out(memStatsPath);
+      MemoryStats::report(out);
+    }
   }
+  return status;
 }
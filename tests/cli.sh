@@ -0,0 +1,350 @@
+#!/bin/sh
+# Command-line behavior the golden scripts cannot show: flag parsing,
+# reports written to files, snapshots and the server.
+#
+#   cli.sh path/to/lox
+lox=$(realpath "$1")
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+cd "$scratch" || exit 1
+failed=0
+
+# check NAME EXPECTED ACTUAL
+check() {
+  if [ "$2" != "$3" ]; then
+    echo "FAIL $1"
+    echo "expected: $2"
+    echo "actual:   $3"
+    failed=1
+  fi
+}
+
+# OUTPUT COMMAND...: the command's stdout followed by its exit status
+output() {
+  "$@"
+  echo "exit: $?"
+}
+
+echo 'print 1 + 2;' > three.lox
+
+# --jit takes a positive whole threshold; anything else is a usage error
+check "jit threshold" "3
+exit: 0" "$(output "$lox" --jit=5 three.lox)"
+for flag in --jit= --jit=foo --jit=0 --jit=-1 --jit=5x; do
+  "$lox" "$flag" three.lox > /dev/null
+  check "$flag" 255 $?
+done
+
+# --engine picks tree or closure; the closure engine has no JIT, profiler
+# or statistics, so asking for those with it is a usage error too
+for engine in tree closure; do
+  check "engine $engine" "3
+exit: 0" "$(output "$lox" --engine=$engine three.lox)"
+done
+for flags in --engine= --engine=bogus "--engine=closure --jit" "--engine=closure --stats" \
+    "--engine=closure --profile=out.folded"; do
+  "$lox" $flags three.lox > /dev/null
+  check "$flags" 255 $?
+done
+
+# samples are folded into one line per Lox call stack, each frame named
+# after the function and the line it was called from
+cat > hot.lox <<'LOX'
+fun inner(n) {
+  var total = 0;
+  for (var i = 0; i < n; i = i + 1) total = total + i;
+  return total;
+}
+fun outer() { return inner(3000000); }
+print outer();
+LOX
+check "profile run" "4499998500000
+exit: 0" "$(output "$lox" --profile=hot.folded hot.lox)"
+check "profile hottest stack" "<script>;outer:7;inner:6" "$(sort -k2 -n hot.folded | tail -1 | cut -d' ' -f1)"
+check "profile format" "" "$(grep -Ev '^<script>(;[A-Za-z_]+:[0-9]+)* [0-9]+$' hot.folded)"
+
+# --check reports every error of every file, in the order the files were
+# given, and runs none of them
+printf 'print "ran";\nfun f() { return 2; }\n' > clean.lox
+printf 'var = 1;\nprint (2;\nfun g( { }\nclass { }\nprint "fine";\n' > errors.lox
+printf 'print "ran";\nreturn 3;\n' > toplevel.lox
+check "check errors" "errors.lox:[line 1] Error at '=': Expect variable name.
+errors.lox:[line 2] Error at ';': Expect ')' after expression.
+errors.lox:[line 3] Error at '{': Expect parameter name.
+errors.lox:[line 4] Error at '{': Expect class name.
+toplevel.lox:[line 2] Error at 'return': Can't return from top-level code.
+exit: 65" "$(output "$lox" --check clean.lox errors.lox toplevel.lox)"
+check "check clean" "exit: 0" "$(output "$lox" --check clean.lox)"
+many=
+for n in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16; do
+  printf 'print %s +;\n' "$n" > "many$n.lox"
+  many="$many many$n.lox"
+done
+check "check order" "1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16" \
+  "$("$lox" --check $many | sed 's/^many\([0-9]*\)\.lox.*/\1/' | tr '\n' ' ' | sed 's/ $//')"
+check "check unreadable" "missing.lox: Could not read file.
+exit: 66" "$(output "$lox" --check errors.lox missing.lox | tail -2)"
+
+# a source big enough to be scanned in several chunks on a machine with
+# several cores, with strings and comments that could fool a chunk
+# boundary, runs as if scanned in one (equivalence.cpp forces the chunks)
+awk 'BEGIN {
+  print "var total = 0;"
+  for (i = 1; i <= 20000; i++) {
+    print "// comment with \"quotes\" and /* stars */ " i
+    print "var s" i " = \"a string that spans"
+    print "two lines // and looks like a comment\";"
+    print "total = total + " i "; // trailing \" quote"
+  }
+  print "print total;"
+  print "print s20000;"
+  print "nil + 1;"
+}' > large.lox
+check "chunked scan" "200010000
+a string that spans
+two lines // and looks like a comment
+Operands must be two numbers or two strings.
+[line 80004]
+exit: 70" "$(output "$lox" large.lox)"
+
+# foreign() refuses malformed signatures, libraries and symbols with a
+# runtime error naming the problem
+ffi() {
+  echo "foreign(\"$1\", \"$2\", \"$3\");" > foreign.lox
+  "$lox" foreign.lox | head -1
+}
+shape="Signature must look like 'double(double, int64)'."
+for signature in "double" "double(" "double(double" "double(double,)" "double(double) x" ""; do
+  check "foreign '$signature'" "$shape" "$(ffi libm.so.6 cos "$signature")"
+done
+check "foreign unknown type" "Unknown type 'float' in signature." "$(ffi libm.so.6 cos "double(float)")"
+check "foreign missing return type" "Unknown type '' in signature." "$(ffi libm.so.6 cos "(double)")"
+check "foreign void parameter" "A parameter cannot be void." "$(ffi libm.so.6 cos "double(double, void)")"
+check "foreign too many" "Foreign functions take at most 6 int64 or string and 8 double parameters." \
+  "$(ffi "" labs "int64(int64, int64, int64, int64, int64, int64, string)")"
+check "foreign library" "Could not load library: nowhere.so: cannot open shared object file: No such file or directory." \
+  "$(ffi nowhere.so cos "double(double)")"
+check "foreign symbol" "Undefined symbol 'no_such_symbol' in the program." "$(ffi "" no_such_symbol "void()")"
+echo 'print foreign("", "getpid", "int64(void)")() > 0;' > foreign.lox
+check "foreign void list" "true
+exit: 0" "$(output "$lox" foreign.lox)"
+# nor can a snapshot hold one
+echo 'var cos = foreign("libm.so.6", "cos", "double(double)");' > foreign.lox
+check "foreign snapshot" "Cannot save foreign function 'cos'.
+exit: 74" "$(output "$lox" --snapshot foreign.bin foreign.lox 2>&1)"
+
+# file natives fail with a runtime error naming the problem
+fileError() {
+  echo "$1" > files.lox
+  "$lox" files.lox | head -1
+}
+echo 'some text' > text.txt
+check "file missing" "Could not open 'missing/x.txt': No such file or directory." \
+  "$(fileError 'openFile("missing/x.txt", "r");')"
+check "file mode" 'Mode must be "r", "w" or "a".' "$(fileError 'openFile("text.txt", "rw");')"
+check "file not readable" "File is not open for reading." \
+  "$(fileError 'var f = openFile("out.txt", "w"); readLine(f);')"
+check "file not writable" "File is not open for writing." \
+  "$(fileError 'var f = openFile("text.txt", "r"); writeAll(f, "x");')"
+check "file chunk size" "Chunk size must be a positive integer." \
+  "$(fileError 'var f = openFile("text.txt", "r"); readChunk(f, 1.5);')"
+check "file argument" "Argument must be a file." "$(fileError 'readLine(clock);')"
+check "file directory" "Could not read '.': Is a directory." \
+  "$(fileError 'var f = openFile(".", "r"); readLine(f);')"
+
+# every expression row, literals included, names its line and the rows
+# add up to the total
+cat > loop.lox <<'LOX'
+var a = 1;
+for (var i = 0; i < 3; i = i + 1) a = a + 2;
+print a;
+LOX
+"$lox" --stats=stats.txt loop.lox > /dev/null
+check "stats literal rows" "5 0" "$(grep -c 'Literal (line' stats.txt) $(grep 'Literal' stats.txt | grep -vc '(line')"
+check "stats expression total" \
+  "$(awk '/expressions evaluated/ { print $1 }' stats.txt)" \
+  "$(awk '/^== expressions/ { on = 1; next } /^==/ { on = 0 } on && NF { sum += $1 } END { print sum }' stats.txt)"
+
+# the annotated source counts the statements started on each line and
+# leaves lines that never ran blank
+cat > branch.lox <<'LOX'
+var a = 1;
+for (var i = 0; i < 3; i = i + 1) a = a + 2;
+if (a > 100)
+  print "never";
+LOX
+"$lox" --stats-source=annotated.txt branch.lox 2> /dev/null
+check "stats source" "           1 | var a = 1;
+           5 | for (var i = 0; i < 3; i = i + 1) a = a + 2;
+           1 | if (a > 100)
+             |   print \"never\";" "$(cat annotated.txt)"
+
+# the memory report adds up, and instances nothing refers to any more
+# are freed: each one is an allocation for the object and one for its
+# fields
+cat > objects.lox <<'LOX'
+class Point { init(x) { this.x = x; } }
+var kept = Point(1);
+for (var i = 0; i < 50; i = i + 1) Point(i);
+print kept.x;
+LOX
+"$lox" --mem-stats=memory.txt objects.lox > /dev/null
+check "memory totals" \
+  "$(awk '$1 == "total" { print $2, $4, $5 }' memory.txt)" \
+  "$(awk 'NR > 2 && $1 != "total" { live += $2; count += $4; frees += $5 } END { print live, count, frees }' memory.txt)"
+check "memory bounds" "" "$(awk 'NR > 2 && ($2 > $3 || $5 > $4) { print $1 }' memory.txt)"
+check "memory objects" "102 100" "$(awk '$1 == "object" { print $4, $5 }' memory.txt)"
+
+# a script run from a snapshot sees what the prelude left behind, closure
+# state included, as if the two had run as one script
+cat > prelude.lox <<'LOX'
+fun makeCounter() {
+  var count = 0;
+  fun next() {
+    count = count + 1;
+    return count;
+  }
+  return next;
+}
+class Greeter {
+  init(name) { this.name = name; }
+  greet() { return "hello " + this.name; }
+}
+var counter = makeCounter();
+counter();
+var greeter = Greeter("snapshot");
+var primes = [2, 3, 5, 7];
+var ages = { "ada": 36, "alan": 41 };
+var big = 9007199254740993;
+LOX
+cat > main.lox <<'LOX'
+print counter();
+print counter();
+print greeter.greet();
+print primes[3];
+print ages["alan"];
+print big + 1;
+LOX
+cat prelude.lox main.lox > whole.lox
+check "snapshot save" "exit: 0" "$(output "$lox" --snapshot image.bin prelude.lox)"
+check "snapshot load" "$(output "$lox" whole.lox)" "$(output "$lox" --from-snapshot image.bin main.lox)"
+head -c 100 image.bin > cut.bin
+check "snapshot truncated" "cut.bin: Snapshot is corrupt.
+exit: 66" "$(output "$lox" --from-snapshot cut.bin main.lox 2>&1)"
+cp image.bin flipped.bin
+printf 'X' | dd of=flipped.bin bs=1 seek=200 conv=notrunc 2> /dev/null
+check "snapshot damaged" "flipped.bin: Snapshot is corrupt.
+exit: 66" "$(output "$lox" --from-snapshot flipped.bin main.lox 2>&1)"
+check "snapshot not an image" "main.lox: Not a snapshot.
+exit: 66" "$(output "$lox" --from-snapshot main.lox main.lox 2>&1)"
+check "snapshot missing" "Could not read snapshot missing.bin
+exit: 66" "$(output "$lox" --from-snapshot missing.bin main.lox 2>&1)"
+# a prelude that fails leaves no image behind
+echo 'var a = 1; nil + 1;' > failing.lox
+check "snapshot failing prelude" "exit: 70 no image" \
+  "$(output "$lox" --snapshot failing.bin failing.lox 2> /dev/null | tail -1) $([ -e failing.bin ] || echo no image)"
+
+# scripts that crash or fail only fail their own request
+"$lox" --serve lox.sock --time-limit=2 &
+server=$!
+for attempt in 1 2 3 4 5 6 7 8 9 10; do
+  [ -S lox.sock ] && break
+  sleep 0.1
+done
+echo 'fun f(n) { return f(n + 1); } print f(0);' > deep.lox
+echo 'print "before"; nil + 1;' > fails.lox
+echo 'print "oops" +;' > broken.lox
+check "server crash" "Internal error: script terminated by signal 11.
+exit: 70" "$(output "$lox" --client lox.sock deep.lox)"
+check "server runtime error" "before
+Operands must be two numbers or two strings.
+[line 1]
+exit: 70" "$(output "$lox" --client lox.sock fails.lox)"
+check "server parse error" "[line 1] Error at ';': Expect expression.
+exit: 65" "$(output "$lox" --client lox.sock broken.lox)"
+check "server after errors" "3
+exit: 0" "$(output "$lox" --client lox.sock three.lox)"
+
+# a script sent again after an edit is only reparsed around the edit, and
+# runs as if parsed from scratch, even when the edit gives a kept `if`
+# an `else`
+cat > edited.lox <<'LOX'
+fun greet() { return "hello"; }
+var flag = false;
+if (flag) print "then"; // else print "else";
+print greet();
+LOX
+check "server edit before" "hello
+exit: 0" "$(output "$lox" --client lox.sock edited.lox)"
+sed -i 's|// else|else|' edited.lox
+check "server edit else" "else
+hello
+exit: 0" "$(output "$lox" --client lox.sock edited.lox)"
+sed -i 's|"hello"|"hello again"|' edited.lox
+check "server edit after" "else
+hello again
+exit: 0" "$(output "$lox" --client lox.sock edited.lox)"
+sed -i 's|"hello again";|"hello again" +;|' edited.lox
+check "server edit breaks" "[line 1] Error at ';': Expect expression.
+exit: 65" "$(output "$lox" --client lox.sock edited.lox)"
+sed -i 's|"hello again" +;|"fixed";|' edited.lox
+check "server edit fixed" "else
+fixed
+exit: 0" "$(output "$lox" --client lox.sock edited.lox)"
+
+# declarations a line added above moves are kept, and report their new
+# lines
+printf 'var n = 1;\nfun bad() { return n + nil; }\nprint bad();\n' > moved.lox
+check "server moved before" "Operands must be two numbers or two strings.
+[line 2]
+exit: 70" "$(output "$lox" --client lox.sock moved.lox)"
+sed -i '1i // a line added on top' moved.lox
+check "server moved after" "Operands must be two numbers or two strings.
+[line 3]
+exit: 70" "$(output "$lox" --client lox.sock moved.lox)"
+
+# each request starts from the interpreter the server set up, and clients
+# may overlap
+echo 'var leaked = 1; print leaked;' > define.lox
+echo 'print leaked;' > use.lox
+check "server define" "1
+exit: 0" "$(output "$lox" --client lox.sock define.lox)"
+check "server isolation" "Undefined variable 'leaked'.
+[line 1]
+exit: 70" "$(output "$lox" --client lox.sock use.lox)"
+clients=
+for client in 1 2 3 4 5 6 7 8; do
+  output "$lox" --client lox.sock three.lox > "client$client.txt" &
+  clients="$clients $!"
+done
+wait $clients
+check "server concurrent clients" "8" "$(cat client*.txt | grep -c '^3$')"
+
+# a script that never ends holds up no other client, and is killed once
+# it runs past the time limit
+echo 'while (true) {}' > spin.lox
+output "$lox" --client lox.sock spin.lox > spin.txt &
+spinner=$!
+sleep 0.2
+check "server while spinning" "3
+exit: 0 spinning" "$(output "$lox" --client lox.sock three.lox) $(kill -0 $spinner 2> /dev/null && echo spinning)"
+wait $spinner
+check "server time limit" "Script exceeded the time limit of 2 seconds.
+exit: 70" "$(cat spin.txt)"
+
+# names only evicted scripts used are dropped with them, so a server fed
+# ever new scripts levels off in size once its cache starts being dropped
+unique() {
+  awk -v r=$1 'BEGIN { for (j = 0; j < 300; j++) printf "var unique_name_%d_%d = %d;\n", r, j, j }' > unique.lox
+  "$lox" --client lox.sock unique.lox
+}
+rss() { awk '/VmRSS/ { print $2 }' /proc/$server/status; }
+for request in $(seq 1 300); do unique $request; done
+before=$(rss)
+for request in $(seq 301 812); do unique $request; done
+after=$(rss)
+check "server memory bounded" "bounded" "$([ $((after - before)) -lt 8192 ] && echo bounded || echo "grew from ${before} kB to ${after} kB")"
+kill $server
+wait $server 2> /dev/null
+
+exit $failed
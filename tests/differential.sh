@@ -0,0 +1,26 @@
+#!/bin/sh
+# Runs the examples, the benchmarks and the golden scripts once plainly and
+# once with the given flags (--jit=1, say, or --engine=closure) and fails
+# if their output or exit status differ.
+#
+#   differential.sh path/to/lox flags...
+lox=$(realpath "$1")
+shift
+root=$(dirname "$(realpath "$0")")/..
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+failed=0
+for script in "$root"/examples/*.lox "$root"/benchmarks/*.lox "$root"/tests/lox/*.lox; do
+  name=$(basename "$script" .lox)
+  rm -rf "$scratch/plain" "$scratch/flags"
+  mkdir "$scratch/plain" "$scratch/flags"
+  plain=$(cd "$scratch/plain" && "$lox" "$script" 2>/dev/null; echo "exit: $?")
+  flagged=$(cd "$scratch/flags" && "$lox" "$@" "$script" 2>/dev/null; echo "exit: $?")
+  if [ "$plain" != "$flagged" ]; then
+    echo "FAIL $script $*"
+    printf '%s\n' "$plain" > "$scratch/plain.out"
+    printf '%s\n' "$flagged" | diff -u "$scratch/plain.out" -
+    failed=1
+  fi
+done
+exit $failed
@@ -0,0 +1,851 @@
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "interpreter/Diagnostics.hpp"
+#include "interpreter/IncrementalParser.hpp"
+#include "interpreter/Number.hpp"
+#include "interpreter/Parser.hpp"
+#include "interpreter/Resolver.hpp"
+#include "interpreter/Scanner.hpp"
+#include "interpreter/TypeInference.hpp"
+
+// Randomized checks that the faster front-end paths give exactly what the
+// straightforward ones do: the precedence-climbing expression parser
+// against the recursive-descent grammar it replaced, the chunked lexer
+// against a single pass, and incremental reparsing after an edit against
+// parsing the edited script from scratch.
+//
+//   lox_equivalence [seed]
+//
+// The seed is fixed unless given, so a run is repeatable; a failure prints
+// the seed and the source that diverged.
+
+namespace {
+  // Prints a tree as nested lists with every field the front end fills in.
+  // Local ids are renumbered per top-level statement in order of
+  // appearance, since only which references share a declaration matters,
+  // not the ids themselves.
+  struct Dumper : public ExprVisitor, public StmtVisitor {
+    std::ostringstream out;
+    std::map<int, int> locals;
+
+    std::string dump(std::vector<std::shared_ptr<Stmt>> &statements) {
+      for (std::shared_ptr<Stmt> &stmt : statements) {
+        locals.clear();
+        dump(stmt);
+        out << "\n";
+      }
+      return out.str();
+    }
+    void dump(std::shared_ptr<Stmt> &stmt) {
+      if (stmt == nullptr)
+        out << " null";
+      else
+        stmt->accept(*this);
+    }
+    void dump(std::shared_ptr<Expr> &expr) {
+      if (expr == nullptr) {
+        out << " null";
+        return;
+      }
+      expr->accept(*this);
+      if (expr->numeric != NumericForm::None)
+        out << "#" << static_cast<int>(expr->numeric);
+    }
+    void token(const Token &token) {
+      out << " " << token.lexeme->str() << "@" << token.line;
+    }
+    void local(int id) {
+      if (id < 0)
+        return;
+      auto [entry, inserted] = locals.try_emplace(id, locals.size());
+      out << "$" << entry->second;
+    }
+    void value(const std::any &value) {
+      if (value.type() == typeid(int64_t))
+        out << "i" << formatNumber(value);
+      else if (value.type() == typeid(double))
+        out << "d" << formatNumber(value);
+      else if (value.type() == typeid(bool))
+        out << (std::any_cast<bool>(value) ? "true" : "false");
+      else if (value.type() == typeid(StringRef))
+        out << '"' << std::any_cast<StringRef>(value)->str() << '"';
+      else
+        out << "nil";
+    }
+
+    std::any visitAssignExpr(Assign &expr) override {
+      out << " (Assign";
+      token(expr.name);
+      local(expr.local);
+      dump(expr.value);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitGroupingExpr(Grouping &expr) override {
+      out << " (Grouping";
+      dump(expr.expr);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitBinaryExpr(Binary &expr) override {
+      out << " (Binary";
+      token(expr.op);
+      dump(expr.left);
+      dump(expr.right);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitCallExpr(Call &expr) override {
+      out << " (Call";
+      token(expr.paren);
+      dump(expr.callee);
+      for (std::shared_ptr<Expr> &argument : expr.arguments)
+        dump(argument);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitGetExpr(Get &expr) override {
+      out << " (Get";
+      token(expr.name);
+      dump(expr.object);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitSetExpr(Set &expr) override {
+      out << " (Set";
+      token(expr.name);
+      dump(expr.object);
+      dump(expr.value);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitThisExpr(This &expr) override {
+      out << " (This";
+      token(expr.keyword);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitSuperExpr(Super &expr) override {
+      out << " (Super";
+      token(expr.keyword);
+      token(expr.method);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitArrayLiteralExpr(ArrayLiteral &expr) override {
+      out << " (ArrayLiteral";
+      token(expr.bracket);
+      for (std::shared_ptr<Expr> &element : expr.elements)
+        dump(element);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitMapLiteralExpr(MapLiteral &expr) override {
+      out << " (MapLiteral";
+      token(expr.brace);
+      for (size_t i = 0; i < expr.keys.size(); ++i) {
+        dump(expr.keys[i]);
+        dump(expr.values[i]);
+      }
+      out << ")";
+      return nullptr;
+    }
+    std::any visitIndexExpr(Index &expr) override {
+      out << " (Index";
+      token(expr.bracket);
+      dump(expr.object);
+      dump(expr.index);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitIndexSetExpr(IndexSet &expr) override {
+      out << " (IndexSet";
+      token(expr.bracket);
+      dump(expr.object);
+      dump(expr.index);
+      dump(expr.value);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitLiteralExpr(Literal &expr) override {
+      out << " (Literal ";
+      value(expr.value);
+      out << "@" << expr.line << ")";
+      return nullptr;
+    }
+    std::any visitLogicalExpr(Logical &expr) override {
+      out << " (Logical";
+      token(expr.op);
+      dump(expr.left);
+      dump(expr.right);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitUnaryExpr(Unary &expr) override {
+      out << " (Unary";
+      token(expr.op);
+      dump(expr.right);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitVariableExpr(Variable &expr) override {
+      out << " (Variable";
+      token(expr.name);
+      local(expr.local);
+      out << ")";
+      return nullptr;
+    }
+
+    std::any visitBlockStmt(Block &stmt) override {
+      out << " (Block";
+      for (std::shared_ptr<Stmt> &inner : stmt.statements)
+        dump(inner);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitVarStmt(Var &stmt) override {
+      out << " (Var";
+      token(stmt.name);
+      local(stmt.local);
+      out << (stmt.cell ? " cell" : "");
+      dump(stmt.initializer);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitWhileStmt(While &stmt) override {
+      out << " (While";
+      dump(stmt.condition);
+      dump(stmt.body);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitForStmt(For &stmt) override {
+      out << " (For";
+      if (stmt.counted)
+        out << " counted " << stmt.step;
+      dump(stmt.initializer);
+      dump(stmt.condition);
+      dump(stmt.increment);
+      dump(stmt.body);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitExpressionStmt(Expression &stmt) override {
+      out << " (Expression";
+      dump(stmt.expr);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitFunctionStmt(Function &stmt) override {
+      out << " (Function";
+      token(stmt.name);
+      local(stmt.local);
+      out << (stmt.cell ? " cell" : "") << (stmt.isMethod ? " method" : "") << (stmt.hasSuperclass ? " super" : "");
+      for (size_t i = 0; i < stmt.params.size(); ++i) {
+        token(stmt.params[i]);
+        if (stmt.firstParam >= 0)
+          local(stmt.firstParam + i);
+        out << (stmt.cellParams[i] ? " cell" : "");
+      }
+      out << " captures";
+      for (StringRef &capture : stmt.captures)
+        out << " " << capture->str();
+      out << (stmt.deferred ? " deferred" : "") << " body";
+      for (std::shared_ptr<Stmt> &inner : stmt.body)
+        dump(inner);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitClassStmt(Class &stmt) override {
+      out << " (Class";
+      token(stmt.name);
+      local(stmt.local);
+      out << (stmt.cell ? " cell" : "");
+      dump(stmt.superclass);
+      for (std::shared_ptr<Function> &method : stmt.methods) {
+        std::shared_ptr<Stmt> inner = method;
+        dump(inner);
+      }
+      out << ")";
+      return nullptr;
+    }
+    std::any visitIfStmt(If &stmt) override {
+      out << " (If";
+      dump(stmt.condition);
+      dump(stmt.thenBranch);
+      dump(stmt.elseBranch);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitPrintStmt(Print &stmt) override {
+      out << " (Print";
+      dump(stmt.expr);
+      out << ")";
+      return nullptr;
+    }
+    std::any visitReturnStmt(Return &stmt) override {
+      out << " (Return";
+      token(stmt.keyword);
+      dump(stmt.value);
+      out << ")";
+      return nullptr;
+    }
+  };
+
+  std::string dump(std::shared_ptr<Expr> &expr) {
+    Dumper dumper;
+    dumper.dump(expr);
+    return dumper.out.str();
+  }
+
+  std::string dump(const Diagnostics &diagnostics) {
+    std::ostringstream out;
+    diagnostics.print(out);
+    return out.str();
+  }
+
+  // The expression grammar as one recursive-descent function per
+  // precedence level, the way the parser was written before it moved to a
+  // rule table. Statements and helpers are the real parser's.
+  struct ReferenceParser : public Parser {
+    using Parser::Parser;
+
+    Result<std::shared_ptr<Expr>> expression() {
+      return assignment();
+    }
+    Result<std::shared_ptr<Expr>> assignment() {
+      Result<std::shared_ptr<Expr>> expr = orExpr();
+      if (!expr)
+        return expr;
+      if (match(TokenType::EQUAL)) {
+        Token equals = previous();
+        Result<std::shared_ptr<Expr>> value = assignment();
+        if (!value)
+          return value;
+
+        if (Variable* varPtr = dynamic_cast<Variable*>(expr->get())) {
+          Token name = varPtr->name;
+          return node<Assign>(name, *value);
+        }
+        if (Get* getPtr = dynamic_cast<Get*>(expr->get())) {
+          Token name = getPtr->name;
+          return node<Set>(getPtr->object, name, *value);
+        }
+        if (Index* indexPtr = dynamic_cast<Index*>(expr->get())) {
+          Token bracket = indexPtr->bracket;
+          return node<IndexSet>(indexPtr->object, bracket, indexPtr->index, *value);
+        }
+        error(equals, "Invalid assignment target.");
+      }
+      return expr;
+    }
+    Result<std::shared_ptr<Expr>> orExpr() {
+      Result<std::shared_ptr<Expr>> expr = andExpr();
+      if (!expr)
+        return expr;
+      while (match(TokenType::OR)) {
+        Token op = previous();
+        Result<std::shared_ptr<Expr>> right = andExpr();
+        if (!right)
+          return right;
+        expr = node<Logical>(*expr, op, *right);
+      }
+      return expr;
+    }
+    Result<std::shared_ptr<Expr>> andExpr() {
+      Result<std::shared_ptr<Expr>> expr = equality();
+      if (!expr)
+        return expr;
+      while (match(TokenType::AND)) {
+        Token op = previous();
+        Result<std::shared_ptr<Expr>> right = equality();
+        if (!right)
+          return right;
+        expr = node<Logical>(*expr, op, *right);
+      }
+      return expr;
+    }
+
+    // a left-associative level; an operator of the level where an operand
+    // should be is reported once its right operand has been parsed
+    template<typename... Types>
+    Result<std::shared_ptr<Expr>> level(Result<std::shared_ptr<Expr>> (ReferenceParser::*next)(), Types... types) {
+      if (match(types...)) {
+        if ((this->*next)()) // discard
+          error(peek(), "Expect finished expression.");
+        return fail();
+      }
+      Result<std::shared_ptr<Expr>> expr = (this->*next)();
+      if (!expr)
+        return expr;
+      while (match(types...)) {
+        Token op = previous();
+        Result<std::shared_ptr<Expr>> right = (this->*next)();
+        if (!right)
+          return right;
+        expr = node<Binary>(*expr, op, *right);
+      }
+      return expr;
+    }
+    Result<std::shared_ptr<Expr>> equality() {
+      return level(&ReferenceParser::comparison, TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL);
+    }
+    Result<std::shared_ptr<Expr>> comparison() {
+      return level(&ReferenceParser::term, TokenType::GREATER, TokenType::GREATER_EQUAL, TokenType::LESS, TokenType::LESS_EQUAL);
+    }
+    Result<std::shared_ptr<Expr>> term() {
+      // a leading '-' is negation, so only '+' is a missing operand here
+      if (match(TokenType::PLUS)) {
+        if (factor()) // discard
+          error(peek(), "Expect finished expression.");
+        return fail();
+      }
+      Result<std::shared_ptr<Expr>> expr = factor();
+      if (!expr)
+        return expr;
+      while (match(TokenType::MINUS, TokenType::PLUS)) {
+        Token op = previous();
+        Result<std::shared_ptr<Expr>> right = factor();
+        if (!right)
+          return right;
+        expr = node<Binary>(*expr, op, *right);
+      }
+      return expr;
+    }
+    Result<std::shared_ptr<Expr>> factor() {
+      return level(&ReferenceParser::unary, TokenType::SLASH, TokenType::STAR);
+    }
+    Result<std::shared_ptr<Expr>> unary() {
+      if (match(TokenType::BANG, TokenType::MINUS)) {
+        Token op = previous();
+        Result<std::shared_ptr<Expr>> right = unary();
+        if (!right)
+          return right;
+        return node<Unary>(op, *right);
+      }
+      return call();
+    }
+    Result<std::shared_ptr<Expr>> call() {
+      Result<std::shared_ptr<Expr>> expr = primary();
+      if (!expr)
+        return expr;
+      while (true) {
+        if (match(TokenType::LEFT_PAREN)) {
+          expr = finishCall(*expr);
+          if (!expr)
+            return expr;
+        } else if (match(TokenType::DOT)) {
+          Result<Token> name = consume(TokenType::IDENTIFIER, "Expect property name after '.'.");
+          if (!name)
+            return fail();
+          expr = node<Get>(*expr, *name);
+        } else if (match(TokenType::LEFT_BRACKET)) {
+          Token bracket = previous();
+          Result<std::shared_ptr<Expr>> index = expression();
+          if (!index)
+            return index;
+          if (!consume(TokenType::RIGHT_BRACKET, "Expect ']' after index."))
+            return fail();
+          expr = node<Index>(*expr, bracket, *index);
+        } else {
+          break;
+        }
+      }
+      return expr;
+    }
+    Result<std::shared_ptr<Expr>> finishCall(std::shared_ptr<Expr> &callee) {
+      std::vector<std::shared_ptr<Expr>> args;
+      if (!check(TokenType::RIGHT_PAREN)) {
+        do {
+          if (args.size() >= 255)
+            error(peek(), "Can't have more than 255 arguments.");
+          Result<std::shared_ptr<Expr>> arg = expression();
+          if (!arg)
+            return arg;
+          args.push_back(*arg);
+        } while (match(TokenType::COMMA));
+      }
+      Result<Token> paren = consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
+      if (!paren)
+        return fail();
+      return node<Call>(callee, *paren, args);
+    }
+    Result<std::shared_ptr<Expr>> primary() {
+      if (match(TokenType::FALSE))
+        return node<Literal>(false, previous().line);
+      if (match(TokenType::TRUE))
+        return node<Literal>(true, previous().line);
+      if (match(TokenType::NIL))
+        return node<Literal>((void*) nullptr, previous().line);
+      if (match(TokenType::NUMBER, TokenType::STRING))
+        return node<Literal>(previous().literal, previous().line);
+      if (match(TokenType::THIS))
+        return node<This>(previous());
+      if (match(TokenType::SUPER)) {
+        Token keyword = previous();
+        if (!consume(TokenType::DOT, "Expect '.' after 'super'."))
+          return fail();
+        Result<Token> method = consume(TokenType::IDENTIFIER, "Expect superclass method name.");
+        if (!method)
+          return fail();
+        return node<Super>(keyword, *method);
+      }
+      if (match(TokenType::IDENTIFIER))
+        return node<Variable>(previous());
+      if (match(TokenType::LEFT_PAREN)) {
+        Result<std::shared_ptr<Expr>> expr = expression();
+        if (!expr)
+          return expr;
+        if (!consume(TokenType::RIGHT_PAREN, "Expect ')' after expression."))
+          return fail();
+        return node<Grouping>(*expr);
+      }
+      if (match(TokenType::LEFT_BRACKET)) {
+        Token bracket = previous();
+        std::vector<std::shared_ptr<Expr>> elements;
+        if (!check(TokenType::RIGHT_BRACKET)) {
+          do {
+            Result<std::shared_ptr<Expr>> element = expression();
+            if (!element)
+              return element;
+            elements.push_back(*element);
+          } while (match(TokenType::COMMA));
+        }
+        if (!consume(TokenType::RIGHT_BRACKET, "Expect ']' after array elements."))
+          return fail();
+        return node<ArrayLiteral>(bracket, elements);
+      }
+      if (match(TokenType::LEFT_BRACE)) {
+        Token brace = previous();
+        std::vector<std::shared_ptr<Expr>> keys;
+        std::vector<std::shared_ptr<Expr>> values;
+        if (!check(TokenType::RIGHT_BRACE)) {
+          do {
+            Result<std::shared_ptr<Expr>> key = expression();
+            if (!key)
+              return key;
+            if (!consume(TokenType::COLON, "Expect ':' after map key."))
+              return fail();
+            Result<std::shared_ptr<Expr>> value = expression();
+            if (!value)
+              return value;
+            keys.push_back(*key);
+            values.push_back(*value);
+          } while (match(TokenType::COMMA));
+        }
+        if (!consume(TokenType::RIGHT_BRACE, "Expect '}' after map entries."))
+          return fail();
+        return node<MapLiteral>(brace, keys, values);
+      }
+      error(peek(), "Expect expression.");
+      return fail();
+    }
+  };
+
+  struct Random {
+    std::mt19937 engine;
+
+    explicit Random(unsigned seed) : engine { seed } {}
+    // in [0, bound)
+    size_t below(size_t bound) { return std::uniform_int_distribution<size_t>(0, bound - 1)(engine); }
+    bool chance(size_t percent) { return below(100) < percent; }
+    template<typename T>
+    const T &pick(const std::vector<T> &options) { return options[below(options.size())]; }
+  };
+
+  // an expression in source form; spaces and newlines vary so tokens land
+  // on different lines
+  std::string randomExpression(Random &random, int depth) {
+    static const std::vector<std::string> atoms {
+      "1", "2.5", "0", "9007199254740993", "\"s\"", "\"\"", "a", "b", "c", "true", "false", "nil", "this", "super.m",
+    };
+    static const std::vector<std::string> binary {
+      "+", "-", "*", "/", "==", "!=", "<", "<=", ">", ">=", "and", "or",
+    };
+    std::string gap = random.chance(15) ? "\n" : " ";
+    if (depth <= 0 || random.chance(25))
+      return random.pick(atoms);
+    switch (random.below(9)) {
+      case 0:
+        return "(" + randomExpression(random, depth - 1) + ")";
+      case 1:
+        return std::string(random.chance(50) ? "-" : "!") + randomExpression(random, depth - 1);
+      case 2: {
+        std::string call = randomExpression(random, depth - 1) + "(";
+        for (size_t i = 0, count = random.below(3); i < count; ++i)
+          call += (i > 0 ? "," + gap : "") + randomExpression(random, depth - 1);
+        return call + ")";
+      }
+      case 3:
+        return randomExpression(random, depth - 1) + "." + random.pick(std::vector<std::string> { "x", "y" });
+      case 4:
+        return randomExpression(random, depth - 1) + "[" + randomExpression(random, depth - 1) + "]";
+      case 5: {
+        std::string array = "[";
+        for (size_t i = 0, count = random.below(3); i < count; ++i)
+          array += (i > 0 ? ", " : "") + randomExpression(random, depth - 1);
+        return array + "]";
+      }
+      case 6: {
+        std::string map = "{";
+        for (size_t i = 0, count = random.below(3); i < count; ++i)
+          map += (i > 0 ? ", " : "") + randomExpression(random, depth - 1) + ": " + randomExpression(random, depth - 1);
+        return map + "}";
+      }
+      case 7:
+        // the target is often something that cannot be assigned to
+        return randomExpression(random, depth - 1) + gap + "=" + gap + randomExpression(random, depth - 1);
+      default:
+        return randomExpression(random, depth - 1) + gap + random.pick(binary) + gap + randomExpression(random, depth - 1);
+    }
+  }
+
+  // a run of tokens with no grammar to it, to compare the error paths
+  std::string randomTokens(Random &random) {
+    static const std::vector<std::string> tokens {
+      "1", "\"s\"", "a", "b", "true", "nil", "this", "super", "(", ")", "[", "]", "{", "}", ",", ".", ":", "=",
+      "+", "-", "*", "/", "!", "==", "!=", "<", ">=", "and", "or", ";",
+    };
+    std::string source;
+    for (size_t i = 0, count = 1 + random.below(10); i < count; ++i)
+      source += random.pick(tokens) + (random.chance(10) ? "\n" : " ");
+    return source;
+  }
+
+  struct Checks {
+    unsigned seed;
+    int failures { 0 };
+
+    void fail(const std::string &what, const std::string &source, const std::string &expected, const std::string &actual) {
+      if (++failures > 5)
+        return;
+      std::cout << "FAIL " << what << " (seed " << seed << ")\n"
+                << "source:\n" << source << "\n"
+                << "expected:\n" << expected << "\n"
+                << "actual:\n" << actual << std::endl;
+    }
+  };
+
+  // one expression parsed both ways: the same tree, or the same errors,
+  // and the parser left at the same token
+  std::string parseExpression(const std::string &source, bool reference) {
+    Diagnostics diagnostics;
+    Scanner scanner(source, diagnostics);
+    std::vector<Token> tokens = scanner.scanTokens();
+    std::ostringstream out;
+    if (reference) {
+      ReferenceParser parser { tokens, diagnostics };
+      Parser::Result<std::shared_ptr<Expr>> expr = parser.expression();
+      out << (expr ? dump(*expr) : " failed") << "\nstopped at " << parser.current << "\n";
+    } else {
+      Parser parser { tokens, diagnostics };
+      Parser::Result<std::shared_ptr<Expr>> expr = parser.expression();
+      out << (expr ? dump(*expr) : " failed") << "\nstopped at " << parser.current << "\n";
+    }
+    out << dump(diagnostics);
+    return out.str();
+  }
+
+  // tokens with everything that tells them apart, then the errors
+  std::string scan(const std::string &source, size_t chunks) {
+    Diagnostics diagnostics;
+    Scanner scanner(source, diagnostics);
+    std::vector<Token> tokens = scanner.scanTokensInChunks(chunks);
+    std::ostringstream out;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+      out << static_cast<int>(tokens[i].type) << " " << tokens[i].lexeme->str() << "@" << tokens[i].line
+          << " +" << scanner.getOffsets()[i] << " ";
+      if (tokens[i].type == TokenType::NUMBER || tokens[i].type == TokenType::STRING) {
+        Dumper dumper;
+        dumper.value(tokens[i].literal);
+        out << dumper.out.str();
+      }
+      out << "\n";
+    }
+    out << "line " << scanner.getLine() << "\n" << dump(diagnostics);
+    return out.str();
+  }
+
+  // source made of pieces that straddle a chunk boundary in every way:
+  // strings and comments spanning lines, and the errors that end a scan
+  std::string randomSource(Random &random) {
+    static const std::vector<std::string> pieces {
+      "var a = 1;\n", "print a + 2.5;\n", "fun f(x) { return x * 3; }\n", "// a comment\n", "// \"not a string\n",
+      "/* block */", "/* spans\nlines\n*/", "/* has // and \" inside */", "\"a string\"", "\"spans\nlines\"",
+      "\"has // and /* inside\"", "\n", "\n\n", "  ", "\t", "9007199254740993", "12345678901234567890", "0.5",
+      "{ }", "a.b[c] = d;", "x != y and z <= w or !v;\n",
+    };
+    static const std::vector<std::string> endings { "", "\"unterminated", "/* unterminated", "@", "\n#\n" };
+    std::string source;
+    for (size_t i = 0, count = random.below(60); i < count; ++i)
+      source += random.pick(pieces);
+    if (random.chance(20))
+      source.insert(random.below(source.size() + 1), random.pick(endings));
+    return source;
+  }
+
+  void checkChunks(Checks &checks, Random &random) {
+    for (int i = 0; i < 1500; ++i) {
+      std::string source = randomSource(random);
+      std::string expected = scan(source, 1);
+      size_t chunks = 2 + random.below(7);
+      std::string actual = scan(source, chunks);
+      // the first run interned every string a second one needs, so the
+      // token memory counted here ends where it started once its tokens are
+      // gone, whichever thread made them
+      int64_t live = MemoryStats::get(MemoryCategory::Token).live;
+      scan(source, chunks);
+      if (expected != actual)
+        checks.fail("lexing in " + std::to_string(chunks) + " chunks vs one pass", source, expected, actual);
+      else if (MemoryStats::get(MemoryCategory::Token).live != live)
+        checks.fail("token memory after lexing in " + std::to_string(chunks) + " chunks", source, std::to_string(live),
+          std::to_string(MemoryStats::get(MemoryCategory::Token).live));
+    }
+  }
+
+  // a whole script as the incremental parser gives it: preparsed, resolved
+  // and analyzed, or nothing but the errors
+  std::string dump(std::vector<std::shared_ptr<Stmt>> &statements, const Diagnostics &diagnostics) {
+    if (diagnostics.hasErrors())
+      return "errors\n" + dump(diagnostics);
+    return Dumper {}.dump(statements);
+  }
+
+  std::string parseScript(const std::string &source) {
+    Diagnostics diagnostics;
+    Scanner scanner(source, diagnostics);
+    std::vector<Token> tokens = scanner.scanTokens();
+    Parser parser { tokens, diagnostics, true };
+    std::vector<std::shared_ptr<Stmt>> statements = parser.parse();
+    Resolver resolver { diagnostics };
+    if (!diagnostics.hasErrors())
+      resolver.resolve(statements);
+    if (!diagnostics.hasErrors())
+      TypeInference { resolver }.analyze(statements);
+    return dump(statements, diagnostics);
+  }
+
+  std::string randomScript(Random &random) {
+    static const std::vector<std::string> declarations {
+      "var a = 1;", "var s = \"text\";", "print a + 1;", "a = a * 2;",
+      "fun f(x) {\n  var y = x * 2;\n  return y;\n}",
+      "fun g() { fun h(n) { return n + a; } return h; }",
+      "fun counter() {\n  var n = 0;\n  fun next() { n = n + 1; return n; }\n  return next;\n}",
+      "class C {\n  init() { this.v = 1; }\n  get() { return this.v; }\n}",
+      "class D < C { get() { return super.get() + 1; } }",
+      "{ var t = 1; t = t + 1; print t; }",
+      "for (var i = 0; i < 3; i = i + 1) print i;",
+      "if (a < 2) print \"lt\"; else print \"ge\";",
+      "while (false) { a = -a; }", "print [1, 2][0] + {\"k\": 3}[\"k\"];",
+      "// a comment", "/* a block comment */", "print \"spans\nlines\";",
+    };
+    std::string script;
+    for (size_t i = 0, count = 1 + random.below(12); i < count; ++i)
+      script += random.pick(declarations) + (random.chance(70) ? "\n" : " ");
+    return script;
+  }
+
+  // inserts, deletes or replaces a few characters anywhere, which may open
+  // a string or comment, split a token or break the syntax
+  std::string randomEdit(Random &random, const std::string &source) {
+    static const std::vector<std::string> snippets {
+      "", " ", "\n", "1", "+", ";", "{", "}", "(", "\"", "/*", "*/", "//", "x", "var z = 2;", "print z;",
+      "fun k() { return 3; }", "return 1;",
+    };
+    size_t at = random.below(source.size() + 1);
+    size_t removed = random.chance(50) ? random.below(std::min<size_t>(10, source.size() - at) + 1) : 0;
+    return source.substr(0, at) + random.pick(snippets) + source.substr(at + removed);
+  }
+
+  void checkReparse(Checks &checks, Random &random) {
+    size_t reused = 0;
+    for (int i = 0; i < 300; ++i) {
+      IncrementalParser incremental;
+      std::string previous;
+      std::vector<std::shared_ptr<Stmt>> previousStatements;
+      std::string previousDump;
+      std::string source = randomScript(random);
+      for (int edit = 0; edit < 8; ++edit) {
+        Diagnostics diagnostics;
+        std::vector<std::shared_ptr<Stmt>> statements = incremental.update(source, diagnostics);
+        reused += incremental.reused();
+        std::string expected = parseScript(source);
+        std::string actual = dump(statements, diagnostics);
+        if (expected != actual) {
+          checks.fail("incremental reparse vs parse from scratch", previous + "\n-- edited to --\n" + source, expected, actual);
+          break;
+        }
+        // what the last version returned is left as it was
+        if (Dumper {}.dump(previousStatements) != previousDump) {
+          checks.fail("incremental reparse left the last version alone", previous + "\n-- edited to --\n" + source,
+            previousDump, Dumper {}.dump(previousStatements));
+          break;
+        }
+        previousStatements = statements;
+        previousDump = Dumper {}.dump(statements);
+        // now and then undo the edit, so a version that did not parse is
+        // followed by one that does, or start over
+        std::string next = random.chance(10) ? previous : random.chance(10) ? randomScript(random) : randomEdit(random, source);
+        previous = source;
+        source = next;
+      }
+    }
+    if (reused == 0)
+      checks.fail("incremental reparse", "", "some declarations reused", "none");
+  }
+
+  // lines added or removed above declarations move them without parsing
+  // them again
+  void checkLineShift(Checks &checks) {
+    const std::string tail = "fun f(x) {\n  return x + 1;\n}\nclass C {\n  m() { return this; }\n}\nvar v = f(1);\n";
+    const std::vector<std::pair<std::string, size_t>> versions {
+      { "var a = 1;\n", 0 },
+      { "var a = 1;\n\n// added\nprint a;\n", 4 },
+      { "var a = 1;\n", 4 },
+      { "var a = 1; ", 4 },
+    };
+    IncrementalParser incremental;
+    for (const auto &[head, reused] : versions) {
+      Diagnostics diagnostics;
+      std::vector<std::shared_ptr<Stmt>> statements = incremental.update(head + tail, diagnostics);
+      std::string expected = parseScript(head + tail);
+      std::string actual = dump(statements, diagnostics);
+      if (expected != actual)
+        checks.fail("declarations moved by an edit vs parse from scratch", head + tail, expected, actual);
+      else if (incremental.reused() != reused)
+        checks.fail("declarations moved by an edit reused", head + tail, std::to_string(reused),
+          std::to_string(incremental.reused()));
+    }
+  }
+
+  void checkExpressions(Checks &checks, Random &random) {
+    for (int i = 0; i < 4000; ++i) {
+      std::string source = i % 4 == 3 ? randomTokens(random) : randomExpression(random, 4);
+      std::string expected = parseExpression(source, true);
+      std::string actual = parseExpression(source, false);
+      if (expected != actual)
+        checks.fail("precedence climbing vs recursive descent", source, expected, actual);
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  Checks checks { argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 20261019u };
+  Random random { checks.seed };
+  checkExpressions(checks, random);
+  checkChunks(checks, random);
+  checkReparse(checks, random);
+  checkLineShift(checks);
+  if (checks.failures > 0) {
+    std::cout << checks.failures << " cases diverged" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Runs every tests/lox/*.lox script with the given lox binary and flags and
+# compares what it prints, followed by a line "exit: <status>", with the
+# .out file next to it. Each script runs in a scratch directory of its own,
+# so it may create files relative to it.
+#
+#   golden.sh path/to/lox [flags...]
+lox=$(realpath "$1")
+shift
+dir=$(dirname "$(realpath "$0")")/lox
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+failed=0
+for script in "$dir"/*.lox; do
+  name=$(basename "$script" .lox)
+  mkdir "$scratch/$name"
+  actual=$(cd "$scratch/$name" && "$lox" "$@" "$script" 2>/dev/null; echo "exit: $?")
+  if ! printf '%s\n' "$actual" | diff -u "$dir/$name.out" - > "$scratch/$name.diff"; then
+    echo "FAIL $name $*"
+    cat "$scratch/$name.diff"
+    failed=1
+  fi
+done
+exit $failed